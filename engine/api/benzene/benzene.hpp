@@ -6,8 +6,13 @@ struct GLFWwindow; // Forward Decl
 #include "../libs/stb/stb_image.h"
 #include "../libs/tinyobjloader/tinyobjloader.h"
 
+#include "jobs.hpp"
+
 #include <functional>
 #include <memory>
+#include <mutex>
+#include <optional>
+#include <span>
 #include <string_view>
 #include <unordered_map>
 #include <vector>
@@ -41,13 +46,68 @@ namespace benzene
 
             return "unknown";
         }
-        static Texture load_from_file(const std::string& filename, const std::string& shader_name, Gamut gamut);
+        // What happens to the decoded pixels once a backend uploaded them
+        enum class Residency {
+            Keep,
+            // Freed for every copy of the texture, uploading it again decodes the file again
+            ReleaseAfterUpload
+        };
+        // Block compressed formats, every block holds 4x4 pixels. Bc5 only keeps red and green, for normal maps
+        enum class Compression {
+            None,
+            Bc1,
+            Bc3,
+            Bc5,
+            Bc7
+        };
+        static const char* compression_to_str(Compression compression){
+            switch(compression){
+            case Compression::None: return "none";
+            case Compression::Bc1: return "bc1";
+            case Compression::Bc3: return "bc3";
+            case Compression::Bc5: return "bc5";
+            case Compression::Bc7: return "bc7";
+            }
+
+            return "unknown";
+        }
+        // Where a mip level's blocks are in the pixels
+        struct Level {
+            size_t offset, size;
+            int width, height;
+
+            bool operator==(const Level& other) const = default;
+        };
+
+        // All of these reuse the pixels of a texture that is still alive if it came from the same file or has the same contents
+        static Texture load_from_file(const std::string& filename, const std::string& shader_name, Gamut gamut, Residency residency = Residency::Keep);
+        // Compressed with a full mip chain made on the CPU, see core/texture_baker.hpp. The result is cached in a .bzt file next to the image and mapped from there as long as the image doesn't change
+        static Texture load_baked(const std::string& filename, const std::string& shader_name, Gamut gamut, Compression compression, Residency residency = Residency::Keep);
+        // Generated textures have no file to decode again, so they always keep their pixels
         static Texture load_from_colour(glm::vec3 colour, const std::string& shader_name);
 
-        const std::vector<uint8_t>& bytes() const {
-            return data;
+        // The same pixels bound to another slot, without copying them
+        Texture share_as(const std::string& shader_name, Gamut gamut) const {
+            Texture tex = *this;
+            tex.shader_name = shader_name;
+            tex.gamut = gamut;
+            return tex;
         }
 
+        // Empty once the pixels were released after an upload, backends upload from acquire_pixels() instead
+        std::span<const uint8_t> bytes() const {
+            if(!pixels)
+                return {};
+
+            std::lock_guard lock{pixels->mutex};
+            return {pixels->data.get(), pixels->data ? pixels->size : 0};
+        }
+
+        // Keeps the pixels alive until the returned pointer goes away, decoding them again if they were released
+        std::shared_ptr<const uint8_t> acquire_pixels() const;
+        // Called by backends once the pixels are on the GPU, frees them if the texture was loaded with Residency::ReleaseAfterUpload
+        void release_after_upload() const;
+
         std::pair<int, int> dimensions() const {
             return {width, height};
         }
@@ -64,11 +124,47 @@ namespace benzene
             return gamut;
         }
 
+        // Hash of the pixels and their dimensions, textures with the same hash and gamut can share a GPU texture once their pixels were compared
+        uint64_t get_hash() const {
+            return hash;
+        }
+
+        // Whether both were loaded from the same file or generated with the same contents, which needs no comparison of the pixels
+        bool shares_pixels_with(const Texture& other) const {
+            return pixels && pixels == other.pixels;
+        }
+
+        Compression get_compression() const {
+            return compression;
+        }
+
+        // Every mip level of a compressed texture, finest first. Uncompressed textures only have their full level, which is all of the pixels, and leave this empty
+        const std::vector<Level>& get_levels() const {
+            return levels;
+        }
+
+        // Shared between copies, and between textures loaded from the same file or generated with the same contents
+        struct Pixels {
+            std::mutex mutex;
+            // Straight from stb_image or the mapped .bzt file, nullptr once released
+            std::shared_ptr<const uint8_t> data;
+            size_t size;
+            // File the pixels were decoded or mapped from, empty for generated textures
+            std::string source;
+            Residency residency;
+        };
+
         private:
-        std::vector<uint8_t> data;
+        // Fills in `tex` from a texture that was loaded under `key` and is still alive
+        static bool find_shared(const std::string& key, Residency residency, Texture& tex);
+
+        std::shared_ptr<Pixels> pixels;
         int width, height, channels;
+        uint64_t hash;
         std::string shader_name;
         Gamut gamut;
+        Compression compression;
+        std::vector<Level> levels;
     };
 
     struct Mesh {
@@ -83,6 +179,38 @@ namespace benzene
 
         struct Material {
             float shininess;
+            // Name in the model's material library, empty if it didn't come with one
+            std::string name;
+            // Kd and Ks, used where the material has no map for them
+            glm::vec3 diffuse, specular;
+            // Image files relative to the model's folder, empty where the material has none
+            std::string diffuse_map, specular_map, normal_map;
+        };
+
+        struct Bounds {
+            glm::vec3 min, max;
+            // Radius of a sphere around the object space origin containing every vertex
+            float radius;
+        };
+
+        // A cluster of at most 64 vertices and 124 triangles that follow each other in `indices`, see core/meshlets.hpp
+        struct Meshlet {
+            uint32_t first_index, index_count;
+
+            // Bounds in object space
+            glm::vec3 center;
+            float radius;
+
+            // Every triangle's normal is within the cone around `cone_axis`, `cone_cutoff` is the sine of its half-angle, 1 if it can't be culled
+            glm::vec3 cone_axis;
+            float cone_cutoff;
+        };
+
+        // A coarser version of the mesh, drawn with the same vertices
+        struct Lod {
+            std::vector<uint32_t> indices;
+            // Estimated distance between the simplified and the original surface, in object space units
+            float error;
         };
 
         struct Primitives {
@@ -92,14 +220,65 @@ namespace benzene
 
         std::vector<Vertex> vertices;
         std::vector<uint32_t> indices;
+        // In order of decreasing detail, `indices` is always the full detail level
+        // Their indices refer to `vertices`, so anything that renumbers vertices has to run before they are generated
+        std::vector<Lod> lods;
+        // Empty unless the loader split `indices` into meshlets, in index buffer order
+        std::vector<Meshlet> meshlets;
         std::vector<Texture> textures;
         Material material;
+        // Filled in by loaders, anything else computes them from the vertices when needed
+        std::optional<Bounds> bounds;
+
+        // Meshes read from a .bzm cache leave `vertices` and `indices` empty and point these into the mapped file instead, which `mapping` keeps alive
+        std::shared_ptr<const void> mapping;
+        std::span<const Vertex> mapped_vertices;
+        std::span<const uint32_t> mapped_indices;
+
+        // The vertices and full detail indices, wherever they live
+        std::span<const Vertex> get_vertices() const {
+            return mapping ? mapped_vertices : std::span<const Vertex>{vertices};
+        }
+
+        std::span<const uint32_t> get_indices() const {
+            return mapping ? mapped_indices : std::span<const uint32_t>{indices};
+        }
+
+        // Copies mapped vertices and indices into `vertices` and `indices`, so they can be edited
+        void make_owned(){
+            if(!mapping)
+                return;
+
+            vertices.assign(mapped_vertices.begin(), mapped_vertices.end());
+            indices.assign(mapped_indices.begin(), mapped_indices.end());
+            mapped_vertices = {};
+            mapped_indices = {};
+            mapping.reset();
+        }
+    };
+
+    struct LodConfig {
+        // Target triangle count of every level, relative to the full detail mesh
+        std::vector<float> ratios = {0.5f, 0.25f, 0.125f, 0.0625f};
+        // The chain ends early instead of deviating from the original surface by more than this fraction of the mesh's size
+        float max_error = 0.05f;
+    };
+
+    struct TextureConfig {
+        // Bakes every map into a block compressed mip chain, cached next to the image. Without it the maps are loaded as they are,
+        // which skips encoding on the CPU the first time a model loads but takes several times the GPU memory
+        bool compress = true;
     };
 
     using ModelId = uint64_t;
     struct Batch {
-        Batch(): transforms{}, meshes{}, updated{false} {}
-        void load_mesh_data_from_file(const std::string& folder, const std::string& file);
+        Batch(): transforms{}, meshes{}, updated{false}, dirty_ranges{} {}
+        // The processed meshes are cached in a .bzm file next to the model and mapped from there as long as the model doesn't change
+        // LODs are generated for every mesh if `lod_config` is given, and cached in a .lod file next to the model
+        // Meshes with a material get its diffuse, specular and normal maps as textures, loaded as `texture_config` says, see core/material_loader.hpp
+        void load_mesh_data_from_file(const std::string& folder, const std::string& file, const LodConfig* lod_config = nullptr, const TextureConfig& texture_config = {});
+        // Replaces the LODs of every mesh, generating them in parallel unless `cache_file` holds ones for the same meshes and config
+        void generate_lods(const LodConfig& config = {}, const std::string& cache_file = "");
         void show_inspector(const std::string& window_name, bool* opened = nullptr, size_t i = 0);
         void update(){
             this->updated = true;
@@ -118,11 +297,27 @@ namespace benzene
             glm::vec3 rotation;
             glm::vec3 scale;
         };
+
+        // Tells the backend that transforms [first, first + count) changed, only those are rebuilt and reuploaded
+        // Growing or shrinking `transforms` is picked up automatically and rebuilds everything
+        void mark_dirty(size_t first, size_t count = 1);
+        void mark_all_dirty(){
+            this->mark_dirty(0, transforms.size());
+        }
+
+        void set_transform(size_t i, const Transform& transform){
+            transforms[i] = transform;
+            this->mark_dirty(i);
+        }
+
+        // Returns the sorted, merged [begin, end) ranges dirtied since the last call, and clears them
+        std::vector<std::pair<size_t, size_t>> consume_dirty_ranges();
         
         std::vector<Transform> transforms;
         std::vector<Mesh> meshes;
         private:
         bool updated;
+        std::vector<std::pair<size_t, size_t>> dirty_ranges;
     };
 
     struct FrameData {
@@ -151,11 +346,14 @@ namespace benzene
         
         virtual void draw_debug_window() = 0;
         virtual void set_fps_cap(bool enabled, size_t fps = 60) = 0;
+
+        // Draws on a dedicated thread while the main thread prepares the next frame, the backend then presents by itself
+        virtual void set_render_thread(bool enabled) = 0;
     };
 
     class Instance {
         public:
-        Instance(const char* application_name, size_t width, size_t height);
+        Instance(const char* application_name, size_t width, size_t height, const jobs::Config& jobs_config = {});
         ~Instance();
 
         void run(std::function<void(FrameData&)> functor);
@@ -163,11 +361,16 @@ namespace benzene
             return *backend;
         }
 
+        jobs::Scheduler& get_jobs(){
+            return *scheduler;
+        }
+
         ModelId add_batch(Batch* model);
 
         void set_property(BackendProperties property, glm::vec4 v);
 
         private:
+        std::unique_ptr<jobs::Scheduler> scheduler;
         std::unique_ptr<IBackend> backend;
 
         size_t width, height;
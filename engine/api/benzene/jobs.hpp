@@ -0,0 +1,132 @@
+#pragma once
+
+#include <atomic>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+namespace benzene::jobs
+{
+    struct Config {
+        // 0 means one worker per hardware thread, minus one for the thread that owns the scheduler
+        size_t n_workers = 0;
+        // Pins worker i to core (first_core + i), so the engine stays off the cores the application uses for itself
+        bool pin_workers = false;
+        size_t first_core = 0;
+    };
+
+    // Tracks a group of submitted jobs, the first exception thrown by one of them is rethrown from Scheduler::wait()
+    struct Counter {
+        bool done() const {
+            return pending.load(std::memory_order_acquire) == 0;
+        }
+
+        private:
+        friend class Scheduler;
+        std::atomic<size_t> pending{0};
+        std::mutex error_mutex;
+        std::exception_ptr error;
+    };
+
+    class Scheduler {
+        public:
+        Scheduler(const Config& config = {});
+        ~Scheduler();
+
+        Scheduler(const Scheduler&) = delete;
+        Scheduler& operator=(const Scheduler&) = delete;
+
+        void submit(std::function<void()> job, Counter& counter);
+        // Runs queued jobs on the calling thread until every job in `counter` has finished
+        void wait(Counter& counter);
+
+        // Calls f(chunk_begin, chunk_end) for chunks of at most `grain` elements of [begin, end) and waits for all of them
+        void parallel_for(size_t begin, size_t end, size_t grain, const std::function<void(size_t, size_t)>& f);
+
+        size_t get_worker_count() const {
+            return workers.size();
+        }
+
+        size_t get_executed_count() const {
+            return n_executed.load(std::memory_order_relaxed);
+        }
+
+        size_t get_stolen_count() const {
+            return n_stolen.load(std::memory_order_relaxed);
+        }
+
+        private:
+        struct Job {
+            std::function<void()> f;
+            Counter* counter;
+        };
+
+        // Owners push and pop at the back, thieves take from the front so they get the oldest and usually largest work
+        struct Queue {
+            std::mutex mutex;
+            std::deque<Job> jobs;
+        };
+
+        void push(Job job);
+        bool try_run_one();
+        void run(Job& job);
+        void worker_main(size_t index, const Config& config);
+
+        // Queue 0 is shared by every thread that isn't a worker, worker i owns queue i + 1
+        std::unique_ptr<Queue[]> queues;
+        size_t n_queues;
+        std::vector<std::thread> workers;
+
+        std::atomic<size_t> n_queued{0};
+        std::atomic<bool> running{true};
+        std::mutex sleep_mutex;
+        std::condition_variable sleep_cv;
+
+        std::atomic<size_t> n_executed{0}, n_stolen{0};
+    };
+
+    // A set of tasks where a task only starts once all of the tasks it depends on have finished
+    class TaskGraph {
+        public:
+        using TaskId = size_t;
+
+        TaskId add(std::function<void()> task);
+        void depends_on(TaskId task, TaskId dependency);
+
+        // Runs every task to completion, throws if the dependencies contain a cycle
+        void run(Scheduler& scheduler);
+        // Same, but one task after the other on the calling thread
+        void run();
+
+        size_t size() const {
+            return nodes.size();
+        }
+
+        private:
+        // Throws if there is a cycle
+        std::vector<TaskId> topological_order() const;
+
+        struct Node {
+            std::function<void()> task;
+            std::vector<TaskId> successors;
+            size_t n_dependencies = 0;
+            std::atomic<size_t> remaining{0};
+        };
+        std::deque<Node> nodes;
+    };
+
+    // The scheduler of the running benzene::Instance, or nullptr if there is none
+    Scheduler* current();
+    void set_current(Scheduler* scheduler);
+
+    // Runs on the current scheduler, or on the calling thread if there isn't one
+    void parallel_for(size_t begin, size_t end, size_t grain, const std::function<void(size_t, size_t)>& f);
+    void run(TaskGraph& graph);
+} // namespace benzene::jobs
@@ -15,6 +15,10 @@ struct format::formatter<const GLubyte*> {
     }
 };
 
+namespace benzene {
+    class Camera;
+} // namespace benzene
+
 namespace benzene::opengl {
     constexpr bool validation = true;
     constexpr bool debug = true;
@@ -26,9 +30,28 @@ namespace benzene::opengl {
     class IRenderer {
         public:
         virtual ~IRenderer() {}
-        virtual void draw(std::unordered_map<benzene::ModelId, benzene::Batch*>& batches, benzene::FrameData& frame_data) = 0;
+        virtual void draw(std::unordered_map<benzene::ModelId, benzene::Batch*>& batches, const benzene::Camera& camera, benzene::FrameData& frame_data) = 0;
         virtual void framebuffer_resize_callback(size_t width, size_t height) = 0;
+        // Runs on the main thread while the render thread may be drawing, so it only reads what publish_debug_state() copied
+        virtual void draw_debug_window() = 0;
+        // Called at the end of every frame and after the renderer is created, with the Backend's lock held
+        virtual void publish_debug_state() = 0;
         glm::vec4 clear_colour;
+
+        // The debug window runs on the main thread, which may not own the context and mustn't touch state the frame uses,
+        // so everything it changes is queued until the next frame starts. Only called with the Backend's lock held
+        void defer(std::function<void()> f){
+            deferred.push_back(std::move(f));
+        }
+
+        void run_deferred(){
+            for(auto& f : deferred)
+                f();
+            deferred.clear();
+        }
+
+        private:
+        std::vector<std::function<void()>> deferred;
     };
 } // !benzene::opengl
 
@@ -42,6 +65,9 @@ namespace gl {
     template<>
     struct type_to_enum<float> { static constexpr GLenum value = GL_FLOAT; };
 
+    template<>
+    struct type_to_enum<short> { static constexpr GLenum value = GL_SHORT; };
+
     template<typename T>
     inline constexpr GLenum type_to_enum_v = type_to_enum<T>::value;
 
@@ -55,19 +81,39 @@ namespace gl {
         (glDisable(options), ...);
     }
     
+    // Layout has to match DrawElementsIndirectCommand, so it can be written straight into a GL_DRAW_INDIRECT_BUFFER
     struct DrawCommand {
+        uint32_t index_count;
         uint32_t instance_count;
-        uint32_t base_instance;
-
         uint32_t first_index;
-        uint32_t index_count;
-
         uint32_t base_vertex;
+        uint32_t base_instance;
     };
+    static_assert(sizeof(DrawCommand) == (5 * sizeof(uint32_t)));
     
     template<typename IndexType, GLenum draw_mode = GL_TRIANGLES>
     void draw(const DrawCommand& cmd){
-        glDrawElementsInstancedBaseVertexBaseInstance(draw_mode, cmd.index_count, gl::type_to_enum_v<IndexType>, (const void*)(uintptr_t)cmd.first_index, cmd.instance_count, cmd.base_vertex, cmd.base_instance);
+        glDrawElementsInstancedBaseVertexBaseInstance(draw_mode, cmd.index_count, gl::type_to_enum_v<IndexType>, (const void*)(uintptr_t)(cmd.first_index * sizeof(IndexType)), cmd.instance_count, cmd.base_vertex, cmd.base_instance);
+    }
+
+    // Draws `count` DrawCommands from the currently bound GL_DRAW_INDIRECT_BUFFER, starting at command `first`
+    template<typename IndexType, GLenum draw_mode = GL_TRIANGLES>
+    void multi_draw_indirect(size_t first, size_t count){
+        glMultiDrawElementsIndirect(draw_mode, gl::type_to_enum_v<IndexType>, (const void*)(uintptr_t)(first * sizeof(DrawCommand)), count, sizeof(DrawCommand));
+    }
+
+    // Internal format of a block compressed benzene::Texture, Srgb ones decode to linear when sampled. BC5 has no sRGB variant, it's only meant for normals
+    inline GLenum compressed_format(benzene::Texture::Compression compression, benzene::Texture::Gamut gamut){
+        bool srgb = gamut == benzene::Texture::Gamut::Srgb;
+        switch (compression){
+            case benzene::Texture::Compression::Bc1: return srgb ? GL_COMPRESSED_SRGB_S3TC_DXT1_EXT : GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+            case benzene::Texture::Compression::Bc3: return srgb ? GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT : GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+            case benzene::Texture::Compression::Bc5: return GL_COMPRESSED_RG_RGTC2;
+            case benzene::Texture::Compression::Bc7: return srgb ? GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM : GL_COMPRESSED_RGBA_BPTC_UNORM;
+            case benzene::Texture::Compression::None: break;
+        }
+
+        return GL_NONE;
     }
 
     struct InstanceData {
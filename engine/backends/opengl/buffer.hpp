@@ -27,19 +27,28 @@ namespace benzene::opengl {
             glDeleteBuffers(1, &handle);
         }
 
-        void bind(){
+        void bind() const {
             glBindBuffer(target, handle);
         }
 
-        void bind_base(GLint binding){
+        void bind_base(GLint binding) const {
             static_assert(target == GL_ATOMIC_COUNTER_BUFFER || target == GL_TRANSFORM_FEEDBACK_BUFFER || target == GL_UNIFORM_BUFFER || target == GL_SHADER_STORAGE_BUFFER);
             glBindBufferBase(target, binding, handle);
         }
 
-        GLuint operator()(){
+        void bind_range(GLint binding, size_t offset, size_t size) const {
+            static_assert(target == GL_ATOMIC_COUNTER_BUFFER || target == GL_TRANSFORM_FEEDBACK_BUFFER || target == GL_UNIFORM_BUFFER || target == GL_SHADER_STORAGE_BUFFER);
+            glBindBufferRange(target, binding, handle, offset, size);
+        }
+
+        GLuint operator()() const {
             return handle;
         }
 
+        size_t get_size() const {
+            return size;
+        }
+
         void* map(){
             if(!mapped_addr)
                 mapped_addr = glMapNamedBufferRange(handle, 0, size, storage_flags &= ~GL_DYNAMIC_STORAGE_BIT);
@@ -60,16 +69,26 @@ namespace benzene::opengl {
             glFlushMappedNamedBufferRange(handle, 0, size);
         }
 
-        void write(void* data){ // Since we can't use a member variable as default argument
+        void write(const void* data){ // Since we can't use a member variable as default argument
             write(data, 0, size);
         }
 
-        void write(void* data, size_t offset, size_t size){
-            if(!storage_flags & GL_DYNAMIC_STORAGE_BIT)
+        void write(const void* data, size_t offset, size_t size){
+            if(!(storage_flags & GL_DYNAMIC_STORAGE_BIT))
                 throw std::runtime_error("opengl/Buffer: Can't write to non-GL_DYNAMIC_STORAGE_BIT after creation");
             glNamedBufferSubData(handle, offset, size, data);
         }
 
+        // Synchronous, waits for every command writing to the buffer to finish
+        void read(void* data, size_t offset, size_t size) const {
+            glGetNamedBufferSubData(handle, offset, size, data);
+        }
+
+        template<GLenum dst_target>
+        void copy_to(Buffer<dst_target>& dst, size_t src_offset, size_t dst_offset, size_t size) const {
+            glCopyNamedBufferSubData(handle, dst(), src_offset, dst_offset, size);
+        }
+
         private:
         size_t size;
         GLuint handle;
@@ -4,6 +4,8 @@
 #include <thread>
 #include <regex>
 #include "renderer/forward.hpp"
+#include "renderer/indirect.hpp"
+#include "renderer/gpu_cull.hpp"
 
 
 using namespace benzene::opengl;
@@ -53,11 +55,16 @@ Backend::Backend([[maybe_unused]] const char* application_name): is_wireframe{fa
 	min_frame_time = 9999.0f;
 	last_frame = 0;
 	last_frame_times = {};
+	texture_sharing = {};
 	frame_counter = 0;
 	fps = 0;
 	fps_cap_enabled = false;
 	extension_window_is_showing = false;
 	driver_info_window_is_showing = false;
+	render_thread_requested = false;
+	frames_submitted = 0;
+	frames_rendered = 0;
+	stop_requested = false;
 	glfwSwapInterval(0); // Disable Vsync
 
 	if(!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
@@ -91,6 +98,7 @@ Backend::Backend([[maybe_unused]] const char* application_name): is_wireframe{fa
 
 	size_t width = Display::instance().get_width();
 	size_t height = Display::instance().get_height();
+	framebuffer_size = {(int)width, (int)height};
 	glViewport(0, 0, width, height);
 
 	gl::enable(GL_CULL_FACE, GL_DEPTH_TEST, GL_MULTISAMPLE, GL_FRAMEBUFFER_SRGB); // Enable Face-Culling, Depth-Testing, MSAA and Gamma correction
@@ -98,7 +106,9 @@ Backend::Backend([[maybe_unused]] const char* application_name): is_wireframe{fa
 	glCullFace(GL_BACK);
 	glFrontFace(GL_CCW);
 
-	this->renderer = new ForwardRenderer{(int)width, (int)height};
+	this->renderer = nullptr;
+	this->renderer_frame_times = {};
+	this->set_renderer(RendererType::Forward);
 	
 	IMGUI_CHECKVERSION();
 	ImGui::CreateContext();
@@ -107,10 +117,49 @@ Backend::Backend([[maybe_unused]] const char* application_name): is_wireframe{fa
 	ImGui_ImplGlfw_InitForOpenGL(Display::instance()(), true);
 	ImGui_ImplOpenGL3_Init();
 
+	GLint n_extensions = 0;
+	glGetIntegerv(GL_NUM_EXTENSIONS, &n_extensions);
+	for(GLint i = 0; i < n_extensions; i++)
+		extensions.emplace_back((const char*)glGetStringi(GL_EXTENSIONS, i));
+
+	auto get_integer = [](GLenum v) -> GLint {
+		GLint i{};
+		glGetIntegerv(v, &i);
+		return i;
+	};
+
+	driver_state_info = {
+		format_to_str("opengl: Context Version: {:d}.{:d}", get_integer(GL_MAJOR_VERSION), get_integer(GL_MINOR_VERSION)),
+		format_to_str("        Vendor: {:s}", glGetString(GL_VENDOR)),
+		format_to_str("        Renderer: {:s}", glGetString(GL_RENDERER)),
+		format_to_str("        GL Version: {:s}", glGetString(GL_VERSION)),
+		format_to_str("        GLSL Version: {:s}", glGetString(GL_SHADING_LANGUAGE_VERSION)),
+		format_to_str("        MSAA: Buffers: {:d}, samples: {:d}", get_integer(GL_SAMPLE_BUFFERS), get_integer(GL_SAMPLES))
+	};
+
+	driver_capabilities_info = {
+		format_to_str("opengl: Capabilities:\n"),
+		format_to_str("        Max Clip Distances: {:d}", get_integer(GL_MAX_CLIP_DISTANCES)),
+		format_to_str("        Max Texture Units: {:d}", get_integer(GL_MAX_COMBINED_TEXTURE_IMAGE_UNITS)),
+		format_to_str("        Max Uniform Blocks: {:d}", get_integer(GL_MAX_COMBINED_UNIFORM_BLOCKS)),
+		format_to_str("        Max SSBO Bindings: {:d}", get_integer(GL_MAX_SHADER_STORAGE_BUFFER_BINDINGS)),
+		format_to_str("        Max Vertex Attribs: {:d}", get_integer(GL_MAX_VERTEX_ATTRIBS)),
+		format_to_str("        Max Fragment Outputs: {:d}", get_integer(GL_MAX_DRAW_BUFFERS)),
+		format_to_str("        Max Framebuffer Dimensions: {:d}x{:d}", get_integer(GL_MAX_FRAMEBUFFER_WIDTH), get_integer(GL_MAX_FRAMEBUFFER_HEIGHT)),
+		format_to_str("        Max MSAA Samples: {:d}", get_integer(GL_MAX_INTEGER_SAMPLES)),
+		format_to_str("        Max Tesselation Patch Vertices: {:d}", get_integer(GL_MAX_PATCH_VERTICES))
+	};
+
 	print("opengl: Started OpenGL Backend\n");
 }
 
 Backend::~Backend(){
+	this->stop_render_thread();
+
+	for(auto& snapshot : snapshots)
+		for(auto* list : snapshot.draw_lists)
+			IM_DELETE(list);
+
 	delete this->renderer;
 
 	ImGui_ImplOpenGL3_Shutdown();
@@ -118,55 +167,300 @@ Backend::~Backend(){
 }
 
 void Backend::framebuffer_resize_callback(int width, int height){
-	glViewport(0, 0, width, height);
-
-	renderer->framebuffer_resize_callback((size_t)width, (size_t)height);
+	// Called from glfwPollEvents on the main thread, so the resize is applied before the next frame is drawn
+	std::lock_guard lock{render_mutex};
+	pending_framebuffer_size = {width, height};
 }
 
 void Backend::frame_update(std::unordered_map<benzene::ModelId, benzene::Batch*>& batches, benzene::FrameData& frame_data){
-	auto time_begin = std::chrono::high_resolution_clock::now();
 	auto time = glfwGetTime();
 	frame_data.delta_time = time - last_frame;
 	last_frame = time;
 
-	renderer->draw(batches, frame_data);
-	ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+	// ImGui input state only exists on the main thread, so the camera moves here and is handed to the renderer by value
+	camera.process_input(frame_data.delta_time);
 
-	this->frame_counter++;
+	if(render_thread_requested && !render_thread.joinable())
+		this->start_render_thread();
+	else if(!render_thread_requested && render_thread.joinable())
+		this->stop_render_thread();
 
-	auto time_end = std::chrono::high_resolution_clock::now();
-	frame_time = (float)(std::chrono::duration<double, std::milli>(time_end - time_begin).count());
+	if(!render_thread.joinable()){
+		this->render_frame(batches, camera, frame_data, ImGui::GetDrawData());
+		Display::instance().swap_buffers();
+		return;
+	}
 
-	auto fps_timer = (float)std::chrono::duration<double, std::milli>(time_end - last_frame_timestamp).count();
-	if(fps_timer > 1000.0f){
-		fps = ((float)frame_counter * (1000.0f / fps_timer));
-		frame_counter = 0;
-		last_frame_timestamp = time_end;
+	// There are two snapshots, wait until the frame that last used this one has been drawn
+	std::unique_lock lock{frame_mutex};
+	frame_cv.wait(lock, [this]{ return (frames_rendered + 1 >= frames_submitted) || render_error; });
+	if(render_error){
+		auto error = render_error;
+		render_error = nullptr;
+		lock.unlock();
+
+		this->render_thread_requested = false;
+		this->stop_render_thread();
+		std::rethrow_exception(error);
 	}
-	
+	lock.unlock();
+
+	this->write_snapshot(snapshots[frames_submitted % snapshots.size()], batches, frame_data);
+
+	lock.lock();
+	frames_submitted++;
+	lock.unlock();
+	frame_cv.notify_all();
+}
+
+void Backend::render_frame(std::unordered_map<benzene::ModelId, benzene::Batch*>& batches, const Camera& camera, benzene::FrameData& frame_data, ImDrawData* draw_data){
+	auto time_begin = std::chrono::high_resolution_clock::now();
+	bool wireframe = false;
+	{
+		// Only held while what the main thread asked for is applied and while the stats are published, the frame itself runs alongside the next simulation step
+		std::lock_guard lock{render_mutex};
+
+		if(pending_framebuffer_size){
+			framebuffer_size = *pending_framebuffer_size;
+			pending_framebuffer_size.reset();
+
+			glViewport(0, 0, framebuffer_size.first, framebuffer_size.second);
+			renderer->framebuffer_resize_callback((size_t)framebuffer_size.first, (size_t)framebuffer_size.second);
+		}
+
+		if(requested_renderer){
+			this->set_renderer(*requested_renderer);
+			requested_renderer.reset();
+		}
+
+		if(requested_clear_colour){
+			renderer->clear_colour = *requested_clear_colour;
+			requested_clear_colour.reset();
+		}
+
+		renderer->run_deferred();
+		wireframe = is_wireframe;
+	}
+
+	if constexpr (wireframe_rendering)
+		glPolygonMode(GL_FRONT_AND_BACK, wireframe ? GL_LINE : GL_FILL);
+
+	renderer->draw(batches, camera, frame_data);
+
+	ImGui_ImplOpenGL3_NewFrame();
+	ImGui_ImplOpenGL3_RenderDrawData(draw_data);
+
+	{
+		std::lock_guard lock{render_mutex};
+		this->frame_counter++;
+
+		auto time_end = std::chrono::high_resolution_clock::now();
+		frame_time = (float)(std::chrono::duration<double, std::milli>(time_end - time_begin).count());
+
+		auto& renderer_times = renderer_frame_times[(int)renderer_type];
+		renderer_times.total += frame_time;
+		renderer_times.frames++;
+
+		auto fps_timer = (float)std::chrono::duration<double, std::milli>(time_end - last_frame_timestamp).count();
+		if(fps_timer > 1000.0f){
+			fps = ((float)frame_counter * (1000.0f / fps_timer));
+			frame_counter = 0;
+			last_frame_timestamp = time_end;
+		}
+
+		texture_sharing = Texture::get_sharing_stats();
+		renderer->publish_debug_state();
+	}
+
 	if(fps_cap_enabled)
-		std::this_thread::sleep_for(std::chrono::duration<double, std::milli>(std::chrono::duration<double, std::milli>(1000 / this->fps_cap) - (time_end - time_begin)));
+		std::this_thread::sleep_for(std::chrono::duration<double, std::milli>(std::chrono::duration<double, std::milli>(1000 / this->fps_cap) - (std::chrono::high_resolution_clock::now() - time_begin)));
 }
 
-void Backend::imgui_update(){
+void Backend::write_snapshot(FrameSnapshot& snapshot, std::unordered_map<benzene::ModelId, benzene::Batch*>& batches, const benzene::FrameData& frame_data){
+	snapshot.camera = camera;
+	snapshot.frame_data = frame_data;
+
+	// ImGui reuses its draw lists for the next frame, so the render thread gets its own copies
+	for(auto* list : snapshot.draw_lists)
+		IM_DELETE(list);
+	snapshot.draw_lists.clear();
+
+	auto* draw_data = ImGui::GetDrawData();
+	snapshot.draw_data = *draw_data;
+	for(int i = 0; i < draw_data->CmdListsCount; i++)
+		snapshot.draw_lists.push_back(draw_data->CmdLists[i]->CloneOutput());
+	snapshot.draw_data.CmdLists = snapshot.draw_lists.data();
+
+	for(auto& [id, batch] : batches){
+		auto& mirror = snapshot.mirrors[id];
+		auto& state = mirror_states[id];
+
+		if(batch->is_updated()){
+			state.mesh_generation++;
+			mirror.update();
+		}
+
+		// The other snapshot still has to catch up with meshes replaced last frame, but the renderer already rebuilt them then
+		if(snapshot.mesh_generations[id] != state.mesh_generation){
+			mirror.meshes = batch->meshes;
+			snapshot.mesh_generations[id] = state.mesh_generation;
+		}
+
+		// This snapshot was last written two frames ago, so it needs both last frame's and this frame's changes
+		auto ranges = batch->consume_dirty_ranges();
+		auto size = batch->transforms.size();
+		bool resized = (size != state.size);
+		if(resized || state.resized || mirror.transforms.size() != size){
+			mirror.transforms = batch->transforms;
+		} else {
+			for(const auto& frame_ranges : {std::cref(state.ranges), std::cref(ranges)})
+				for(auto [begin, end] : frame_ranges.get())
+					std::copy(batch->transforms.begin() + begin, batch->transforms.begin() + end, mirror.transforms.begin() + begin);
+		}
+
+		for(auto [begin, end] : ranges)
+			mirror.mark_dirty(begin, end - begin);
+
+		state.size = size;
+		state.resized = resized;
+		state.ranges = std::move(ranges);
+
+		snapshot.batches[id] = &mirror;
+	}
+}
+
+void Backend::start_render_thread(){
+	// The ImGui font texture has to exist before ImGui::NewFrame runs without the context
 	ImGui_ImplOpenGL3_NewFrame();
+	glFinish();
+	glfwMakeContextCurrent(nullptr);
+
+	frames_submitted = 0;
+	frames_rendered = 0;
+	stop_requested = false;
+	// Mirrors left over from an earlier run of the thread missed every change made since, start from scratch
+	for(auto& snapshot : snapshots){
+		snapshot.mirrors.clear();
+		snapshot.mesh_generations.clear();
+		snapshot.batches.clear();
+	}
+	mirror_states.clear();
+
+	render_thread = std::thread{[this]{ this->render_thread_main(); }};
+
+	print("opengl: Started render thread\n");
+}
+
+void Backend::stop_render_thread(){
+	if(!render_thread.joinable())
+		return;
+
+	{
+		std::lock_guard lock{frame_mutex};
+		stop_requested = true;
+	}
+	frame_cv.notify_all();
+	render_thread.join();
+
+	Display::instance().make_context_current();
+	print("opengl: Stopped render thread\n");
+}
+
+void Backend::render_thread_main(){
+	Display::instance().make_context_current();
+	glfwSwapInterval(0);
+
+	while(true){
+		std::unique_lock lock{frame_mutex};
+		frame_cv.wait(lock, [this]{ return (frames_rendered < frames_submitted) || stop_requested; });
+		if(frames_rendered == frames_submitted)
+			break; // Stopping, and every submitted frame has been drawn
+
+		auto& snapshot = snapshots[frames_rendered % snapshots.size()];
+		lock.unlock();
+
+		try {
+			this->render_frame(snapshot.batches, snapshot.camera, snapshot.frame_data, &snapshot.draw_data);
+			Display::instance().swap_buffers();
+		} catch(...) {
+			lock.lock();
+			render_error = std::current_exception();
+			lock.unlock();
+			frame_cv.notify_all();
+			break;
+		}
+
+		lock.lock();
+		frames_rendered++;
+		lock.unlock();
+		frame_cv.notify_all();
+	}
+
+	glFinish();
+	glfwMakeContextCurrent(nullptr);
+}
+
+void Backend::imgui_update(){
+	// The renderer half is driven from render_frame, which may run without the context on this thread
+	if(!render_thread.joinable())
+		ImGui_ImplOpenGL3_NewFrame();
 	ImGui_ImplGlfw_NewFrame();
 }
 
 void Backend::end_run(){
+	this->stop_render_thread();
 	glFinish();
 }
 
 void Backend::set_property(benzene::BackendProperties property, glm::vec4 v){
+	// Applied when the next frame starts, the render thread may be reading it right now
+	std::lock_guard lock{render_mutex};
 	switch (property)
 	{
-		case benzene::BackendProperties::ClearColour: renderer->clear_colour = v;
+		case benzene::BackendProperties::ClearColour: requested_clear_colour = v;
+	}
+}
+
+void Backend::set_renderer(RendererType type){
+	if(type == RendererType::ForwardIndirect && !GLAD_GL_ARB_multi_draw_indirect){
+		print("opengl: Need GL_ARB_multi_draw_indirect for the indirect renderer, which the current driver does not support\n");
+		return;
+	}
+
+	// Compute shaders and SSBO atomics are all the culling pass needs, nothing past GL 4.3
+	if(type == RendererType::GpuCulled && !(GLAD_GL_ARB_multi_draw_indirect && GLAD_GL_ARB_compute_shader)){
+		print("opengl: Need GL_ARB_multi_draw_indirect and GL_ARB_compute_shader for the GPU culling renderer, which the current driver does not support\n");
+		return;
+	}
+
+	glm::vec4 clear_colour{0, 0, 0, 1};
+	if(renderer){
+		clear_colour = renderer->clear_colour;
+		delete renderer;
 	}
+
+	auto [width, height] = framebuffer_size;
+	switch (type){
+		case RendererType::Forward: renderer = new ForwardRenderer{width, height}; break;
+		case RendererType::ForwardIndirect: renderer = new IndirectRenderer{width, height}; break;
+		case RendererType::GpuCulled: renderer = new GpuCullRenderer{width, height}; break;
+	}
+
+	renderer->clear_colour = clear_colour;
+	renderer->publish_debug_state();
+	renderer_type = type;
+
+	min_frame_time = 9999.0f;
+	max_frame_time = 0.0f;
 }
 
 #pragma region ImGui Drawing
 
 void Backend::draw_debug_window(){
+	// The render thread may be drawing the previous frame right now, so everything below only reads what it published at the end of its last frame
+	// and changes go through requests or the renderer's defer(), which are picked up when the next frame starts
+	std::lock_guard lock{render_mutex};
+
 	ImGui::Begin("Benzene", NULL, ImGuiWindowFlags_MenuBar);
 
 	if(ImGui::BeginMenuBar()){
@@ -177,14 +471,10 @@ void Backend::draw_debug_window(){
 		ImGui::EndMenuBar();
 	}
 
-	if constexpr (wireframe_rendering){
+	if constexpr (wireframe_rendering)
 		ImGui::Checkbox("Wireframe rendering", &this->is_wireframe);
 
-		if(this->is_wireframe)
-			glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
-		else
-			glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
-	}
+	ImGui::Checkbox("Render thread", &this->render_thread_requested);
 
 	std::rotate(last_frame_times.begin(), last_frame_times.begin() + 1, last_frame_times.end());
 	last_frame_times.back() = this->frame_time;
@@ -197,6 +487,32 @@ void Backend::draw_debug_window(){
 
 	ImGui::PlotLines("Frame times (ms)", last_frame_times.data(), last_frame_times.size(), 0, "", min_frame_time, max_frame_time, ImVec2{0, 80});
 	ImGui::Text("FPS: %f\n", this->fps);
+
+	if(auto* scheduler = jobs::current(); scheduler && ImGui::CollapsingHeader("Jobs")){
+		ImGui::Text("Workers: %zu\n", scheduler->get_worker_count());
+		ImGui::Text("Jobs executed: %zu, stolen: %zu\n", scheduler->get_executed_count(), scheduler->get_stolen_count());
+	}
+
+	if(ImGui::CollapsingHeader("Textures")){
+		const auto [textures, references] = texture_sharing;
+		ImGui::Text("GL textures: %zu, shared by %zu mesh texture(s)\n", textures, references);
+	}
+
+	if(ImGui::CollapsingHeader("Renderer")){
+		const char* renderer_names[] = {renderer_type_to_str(RendererType::Forward), renderer_type_to_str(RendererType::ForwardIndirect), renderer_type_to_str(RendererType::GpuCulled)};
+		int selected = (int)renderer_type;
+		if(ImGui::Combo("Renderer", &selected, renderer_names, renderer_frame_times.size()) && selected != (int)renderer_type)
+			this->requested_renderer = (RendererType)selected;
+
+		renderer->draw_debug_window();
+
+		for(size_t i = 0; i < renderer_frame_times.size(); i++){
+			const auto& [total, frames] = renderer_frame_times[i];
+			if(frames > 0)
+				ImGui::Text("%s: %f ms average frame time over %zu frames\n", renderer_names[i], total / frames, frames);
+		}
+	}
+
 	ImGui::End();
 
 	if(extension_window_is_showing)
@@ -218,46 +534,23 @@ void Backend::show_extension_window(bool& opened){
 	
 	ImGui::BeginChild("Scrolling", ImVec2{0, 0}, true);
 
-	GLint n = 0;
-	glGetIntegerv(GL_NUM_EXTENSIONS, &n);
-
-	for(GLint i = 0; i < n; i++){
-		auto str = std::string{(const char*)glGetStringi(GL_EXTENSIONS, i)};
+	for(const auto& str : extensions)
 		if(std::regex_search(str, regex))
 			ImGui::Text("%s", str.c_str());
-	}
 
 	ImGui::EndChild();
 	ImGui::End();
 }
 
 void Backend::show_driver_info_window(bool& opened){
-    auto get_integer = [](GLenum v) -> GLint {
-		GLint i{};
-		glGetIntegerv(v, &i);
-		return i;
-	};
-
-    auto show_state_info = [&get_integer](){
-        ImGui::TextUnformatted(format_to_str("opengl: Context Version: {:d}.{:d}", get_integer(GL_MAJOR_VERSION), get_integer(GL_MINOR_VERSION)).c_str());
-	    ImGui::TextUnformatted(format_to_str("        Vendor: {:s}", glGetString(GL_VENDOR)).c_str());
-	    ImGui::TextUnformatted(format_to_str("        Renderer: {:s}", glGetString(GL_RENDERER)).c_str());
-	    ImGui::TextUnformatted(format_to_str("        GL Version: {:s}", glGetString(GL_VERSION)).c_str());
-    	ImGui::TextUnformatted(format_to_str("        GLSL Version: {:s}", glGetString(GL_SHADING_LANGUAGE_VERSION)).c_str());
-	    ImGui::TextUnformatted(format_to_str("        MSAA: Buffers: {:d}, samples: {:d}", get_integer(GL_SAMPLE_BUFFERS), get_integer(GL_SAMPLES)).c_str());
+    auto show_state_info = [this](){
+        for(const auto& line : driver_state_info)
+            ImGui::TextUnformatted(line.c_str());
     };
 
-    auto show_capabilities_info = [&get_integer](){
-        ImGui::TextUnformatted(format_to_str("opengl: Capabilities:\n").c_str());
-	    ImGui::TextUnformatted(format_to_str("        Max Clip Distances: {:d}", get_integer(GL_MAX_CLIP_DISTANCES)).c_str());
-	    ImGui::TextUnformatted(format_to_str("        Max Texture Units: {:d}", get_integer(GL_MAX_COMBINED_TEXTURE_IMAGE_UNITS)).c_str());
-	    ImGui::TextUnformatted(format_to_str("        Max Uniform Blocks: {:d}", get_integer(GL_MAX_COMBINED_UNIFORM_BLOCKS)).c_str());
-	    ImGui::TextUnformatted(format_to_str("        Max SSBO Bindings: {:d}", get_integer(GL_MAX_SHADER_STORAGE_BUFFER_BINDINGS)).c_str());
-	    ImGui::TextUnformatted(format_to_str("        Max Vertex Attribs: {:d}", get_integer(GL_MAX_VERTEX_ATTRIBS)).c_str());
-	    ImGui::TextUnformatted(format_to_str("        Max Fragment Outputs: {:d}", get_integer(GL_MAX_DRAW_BUFFERS)).c_str());
-	    ImGui::TextUnformatted(format_to_str("        Max Framebuffer Dimensions: {:d}x{:d}", get_integer(GL_MAX_FRAMEBUFFER_WIDTH), get_integer(GL_MAX_FRAMEBUFFER_HEIGHT)).c_str());
-	    ImGui::TextUnformatted(format_to_str("        Max MSAA Samples: {:d}", get_integer(GL_MAX_INTEGER_SAMPLES)).c_str());
-        ImGui::TextUnformatted(format_to_str("        Max Tesselation Patch Vertices: {:d}", get_integer(GL_MAX_PATCH_VERTICES)).c_str());
+    auto show_capabilities_info = [this](){
+        for(const auto& line : driver_capabilities_info)
+            ImGui::TextUnformatted(line.c_str());
     };
 
     ImGui::Begin("Driver Info", &opened);
@@ -3,12 +3,17 @@
 #include "base.hpp"
 
 #include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <optional>
+#include <thread>
 
 #include "model/batch.hpp"
 #include "pipeline.hpp"
 #include "framebuffer.hpp"
 
 #include "../../core/display.hpp"
+#include "../../core/camera.hpp"
 
 #include "../../libs/imgui/imgui.h"
 #include "libs/imgui/imgui_impl_glfw.h"
@@ -17,6 +22,21 @@
 namespace benzene::opengl {
     class Backend : public IBackend {
         public:
+        enum class RendererType : int {
+            Forward,
+            ForwardIndirect,
+            GpuCulled
+        };
+        static const char* renderer_type_to_str(RendererType type){
+            switch(type){
+            case RendererType::Forward: return "Forward";
+            case RendererType::ForwardIndirect: return "Forward (Multi-draw indirect)";
+            case RendererType::GpuCulled: return "Forward (GPU culling)";
+            }
+
+            return "unknown";
+        }
+
         Backend(const char* application_name);
         ~Backend();
 
@@ -36,6 +56,7 @@ namespace benzene::opengl {
         }
 
         void set_property(BackendProperties property, glm::vec4 v);
+        void set_renderer(RendererType type);
 
         private:
         void framebuffer_resize_callback(int width, int height);
@@ -65,7 +86,66 @@ namespace benzene::opengl {
             this->fps_cap = fps;
         }
 
+        void set_render_thread(bool enabled){
+            this->render_thread_requested = enabled;
+        }
+
+        // Everything the render thread needs for one frame, written by the main thread and never touched by it again until the frame has been drawn
+        struct FrameSnapshot {
+            std::unordered_map<ModelId, benzene::Batch> mirrors;
+            std::unordered_map<ModelId, uint64_t> mesh_generations;
+            std::unordered_map<ModelId, benzene::Batch*> batches;
+
+            Camera camera;
+            benzene::FrameData frame_data;
+
+            ImDrawData draw_data;
+            std::vector<ImDrawList*> draw_lists;
+        };
+
+        // Main thread bookkeeping per batch, so a snapshot only has to copy what changed since it was last written two frames ago
+        struct MirrorState {
+            uint64_t mesh_generation = 1;
+            size_t size = 0;
+            bool resized = false;
+            std::vector<std::pair<size_t, size_t>> ranges;
+        };
+
+        void render_frame(std::unordered_map<ModelId, benzene::Batch*>& batches, const Camera& camera, benzene::FrameData& frame_data, ImDrawData* draw_data);
+        void write_snapshot(FrameSnapshot& snapshot, std::unordered_map<ModelId, benzene::Batch*>& batches, const benzene::FrameData& frame_data);
+        void start_render_thread();
+        void stop_render_thread();
+        void render_thread_main();
+
         IRenderer* renderer;
+        RendererType renderer_type;
+        std::optional<RendererType> requested_renderer;
+        std::optional<glm::vec4> requested_clear_colour;
+
+        Camera camera;
+
+        // Guards what the main thread requests and what the frame publishes for the debug window, the frame itself is drawn without it
+        std::mutex render_mutex;
+        std::optional<std::pair<int, int>> pending_framebuffer_size;
+        std::pair<int, int> framebuffer_size;
+
+        bool render_thread_requested;
+        std::thread render_thread;
+        std::mutex frame_mutex;
+        std::condition_variable frame_cv;
+        size_t frames_submitted, frames_rendered;
+        bool stop_requested;
+        std::exception_ptr render_error;
+
+        std::array<FrameSnapshot, 2> snapshots;
+        std::unordered_map<ModelId, MirrorState> mirror_states;
+
+        // Accumulated frame times per renderer, so renderers can be compared after switching between them
+        struct RendererFrameTimes {
+            double total;
+            size_t frames;
+        };
+        std::array<RendererFrameTimes, 3> renderer_frame_times;
 
         bool is_wireframe, fps_cap_enabled;
         float last_frame, frame_time, fps, min_frame_time, max_frame_time;
@@ -74,10 +154,15 @@ namespace benzene::opengl {
         std::chrono::time_point<std::chrono::high_resolution_clock> last_frame_timestamp;
 
         std::array<float, 100> last_frame_times;
+        // Texture::get_sharing_stats() as of the end of the last frame, the render thread creates and deletes textures
+        std::pair<size_t, size_t> texture_sharing;
 
         void show_extension_window(bool &opened);
         void show_driver_info_window(bool& opened);
 
+        // Queried once up front, the windows showing them may be drawn while the context is current on the render thread
+        std::vector<std::string> extensions, driver_state_info, driver_capabilities_info;
+
         bool extension_window_is_showing, driver_info_window_is_showing;
     };
 } // namespace benzene::opengl
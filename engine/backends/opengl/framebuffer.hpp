@@ -68,6 +68,11 @@ namespace benzene::opengl
             return handle;
         }
 
+        // The texture or renderbuffer backing the i'th attachment passed to the constructor
+        GLuint get_attachment(size_t i) const {
+            return buffers[i].second;
+        }
+
         private:
         GLuint create_texture_attachment(size_t width, size_t height, const Attachment& attachment){
             GLuint texture = 0;
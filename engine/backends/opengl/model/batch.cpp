@@ -1,36 +1,125 @@
 #include "batch.hpp"
+#include "../../../core/texture_baker.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <map>
+#include <numeric>
+#include <utility>
 
 using namespace benzene::opengl;
 
 #pragma region Texture
 
+std::map<Texture::Key, Texture::Shared> Texture::shared;
 std::optional<float> Texture::max_anisotropy;
-std::optional<size_t> Texture::max_texture_units;
 
-Texture::Texture(size_t width, size_t height, size_t channels, const uint8_t* data, const std::string& shader_name, benzene::Texture::Gamut gamut): shader_name{shader_name} {
-    glCreateTextures(GL_TEXTURE_2D, 1, &handle);
+Texture::Texture(const benzene::Texture& tex, TextureStreamer& streamer, TextureTable& table): handle{0}, slot{0}, shader_name{tex.get_shader_name()}, key{Key{tex.get_hash(), tex.get_gamut()}}, streamer{&streamer}, table{&table} {
+    auto compression = tex.get_compression();
+    // BC1 and BC3 never made it into core, but nearly every desktop driver has them. The rest get them decoded again
+    bool decompress = (compression == benzene::Texture::Compression::Bc1 || compression == benzene::Texture::Compression::Bc3) && !GLAD_GL_EXT_texture_compression_s3tc;
+
+    auto [it, inserted] = shared.try_emplace(*key, Shared{.handle = 0, .slot = 0, .references = 0, .source = tex});
+    Shared* entry = &it->second;
+    if(!inserted && !same_pixels(entry->source, tex)){
+        print("opengl/Texture: Two different {:d}x{:d} textures have the same hash, they're not shared\n", tex.dimensions().first, tex.dimensions().second);
+        key.reset();
+        entry = nullptr;
+    } else if(!inserted){
+        entry->references++;
+        handle = entry->handle;
+        slot = entry->slot;
+
+        // The CPU copy is only needed to upload it again, or by the streamer, which holds on to it itself
+        tex.release_after_upload();
+        return;
+    } else {
+        entry->references++;
+    }
 
-    this->set_parameter(GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    this->set_parameter(GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    this->set_parameter(GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-    this->set_parameter(GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    const auto [width, height] = tex.dimensions();
+    auto pixels = tex.bytes();
+    bool immediate = !pixels.empty() && pixels.size() <= max_immediate_upload;
+    if(decompress){
+        handle = create_decompressed(tex);
+        tex.release_after_upload();
+    } else if(compression != benzene::Texture::Compression::None){
+        // Baked textures bring every level, nothing is generated on the GPU
+        const auto& levels = tex.get_levels();
+        auto internal_format = gl::compressed_format(compression, tex.get_gamut());
+        handle = create(width, height, levels.size(), internal_format);
+        if(immediate){
+            for(size_t i = 0; i < levels.size(); i++)
+                glCompressedTextureSubImage2D(handle, i, 0, 0, levels[i].width, levels[i].height, internal_format, levels[i].size, pixels.data() + levels[i].offset);
+            tex.release_after_upload();
+        } else {
+            streamer.enqueue(handle, tex);
+        }
+    } else if(immediate){
+        handle = create_uncompressed(width, height, tex.get_channels(), pixels.data(), tex.get_gamut());
+        tex.release_after_upload();
+    } else {
+        handle = create_uncompressed(width, height, tex.get_channels(), nullptr, tex.get_gamut());
+        streamer.enqueue(handle, tex);
+    }
 
-    if((GL_ARB_texture_filter_anisotropic || GL_EXT_texture_filter_anisotropic) && !max_anisotropy.has_value()){
-        static_assert(GL_MAX_TEXTURE_MAX_ANISOTROPY == GL_MAX_TEXTURE_MAX_ANISOTROPY_EXT, "Support both ARB and EXT anisotropy extensions");
-        float max = 0.0f;
-        glGetFloatv(GL_MAX_TEXTURE_MAX_ANISOTROPY, &max);
-        this->max_anisotropy = max;
+    // Textures that only just started streaming are sampled within the levels the streamer has for them
+    slot = table.add(handle, table.default_for(shader_name));
+    if(entry){
+        entry->handle = handle;
+        entry->slot = slot;
     }
+}
 
-    if(max_anisotropy.has_value()){
-        static_assert(GL_TEXTURE_MAX_ANISOTROPY == GL_TEXTURE_MAX_ANISOTROPY_EXT, "Support both ARB and EXT anisotropy extensions");
+GLuint Texture::create_decompressed(const benzene::Texture& tex){
+    static bool logged = false;
+    if(!std::exchange(logged, true))
+        print("opengl/Texture: No GL_EXT_texture_compression_s3tc, BC1 and BC3 textures are decoded and uploaded uncompressed\n");
 
-        this->set_parameter(GL_TEXTURE_MAX_ANISOTROPY, *this->max_anisotropy);
+    auto pixels = tex.acquire_pixels();
+    if(!pixels){
+        print("opengl/Texture: Pixels of a {:s} texture are gone, can't decode it\n", benzene::Texture::compression_to_str(tex.get_compression()));
+        throw std::runtime_error("opengl/Texture: Failed to decode texture");
     }
 
+    // Every level is there already, they're decoded rather than generated so they stay the ones that were baked
+    const auto& levels = tex.get_levels();
+    const auto [width, height] = tex.dimensions();
+    auto handle = create(width, height, levels.size(), (tex.get_gamut() == benzene::Texture::Gamut::Srgb) ? GL_SRGB8_ALPHA8 : GL_RGBA8);
+    for(size_t i = 0; i < levels.size(); i++){
+        auto decoded = benzene::texture_baker::decode(pixels.get() + levels[i].offset, levels[i].width, levels[i].height, tex.get_compression());
+        glTextureSubImage2D(handle, i, 0, 0, levels[i].width, levels[i].height, GL_RGBA, GL_UNSIGNED_BYTE, decoded.data());
+    }
+
+    return handle;
+}
+
+bool Texture::same_pixels(const benzene::Texture& a, const benzene::Texture& b){
+    if(a.shares_pixels_with(b))
+        return true;
+
+    if(a.dimensions() != b.dimensions() || a.get_channels() != b.get_channels() || a.get_compression() != b.get_compression() || a.get_levels() != b.get_levels())
+        return false;
+
+    // Only different files with the same contents get here, the pixels of either may have to be decoded again for this
+    auto pixels_a = a.acquire_pixels(), pixels_b = b.acquire_pixels();
+    if(!pixels_a || !pixels_b)
+        return false;
+
+    const auto [width, height] = a.dimensions();
+    auto size = (size_t)width * height * a.get_channels();
+    if(!a.get_levels().empty()){
+        size = 0;
+        for(const auto& level : a.get_levels())
+            size = std::max(size, level.offset + level.size);
+    }
+    return std::memcmp(pixels_a.get(), pixels_b.get(), size) == 0;
+}
+
+GLuint Texture::create_uncompressed(size_t width, size_t height, size_t channels, const uint8_t* data, benzene::Texture::Gamut gamut){
     auto internal_format = (gamut == benzene::Texture::Gamut::Srgb) ? GL_SRGB8 : GL_RGB8;
     auto mip_levels = (size_t)std::floor(std::log2(std::max(width, height))) + 1;
-    glTextureStorage2D(handle, mip_levels, internal_format, width, height);
 
     auto format = GL_RGBA;
     switch (channels){
@@ -41,123 +130,600 @@ Texture::Texture(size_t width, size_t height, size_t channels, const uint8_t* da
             throw std::runtime_error("opengl/Texture: Unknown channel count");
             break;
     }
+
+    auto handle = create(width, height, mip_levels, internal_format);
+    if(!data)
+        return handle;
+
     glTextureSubImage2D(handle, 0, 0, 0, width, height, format, GL_UNSIGNED_BYTE, data);
 
     glGenerateTextureMipmap(handle);
+    return handle;
 }
 
-void Texture::clean(){
-    glDeleteTextures(1, &handle);
-}
+GLuint Texture::create(size_t width, size_t height, size_t levels, GLenum internal_format, size_t layers){
+    GLuint handle;
+    glCreateTextures((layers > 0) ? GL_TEXTURE_2D_ARRAY : GL_TEXTURE_2D, 1, &handle);
+
+    glTextureParameteri(handle, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTextureParameteri(handle, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTextureParameteri(handle, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTextureParameteri(handle, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 
-void Texture::bind(Program& program, size_t i) const {
-    if(!max_texture_units.has_value()){
-        GLint max_units;
-        glGetIntegerv(GL_MAX_COMBINED_TEXTURE_IMAGE_UNITS, &max_units);
-        max_texture_units = max_units;
+    if((GL_ARB_texture_filter_anisotropic || GL_EXT_texture_filter_anisotropic) && !max_anisotropy.has_value()){
+        static_assert(GL_MAX_TEXTURE_MAX_ANISOTROPY == GL_MAX_TEXTURE_MAX_ANISOTROPY_EXT, "Support both ARB and EXT anisotropy extensions");
+        float max = 0.0f;
+        glGetFloatv(GL_MAX_TEXTURE_MAX_ANISOTROPY, &max);
+        max_anisotropy = max;
     }
 
-    assert(i < (*max_texture_units - 1)); // Test if we're going over the limit        
+    if(max_anisotropy.has_value()){
+        static_assert(GL_TEXTURE_MAX_ANISOTROPY == GL_TEXTURE_MAX_ANISOTROPY_EXT, "Support both ARB and EXT anisotropy extensions");
+
+        glTextureParameterf(handle, GL_TEXTURE_MAX_ANISOTROPY, *max_anisotropy);
+    }
 
-    program.set_uniform("material." + shader_name, (int)i); // Tell it to bind the uniform with the name "material.{shader_name}" to texture unit i
-    glBindTextureUnit(i, handle);
+    if(layers > 0)
+        glTextureStorage3D(handle, levels, internal_format, width, height, layers);
+    else
+        glTextureStorage2D(handle, levels, internal_format, width, height);
+    return handle;
 }
 
-void Texture::set_parameter(GLenum key, GLint value){
-    glTextureParameteri(handle, key, value);
+void Texture::clean(){
+    if(key){
+        auto it = shared.find(*key);
+        if(it == shared.end() || --it->second.references > 0)
+            return;
+
+        shared.erase(it);
+    }
+
+    if(streamer)
+        streamer->cancel(handle);
+    if(table)
+        table->remove(slot);
+    glDeleteTextures(1, &handle);
 }
 
-void Texture::set_parameter(GLenum key, GLfloat value){
-    glTextureParameterf(handle, key, value);
+std::pair<size_t, size_t> Texture::get_sharing_stats(){
+    size_t references = 0;
+    for(const auto& [key, texture] : shared)
+        references += texture.references;
+
+    return {shared.size(), references};
 }
 
 #pragma endregion
 
 #pragma region DrawMesh
 
-DrawMesh::DrawMesh(const benzene::Mesh& api_mesh, Program& program): program{&program}, api_mesh{&api_mesh} {
-    mesh = Mesh{api_mesh.indices, api_mesh.vertices, {
-        {.location = program.get_vertex_attrib_location("inPosition"), .type = gl::type_to_enum_v<float>, .offset = offsetof(benzene::Mesh::Vertex, pos), .n = 3},
-        {.location = program.get_vertex_attrib_location("inNormal"), .type = gl::type_to_enum_v<float>, .offset = offsetof(benzene::Mesh::Vertex, normal), .n = 3},
-        {.location = program.get_vertex_attrib_location("inTangent"), .type = gl::type_to_enum_v<float>, .offset = offsetof(benzene::Mesh::Vertex, tangent), .n = 3},
-        {.location = program.get_vertex_attrib_location("inUv"), .type = gl::type_to_enum_v<float>, .offset = offsetof(benzene::Mesh::Vertex, uv), .n = 2}
-    }};
+DrawMesh::DrawMesh(const benzene::Mesh& api_mesh, Program& program, GeometryPool& pool, TextureStreamer& streamer, TextureTable& texture_table, MaterialTable& materials): pool{&pool}, program{&program}, materials{&materials} {
+    auto vertices = api_mesh.get_vertices();
+    auto indices = api_mesh.get_indices();
+    lods.push_back({.first_index = 0, .index_count = indices.size(), .error = 0.0f});
+
+    // Meshes from the loader come split already, anything else large enough is split here, which reorders a copy of its triangles
+    std::vector<GeometryPool::Index> reordered{};
+    clusters = api_mesh.meshlets;
+    if(clusters.size() == 0 && indices.size() > (meshlets::max_triangles * 3)){
+        reordered.assign(indices.begin(), indices.end());
+        clusters = meshlets::build(vertices, reordered);
+        indices = reordered;
+    }
 
-    for(const auto& texture : api_mesh.textures)
-        this->textures.emplace_back(texture);
+    // Every level goes into the mesh's single allocation, straight from wherever the API mesh keeps it
+    std::vector<std::span<const GeometryPool::Index>> index_parts{indices};
+    for(const auto& lod : api_mesh.lods){
+        lods.push_back({.first_index = lods.back().first_index + lods.back().index_count, .index_count = lod.indices.size(), .error = lod.error});
+        index_parts.emplace_back(lod.indices);
+    }
+
+    if(pool.get_vertex_format() == VertexFormat::Packed){
+        std::vector<vertex_packing::PackedVertex> packed(vertices.size());
+        vertex_packing::pack(vertices.data(), vertices.size(), packed.data());
+        geometry = pool.allocate(packed.data(), packed.size(), index_parts);
+    } else {
+        geometry = pool.allocate(vertices.data(), vertices.size(), index_parts);
+    }
+
+    if(api_mesh.bounds){
+        bounding_radius = api_mesh.bounds->radius;
+    } else {
+        float max_distance2 = 0.0f;
+        for(const auto& vertex : vertices)
+            max_distance2 = std::max(max_distance2, glm::dot(vertex.pos, vertex.pos));
+        bounding_radius = std::sqrt(max_distance2);
+    }
+
+    // Meshes that didn't come with a material are plain white without highlights
+    const auto& api_material = api_mesh.material;
+    bool has_material = !api_material.name.empty();
+    MaterialTable::Entry material{
+        .diffuse = {1.0f, 1.0f, 1.0f}, .shininess = api_material.shininess, .specular = {0.0f, 0.0f, 0.0f},
+        .normal_map = texture_table.default_for("normal"), .diffuse_map = texture_table.default_for("diffuse"), .specular_map = texture_table.default_for("specular"), .padding = {}
+    };
+    for(int k = 0; k < 3 && has_material; k++){
+        material.diffuse[k] = api_material.diffuse[k];
+        material.specular[k] = api_material.specular[k];
+    }
+
+    // Maps replace the colours they stand for
+    for(const auto& texture : api_mesh.textures){
+        const auto& added = this->textures.emplace_back(texture, streamer, texture_table);
+        if(added.get_shader_name() == "diffuse"){
+            material.diffuse_map = added.get_slot();
+            std::fill_n(material.diffuse, 3, 1.0f);
+        } else if(added.get_shader_name() == "specular"){
+            material.specular_map = added.get_slot();
+            std::fill_n(material.specular, 3, 1.0f);
+        } else if(added.get_shader_name() == "normal"){
+            material.normal_map = added.get_slot();
+        }
+    }
+    material_index = materials.add(material);
 }
 
 void DrawMesh::clean() {
-    mesh.clean();
+    pool->free(geometry);
 
     for(auto& texture : textures)
         texture.clean();
-}
-
-void DrawMesh::draw() const {
-    this->bind();
-    mesh.draw();
+    materials->remove(material_index);
 }
 
 void DrawMesh::bind() const {
-    for(size_t i = 0; i < textures.size(); i++)
-        textures[i].bind(*program, i);
-
     program->bind();
-    program->set_uniform("material.shininess", api_mesh->material.shininess);
+    pool->bind();
+}
 
-    mesh.bind();
+gl::DrawCommand DrawMesh::draw_command(size_t lod) const {
+    auto cmd = pool->draw_command(geometry);
+    cmd.first_index += lods[lod].first_index;
+    cmd.index_count = lods[lod].index_count;
+
+    return cmd;
 }
 
-gl::DrawCommand DrawMesh::draw_command() const {
-    return mesh.draw_command();
+bool DrawMesh::shares_state_with(const DrawMesh& other) const {
+    if(program != other.program || pool->vertex_array() != other.pool->vertex_array())
+        return false;
+
+    // Without gl_DrawIDARB every draw of a multi-draw reads the material of its first command
+    return GLAD_GL_ARB_shader_draw_parameters || material_index == other.material_index;
 }
 
 #pragma endregion
 
 #pragma region Model
 
-Batch::Batch(benzene::Batch& batch, Program& program): batch{&batch}, program{&program} {
-    per_instance_buffer = Buffer<GL_SHADER_STORAGE_BUFFER>(batch.transforms.size() * sizeof(gl::InstanceData), nullptr, GL_DYNAMIC_STORAGE_BIT | GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT);
+Batch::Batch(benzene::Batch& batch, Program& program, GeometryPool& pool, TextureStreamer& streamer, TextureTable& texture_table, MaterialTable& materials, RingBuffer<GL_SHADER_STORAGE_BUFFER>& instance_ring): batch{&batch}, program{&program}, pool{&pool}, instance_ring{&instance_ring}, instance_count{0}, visible_count{0}, visible_triangles{0}, cluster_stats{}, draw_state{} {
     for(auto& mesh : batch.meshes)
-		meshes.emplace_back(mesh, program);
+		meshes.emplace_back(mesh, program, pool, streamer, texture_table, materials);
+
+    // The coarsest level of a mesh has no next level, so it stays selected at any distance
+    for(uint32_t i = 0; i < meshes.size(); i++){
+        auto n_lods = meshes[i].get_lod_count();
+        for(uint32_t lod = 0; lod < n_lods; lod++){
+            auto next_error = ((lod + 1) < n_lods) ? meshes[i].get_lod_error(lod + 1) : std::numeric_limits<float>::max();
+            lod_draws.push_back({.mesh = i, .lod = lod, .error = meshes[i].get_lod_error(lod), .next_error = next_error});
+        }
+    }
+
+    if(lod_draws.size() > 0){
+        // Room for the commands of both occlusion culling passes, the late pass writes its own so it never races the early draws
+        indirect_buffer = Buffer<GL_DRAW_INDIRECT_BUFFER>{2 * lod_draws.size() * sizeof(gl::DrawCommand), nullptr, GL_DYNAMIC_STORAGE_BIT};
+
+        std::vector<MeshBounds> bounds{};
+        for(const auto& draw : lod_draws)
+            bounds.push_back({.radius = meshes[draw.mesh].get_bounding_radius(), .lod_error = draw.error, .next_lod_error = draw.next_error, .lod = draw.lod});
+        bounds_buffer = Buffer<GL_SHADER_STORAGE_BUFFER>{bounds.size() * sizeof(MeshBounds), bounds.data(), 0};
+    }
 }
 
 void Batch::clean(){
     for(auto& mesh : meshes)
         mesh.clean();
 
-    per_instance_buffer.clean();
+    indirect_buffer.clean();
+    instance_buffer.clean();
+    bounds_buffer.clean();
+    gpu_visible_buffer.clean();
+    visibility_buffer.clean();
 }
 
-void Batch::draw() const {
-    auto* instance_data = (gl::InstanceData*)per_instance_buffer.map();
+static_assert(sizeof(gl::InstanceData) == (benzene::transform_kernel::floats_per_instance * sizeof(float)), "The transform kernels write gl::InstanceData directly");
+
+void Batch::update_instance_data() const {
+    auto n_instances = batch->transforms.size();
+    auto dirty = batch->consume_dirty_ranges();
 
-    #pragma omp parallel for
-    for(size_t i = 0; i < batch->transforms.size(); i++){
-        auto& transform = batch->transforms[i];
-        auto translate = glm::translate(glm::mat4{1.0f}, transform.pos);
-	    auto scale = glm::scale(glm::mat4{1.0f}, transform.scale);
-        auto rotate = glm::rotate(glm::mat4{1.0f}, glm::radians(transform.rotation.y), glm::vec3{0.0f, 1.0f, 0.0f});
-	    rotate = glm::rotate(rotate, glm::radians(transform.rotation.z), glm::vec3{0.0f, 0.0f, 1.0f});
-	    rotate = glm::rotate(rotate, glm::radians(transform.rotation.x), glm::vec3{1.0f, 0.0f, 0.0f});
-            
-        auto model_matrix = translate * rotate * scale;
-        auto normal_matrix = glm::transpose(glm::inverse(model_matrix));
+    if(n_instances != instance_count){
+        // Resized, so every instance and the instance counts in the draw commands are stale
+        if(n_instances * sizeof(gl::InstanceData) > instance_buffer.get_size()){
+            instance_buffer.clean();
+            instance_buffer = Buffer<GL_SHADER_STORAGE_BUFFER>{n_instances * sizeof(gl::InstanceData), nullptr, GL_DYNAMIC_STORAGE_BIT};
+        }
 
-        instance_data[i].model_matrix = model_matrix;
-        instance_data[i].normal_matrix = normal_matrix;
+        instance_count = n_instances;
+        transform_store.resize(n_instances);
+        dirty = {{0, n_instances}};
     }
 
-    per_instance_buffer.bind_base(0);
+    if(n_instances == 0)
+        return;
+
+    // Ranges separated by only a few clean instances are cheaper to redo than to copy separately
+    constexpr size_t max_dirty_gap = 16;
+    std::vector<std::pair<size_t, size_t>> ranges{};
+    size_t n_dirty = 0;
+    for(auto [begin, end] : dirty){
+        if(ranges.size() > 0 && (begin - ranges.back().second) <= max_dirty_gap)
+            ranges.back().second = end;
+        else
+            ranges.emplace_back(begin, end);
+    }
+
+    for(auto [begin, end] : ranges)
+        n_dirty += (end - begin);
+
+    if(n_dirty > 0){
+        // Dirty instances are staged in this frame's region of the ring and then copied into the persistent buffer on the GPU
+        auto allocation = instance_ring->allocate(n_dirty * sizeof(gl::InstanceData));
+        auto* staging = (gl::InstanceData*)allocation.ptr;
+
+        size_t staged = 0;
+        for(auto [begin, end] : ranges){
+            transform_store.gather(batch->transforms, begin, end);
 
-    for(const auto& mesh : meshes){
-        auto cmd = mesh.draw_command();
-        cmd.instance_count = batch->transforms.size();
-        
-        mesh.bind();
-        gl::draw<uint32_t>(cmd);
+            constexpr size_t chunk_size = 1024;
+            auto* range_staging = staging + staged - begin;
+            jobs::parallel_for(begin, end, chunk_size, [this, range_staging](size_t first, size_t last){
+                transform_kernel::build_matrices(transform_store.view(first), last - first, (float*)(range_staging + first));
+            });
+
+            instance_ring->get_buffer().copy_to(instance_buffer, allocation.offset + staged * sizeof(gl::InstanceData), begin * sizeof(gl::InstanceData), (end - begin) * sizeof(gl::InstanceData));
+            staged += (end - begin);
+        }
     }
+
+    instance_buffer.bind_base(0);
+}
+
+// Keeps the instances in `indices` that draw the level between `error` and `next_error`, returns how many are left
+static size_t select_lod(const benzene::transform_kernel::TransformsSoA& transforms, uint32_t* indices, size_t n, const LodSelection& lod, float error, float next_error){
+    size_t kept = 0;
+    for(size_t i = 0; i < n; i++){
+        auto index = indices[i];
+        auto pos = glm::vec3{transforms.pos[0][index], transforms.pos[1][index], transforms.pos[2][index]};
+        auto scale = std::max({std::abs(transforms.scale[0][index]), std::abs(transforms.scale[1][index]), std::abs(transforms.scale[2][index])});
+
+        if(lod.selects(error, next_error, scale, glm::length(pos - lod.camera_pos)))
+            indices[kept++] = index;
+    }
+
+    return kept;
+}
+
+void Batch::cull(const transform_kernel::FrustumPlanes* frustum, const LodSelection* lod, const ClusterCulling* clusters) const {
+    // Visible instances of every level are written back to back, each level's draw starts at its run through `base_instance`
+    visible_indices.clear();
+    visible_triangles = 0;
+    cluster_stats = {};
+    draw_commands.clear();
+    command_ranges.resize(lod_draws.size());
+
+    constexpr size_t chunk_size = 4096;
+    std::vector<size_t> chunk_counts{};
+    for(size_t i = 0; i < lod_draws.size(); i++){
+        const auto& draw = lod_draws[i];
+        const auto& mesh = meshes[draw.mesh];
+
+        auto first = visible_indices.size();
+        auto cmd = mesh.draw_command(draw.lod);
+        cmd.instance_count = 0;
+        cmd.base_instance = first;
+        command_ranges[i] = {draw_commands.size(), 1};
+        draw_commands.push_back(cmd);
+
+        if(!lod && draw.lod != 0)
+            continue;
+
+        visible_indices.resize(first + instance_count);
+        auto* out = visible_indices.data() + first;
+
+        // Every chunk writes to where it would start if all of its instances were visible, then they are packed together
+        auto n_chunks = (instance_count + chunk_size - 1) / chunk_size;
+        chunk_counts.assign(n_chunks, 0);
+        auto radius = mesh.get_bounding_radius();
+        auto select = lod && mesh.get_lod_count() > 1;
+        jobs::parallel_for(0, instance_count, chunk_size, [&](size_t begin, size_t end){
+            size_t n = end - begin;
+            if(frustum)
+                n = transform_kernel::cull_spheres(transform_store.view(begin), end - begin, *frustum, radius, begin, out + begin);
+            else
+                std::iota(out + begin, out + end, (uint32_t)begin);
+
+            if(select)
+                n = select_lod(transform_store.view(), out + begin, n, *lod, draw.error, draw.next_error);
+            chunk_counts[begin / chunk_size] = n;
+        });
+
+        size_t visible = 0;
+        for(size_t chunk = 0; chunk < n_chunks; chunk++){
+            std::copy_n(out + chunk * chunk_size, chunk_counts[chunk], out + visible);
+            visible += chunk_counts[chunk];
+        }
+
+        if(clusters && draw.lod == 0 && mesh.get_meshlets().size() > 0){
+            visible = this->cull_meshlets(mesh, frustum, *clusters, out, visible, command_ranges[i].first);
+            command_ranges[i].second = draw_commands.size() - command_ranges[i].first;
+        } else {
+            draw_commands[command_ranges[i].first].instance_count = visible;
+            visible_triangles += visible * (cmd.index_count / 3);
+        }
+        visible_indices.resize(first + visible);
+    }
+    visible_count = visible_indices.size();
+
+    auto allocation = instance_ring->allocate(std::max<size_t>(visible_indices.size(), 1) * sizeof(uint32_t));
+    std::copy(visible_indices.begin(), visible_indices.end(), (uint32_t*)allocation.ptr);
+    draw_state = {.command_materials = this->upload_command_materials(), .instance_stream = allocation.buffer, .instance_stream_offset = allocation.offset, .first_indirect_command = 0};
+}
+
+RingBuffer<GL_SHADER_STORAGE_BUFFER>::Allocation Batch::upload_command_materials() const {
+    auto allocation = instance_ring->allocate(std::max<size_t>(draw_commands.size(), 1) * sizeof(uint32_t));
+    auto* out = (uint32_t*)allocation.ptr;
+    for(size_t i = 0; i < lod_draws.size(); i++){
+        auto [first, count] = command_ranges[i];
+        std::fill_n(out + first, count, meshes[lod_draws[i].mesh].get_material());
+    }
+
+    return allocation;
+}
+
+size_t Batch::cull_meshlets(const DrawMesh& mesh, const transform_kernel::FrustumPlanes* frustum, const ClusterCulling& clusters, uint32_t* indices, size_t n, size_t command) const {
+    const auto& mesh_meshlets = mesh.get_meshlets();
+    auto base = draw_commands[command];
+
+    // Instances that keep every meshlet stay in the instanced command, the others get one command per run of neighbouring visible meshlets
+    struct Chunk {
+        std::vector<uint32_t> whole, partial;
+        // How many runs each partial instance has, and the runs themselves as (first index, index count) relative to the mesh
+        std::vector<size_t> run_counts;
+        std::vector<std::pair<uint32_t, uint32_t>> runs;
+        size_t triangles;
+        ClusterStats stats;
+    };
+
+    constexpr size_t chunk_size = 64;
+    std::vector<Chunk> chunks((n + chunk_size - 1) / chunk_size);
+    jobs::parallel_for(0, n, chunk_size, [&](size_t begin, size_t end){
+        auto& chunk = chunks[begin / chunk_size];
+        chunk.triangles = 0;
+        chunk.stats = {};
+
+        for(size_t i = begin; i < end; i++){
+            auto transform = transform_store.view(indices[i]);
+            gl::InstanceData instance;
+            transform_kernel::build_matrices(transform, 1, (float*)&instance);
+
+            auto min_scale = std::min({transform.scale[0][0], transform.scale[1][0], transform.scale[2][0]});
+            auto max_scale = std::max({std::abs(transform.scale[0][0]), std::abs(transform.scale[1][0]), std::abs(transform.scale[2][0])});
+            // Normal cones only survive uniform scaling, mirroring also flips the winding
+            auto cone = clusters.backface && min_scale > 0.0f && (max_scale - min_scale) <= (max_scale * 1e-4f);
+            auto camera = glm::vec3{glm::inverse(instance.model_matrix) * glm::vec4{clusters.camera_pos, 1.0f}};
+
+            // The planes are moved to object space instead of every meshlet to world space, distances stay in world units
+            glm::vec4 planes[6];
+            if(frustum)
+                for(int p = 0; p < 6; p++)
+                    planes[p] = glm::vec4{frustum->planes[p][0], frustum->planes[p][1], frustum->planes[p][2], frustum->planes[p][3]} * instance.model_matrix;
+
+            auto first_run = chunk.runs.size();
+            size_t drawn = 0;
+            bool in_run = false;
+            for(const auto& meshlet : mesh_meshlets){
+                bool visible = true;
+                if(frustum){
+                    for(int p = 0; p < 6 && visible; p++)
+                        visible = (glm::dot(glm::vec3{planes[p]}, meshlet.center) + planes[p].w) >= (-meshlet.radius * max_scale);
+
+                    if(!visible)
+                        chunk.stats.frustum_culled += meshlet.index_count / 3;
+                }
+
+                if(visible && cone && meshlets::is_backfacing(meshlet, camera)){
+                    visible = false;
+                    chunk.stats.backface_culled += meshlet.index_count / 3;
+                }
+
+                if(!visible){
+                    in_run = false;
+                    continue;
+                }
+
+                if(in_run)
+                    chunk.runs.back().second += meshlet.index_count;
+                else
+                    chunk.runs.emplace_back(meshlet.first_index, meshlet.index_count);
+                in_run = true;
+                drawn += meshlet.index_count;
+            }
+
+            chunk.stats.triangles += base.index_count / 3;
+            chunk.triangles += drawn / 3;
+            if(drawn == base.index_count){
+                chunk.runs.resize(first_run);
+                chunk.whole.push_back(indices[i]);
+            } else if(drawn > 0){
+                chunk.partial.push_back(indices[i]);
+                chunk.run_counts.push_back(chunk.runs.size() - first_run);
+            }
+        }
+    });
+
+    size_t kept = 0;
+    for(const auto& chunk : chunks){
+        std::copy(chunk.whole.begin(), chunk.whole.end(), indices + kept);
+        kept += chunk.whole.size();
+    }
+    draw_commands[command].instance_count = kept;
+
+    // Partial instances that kept exactly the same meshlets share an instanced command per run, like ones seen from the same side
+    std::map<std::vector<std::pair<uint32_t, uint32_t>>, std::vector<uint32_t>> groups;
+    for(const auto& chunk : chunks){
+        auto run = chunk.runs.begin();
+        for(size_t i = 0; i < chunk.partial.size(); i++){
+            std::vector<std::pair<uint32_t, uint32_t>> runs(run, run + chunk.run_counts[i]);
+            run += chunk.run_counts[i];
+            groups[std::move(runs)].push_back(chunk.partial[i]);
+        }
+
+        visible_triangles += chunk.triangles;
+        cluster_stats += chunk.stats;
+    }
+
+    for(const auto& [runs, instances] : groups){
+        std::copy(instances.begin(), instances.end(), indices + kept);
+        for(auto [first, count] : runs){
+            auto cmd = base;
+            cmd.first_index += first;
+            cmd.index_count = count;
+            cmd.instance_count = instances.size();
+            cmd.base_instance = base.base_instance + kept;
+            draw_commands.push_back(cmd);
+        }
+        kept += instances.size();
+    }
+
+    return kept;
+}
+
+void Batch::draw(RenderQueue& queue, const transform_kernel::FrustumPlanes* frustum, const LodSelection* lod, const ClusterCulling* clusters) const {
+    this->update_instance_data();
+    this->cull(frustum, lod, clusters);
+    this->queue_draws(queue, false, false);
+}
+
+void Batch::draw_indirect(RenderQueue& queue, const transform_kernel::FrustumPlanes* frustum, const LodSelection* lod, const ClusterCulling* clusters) const {
+    this->update_instance_data();
+    this->cull(frustum, lod, clusters);
+
+    if(lod_draws.size() == 0)
+        return;
+
+    // Meshlet culling adds commands for every partially visible instance, so leave room for the count to keep growing
+    auto size = draw_commands.size() * sizeof(gl::DrawCommand);
+    if(size > indirect_buffer.get_size()){
+        indirect_buffer.clean();
+        indirect_buffer = Buffer<GL_DRAW_INDIRECT_BUFFER>{2 * size, nullptr, GL_DYNAMIC_STORAGE_BIT};
+    }
+
+    indirect_buffer.write(draw_commands.data(), 0, size);
+    this->queue_draws(queue, true, false);
+}
+
+void Batch::draw_gpu_culled(RenderQueue& queue, Program& cull_program, GpuCullPhase phase) const {
+    if(phase == GpuCullPhase::Late)
+        instance_buffer.bind_base(0);
+    else
+        this->update_instance_data();
+
+    // What was actually drawn stays on the GPU, the renderer reads it back from there if it wants it
+    visible_count = 0;
+    visible_triangles = 0;
+    cluster_stats = {};
+
+    if(lod_draws.size() == 0 || instance_count == 0)
+        return;
+
+    // Worst case every instance draws every level, so each level gets a run of instance_count slots per pass
+    auto n_slots = instance_count * lod_draws.size();
+    if(2 * n_slots * sizeof(uint32_t) > gpu_visible_buffer.get_size()){
+        gpu_visible_buffer.clean();
+        gpu_visible_buffer = Buffer<GL_SHADER_STORAGE_BUFFER>{2 * n_slots * sizeof(uint32_t), nullptr, 0};
+    }
+
+    if(phase != GpuCullPhase::Single && n_slots * sizeof(uint32_t) > visibility_buffer.get_size()){
+        // Nothing was visible before the batch existed, so the first late pass draws everything that isn't occluded
+        std::vector<uint32_t> none(n_slots, 0);
+        visibility_buffer.clean();
+        visibility_buffer = Buffer<GL_SHADER_STORAGE_BUFFER>{n_slots * sizeof(uint32_t), none.data(), 0};
+    }
+
+    // The CPU only resets one command per level, the culling pass counts the instances up again
+    size_t first_command = (phase == GpuCullPhase::Late) ? lod_draws.size() : 0;
+    draw_commands.resize(lod_draws.size());
+    command_ranges.resize(lod_draws.size());
+    for(size_t i = 0; i < lod_draws.size(); i++){
+        auto cmd = meshes[lod_draws[i].mesh].draw_command(lod_draws[i].lod);
+        cmd.instance_count = 0;
+        cmd.base_instance = (first_command + i) * instance_count;
+        draw_commands[i] = cmd;
+        command_ranges[i] = {i, 1};
+    }
+    indirect_buffer.write(draw_commands.data(), first_command * sizeof(gl::DrawCommand), draw_commands.size() * sizeof(gl::DrawCommand));
+
+    constexpr size_t cull_group_size = 64; // Has to match local_size_x of the culling shader
+    bounds_buffer.bind_base(1);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, indirect_buffer());
+    gpu_visible_buffer.bind_base(3);
+    if(phase != GpuCullPhase::Single)
+        visibility_buffer.bind_base(4);
+
+    cull_program.set_uniform("instanceCount"_uniform, (int)instance_count);
+    cull_program.set_uniform("cullPhase"_uniform, (int)phase);
+    cull_program.set_uniform("firstCommand"_uniform, (int)first_command);
+    cull_program.bind();
+    glDispatchCompute((instance_count + cull_group_size - 1) / cull_group_size, lod_draws.size(), 1);
+    glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT);
+
+    draw_state = {.command_materials = this->upload_command_materials(), .instance_stream = gpu_visible_buffer(), .instance_stream_offset = 0, .first_indirect_command = first_command};
+    this->queue_draws(queue, true, true);
+}
+
+void Batch::queue_draws(RenderQueue& queue, bool indirect, bool gpu_visibility) const {
+    const auto& camera = queue.get_camera_position();
+    auto transforms = transform_store.view();
+    auto distance_to = [&](uint32_t instance){
+        return glm::length(glm::vec3{transforms.pos[0][instance], transforms.pos[1][instance], transforms.pos[2][instance]} - camera);
+    };
+
+    // Commands were written in mesh order, so every run of meshes is a contiguous range of them
+    for(size_t i = 0; i < lod_draws.size();){
+        const auto& mesh = meshes[lod_draws[i].mesh];
+
+        size_t n = 1;
+        while(indirect && (i + n) < lod_draws.size() && mesh.shares_state_with(meshes[lod_draws[i + n].mesh]))
+            n++;
+
+        auto first = command_ranges[i].first;
+        auto last = command_ranges[i + n - 1].first + command_ranges[i + n - 1].second;
+        i += n;
+
+        std::optional<float> depth;
+        if(gpu_visibility){
+            depth = (instance_count > 0) ? distance_to(0) : 0.0f;
+        } else {
+            for(auto j = first; j < last && !depth; j++)
+                if(draw_commands[j].instance_count > 0)
+                    depth = distance_to(visible_indices[draw_commands[j].base_instance]);
+        }
+
+        // Every instance was culled, indirect draws go in anyway since their commands are already in the buffer
+        if(!depth && !indirect)
+            continue;
+
+        queue.push({.batch = this, .material = mesh.get_material(), .depth = depth.value_or(0.0f), .first_command = (uint32_t)first, .command_count = (uint32_t)(last - first), .indirect = indirect});
+    }
+}
+
+void Batch::bind_state() const {
+    instance_buffer.bind_base(0);
+    RingBuffer<GL_SHADER_STORAGE_BUFFER>::bind_range(command_material_binding, draw_state.command_materials);
+    pool->bind_instance_buffer(draw_state.instance_stream, draw_state.instance_stream_offset, sizeof(uint32_t));
+    indirect_buffer.bind();
 }
 
 const benzene::Batch& Batch::api_handle() const {
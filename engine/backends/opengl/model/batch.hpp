@@ -2,71 +2,296 @@
 
 #include "../base.hpp"
 
+#include <map>
 #include <vector>
 #include <optional>
 #include <cmath>
+#include <utility>
 
 #include "../pipeline.hpp"
 #include "../buffer.hpp"
-#include "mesh.hpp"
+#include "../ring_buffer.hpp"
+#include "geometry_pool.hpp"
+#include "texture_streamer.hpp"
+#include "texture_table.hpp"
+#include "material_table.hpp"
+#include "render_queue.hpp"
+
+#include "../../../core/transform_kernel.hpp"
+#include "../../../core/vertex_packing.hpp"
+#include "../../../core/meshlets.hpp"
 
 namespace benzene::opengl
 {
     class Texture {
         public:
-        Texture(): handle{0}, shader_name{} {}
-        Texture(const benzene::Texture& tex): Texture{(size_t)tex.dimensions().first, (size_t)tex.dimensions().second, (size_t)tex.get_channels(), tex.bytes().data(), tex.get_shader_name(), tex.get_gamut()} {}
-        Texture(size_t width, size_t height, size_t channels, const uint8_t* data, const std::string& shader_name, benzene::Texture::Gamut gamut);
+        Texture(): handle{0}, slot{0}, shader_name{}, key{}, streamer{nullptr}, table{nullptr} {}
+        // Textures with the same pixels and gamut share one GL texture and one slot in `table`, they're freed when the last Texture using them is cleaned
+        // New GL textures are streamed in by `streamer` unless they're tiny, compressed ones with the levels they were baked with
+        Texture(const benzene::Texture& tex, TextureStreamer& streamer, TextureTable& table);
         void clean();
 
-        GLuint operator()(){
+        // Shared GL textures alive right now, and how many Textures use them
+        static std::pair<size_t, size_t> get_sharing_stats();
+
+        // Sampling parameters and immutable storage for `levels` mip levels, without any contents. With `layers` it's a GL_TEXTURE_2D_ARRAY of that many layers
+        static GLuint create(size_t width, size_t height, size_t levels, GLenum internal_format, size_t layers = 0);
+
+        GLuint operator()() const {
             return handle;
         }
 
-        void bind(Program& program, size_t i) const;
-        void set_parameter(GLenum key, GLint value);
-        void set_parameter(GLenum key, GLfloat value);
+        // Where the shaders find it in the TextureTable
+        uint32_t get_slot() const {
+            return slot;
+        }
+
+        const std::string& get_shader_name() const {
+            return shader_name;
+        }
 
         private:
+        using Key = std::pair<uint64_t, benzene::Texture::Gamut>;
+        struct Shared {
+            GLuint handle;
+            uint32_t slot;
+            size_t references;
+            // The texture it was made from, what later ones with the same key are compared to
+            benzene::Texture source;
+        };
+
+        // Whether `a` and `b` hold the same pixels, for textures whose keys match
+        static bool same_pixels(const benzene::Texture& a, const benzene::Texture& b);
+
+        // Immutable storage for a full mip chain of uncompressed pixels, uploaded and mipmapped right away if there's `data`
+        static GLuint create_uncompressed(size_t width, size_t height, size_t channels, const uint8_t* data, benzene::Texture::Gamut gamut);
+        // The baked BC1 or BC3 levels of `tex` decoded on the CPU and uploaded right away as plain RGBA, for drivers without S3TC
+        static GLuint create_decompressed(const benzene::Texture& tex);
+
         GLuint handle;
+        uint32_t slot;
         std::string shader_name;
+        std::optional<Key> key;
+        TextureStreamer* streamer;
+        TextureTable* table;
+
+        // Uploading these right away costs less than a frame's worth of streaming
+        static constexpr size_t max_immediate_upload = 64 * 1024;
 
+        // Only touched from the thread owning the GL context
+        static std::map<Key, Shared> shared;
         static std::optional<float> max_anisotropy;
-        static std::optional<size_t> max_texture_units;
     };
 
     class DrawMesh {
         public:
-        DrawMesh(): mesh{}, textures{} {}
-        DrawMesh(const benzene::Mesh& api_mesh, Program& program);
+        DrawMesh(): geometry{}, textures{} {}
+        DrawMesh(const benzene::Mesh& api_mesh, Program& program, GeometryPool& pool, TextureStreamer& streamer, TextureTable& texture_table, MaterialTable& materials);
         void clean();
 
-        void draw() const;
+        // Textures and material are in the tables bound once per frame, only the program and the geometry are left
         void bind() const;
-        gl::DrawCommand draw_command() const;
+        // Level 0 is the full detail mesh, the others are its benzene::Mesh::Lod's in order
+        gl::DrawCommand draw_command(size_t lod = 0) const;
 
+        size_t get_lod_count() const {
+            return lods.size();
+        }
+
+        // Object space error of a level, 0 for the full detail mesh
+        float get_lod_error(size_t lod) const {
+            return lods[lod].error;
+        }
+
+        // Returns true if drawing `other` after `this` needs no state changes in between
+        // Whatever it returns, every command keeps a single material, the fragment shader relies on that to pick textures
+        bool shares_state_with(const DrawMesh& other) const;
+
+        // Index into the MaterialTable
+        uint32_t get_material() const {
+            return material_index;
+        }
+
+        // Radius of a sphere around the object space origin containing every vertex
+        float get_bounding_radius() const {
+            return bounding_radius;
+        }
+
+        // Meshlets of the full detail level, relative to its first index, empty if the mesh fits in one
+        const std::vector<meshlets::Meshlet>& get_meshlets() const {
+            return clusters;
+        }
 
         private:
-        Mesh<uint32_t, benzene::Mesh::Vertex> mesh;
+        // Every level's indices follow each other in the mesh's single pool allocation, they all share its vertices
+        struct Lod {
+            size_t first_index, index_count;
+            float error;
+        };
+
+        GeometryPool::Handle geometry;
+        std::vector<Lod> lods;
+        float bounding_radius;
+        std::vector<meshlets::Meshlet> clusters;
         std::vector<opengl::Texture> textures;
 
+        GeometryPool* pool;
         Program* program;
-        const benzene::Mesh* api_mesh;
+        MaterialTable* materials;
+        uint32_t material_index;
+    };
+
+    // Which pass of the GPU culling shader a batch is drawn in, Early and Late are the two halves of occlusion culling
+    enum class GpuCullPhase : int {
+        Single,
+        Early, // Only instances that were visible last frame
+        Late // Everything that wasn't drawn in the early pass and survives the depth pyramid
+    };
+
+    // Every instance draws the coarsest level of detail whose error projects to at most the pixel threshold
+    struct LodSelection {
+        glm::vec3 camera_pos;
+        // Pixels covered by one object space unit at distance 1, divided by the pixel threshold
+        float pixels_per_unit;
+
+        // Whether an instance at `distance` with uniform scale `scale` draws the level between `error` and the next level's `next_error`
+        bool selects(float error, float next_error, float scale, float distance) const {
+            auto k = scale * pixels_per_unit;
+            return (error * k <= distance) && (next_error * k > distance);
+        }
+    };
+
+    // Full detail instances of meshes with meshlets only draw the meshlets that intersect the frustum and, with `backface`, may face the camera
+    struct ClusterCulling {
+        glm::vec3 camera_pos;
+        bool backface;
+    };
+
+    // Triangles of the instances that went through meshlet culling, and how many of those each test removed
+    struct ClusterStats {
+        size_t triangles, frustum_culled, backface_culled;
+
+        ClusterStats& operator+=(const ClusterStats& other){
+            triangles += other.triangles;
+            frustum_culled += other.frustum_culled;
+            backface_culled += other.backface_culled;
+            return *this;
+        }
     };
 
     class Batch {
         public:
         Batch() {}
-        Batch(benzene::Batch& batch, Program& program);
+        Batch(benzene::Batch& batch, Program& program, GeometryPool& pool, TextureStreamer& streamer, TextureTable& texture_table, MaterialTable& materials, RingBuffer<GL_SHADER_STORAGE_BUFFER>& instance_ring);
         void clean();
 
-        void draw() const;
+        // Draws go into `queue`, which issues them when it's flushed. Only instances whose bounds intersect `frustum` are drawn, nullptr draws everything
+        // Without `lod` every instance draws the full detail level, without `clusters` every instance draws all of its meshlets
+        void draw(RenderQueue& queue, const transform_kernel::FrustumPlanes* frustum, const LodSelection* lod, const ClusterCulling* clusters) const;
+        void draw_indirect(RenderQueue& queue, const transform_kernel::FrustumPlanes* frustum, const LodSelection* lod, const ClusterCulling* clusters) const;
+        // Visibility is decided on the GPU by `cull_program`, which appends visible instances and fills in the instance counts of the indirect commands
+        // The late pass has to follow the early pass of the same frame, it reuses the instance data uploaded by it, and `queue` has to be flushed in between
+        void draw_gpu_culled(RenderQueue& queue, Program& cull_program, GpuCullPhase phase) const;
         const benzene::Batch& api_handle() const;
 
+        // What the RenderQueue needs to issue the draws it was given
+        // Binds the instance data, instance indices, command materials and indirect commands of the last draw
+        void bind_state() const;
+
+        const gl::DrawCommand& get_draw_command(size_t i) const {
+            return draw_commands[i];
+        }
+
+        // Where draw_commands start in the indirect buffer
+        size_t get_first_indirect_command() const {
+            return draw_state.first_indirect_command;
+        }
+
+        Program& get_program() const {
+            return *program;
+        }
+
+        const GeometryPool& get_pool() const {
+            return *pool;
+        }
+
+        // Summed over all meshes, for the last draw. Always 0 after draw_gpu_culled(), the CPU never learns what survived there
+        size_t get_visible_count() const {
+            return visible_count;
+        }
+
+        size_t get_total_count() const {
+            return instance_count * meshes.size();
+        }
+
+        size_t get_visible_triangle_count() const {
+            return visible_triangles;
+        }
+
+        const ClusterStats& get_cluster_stats() const {
+            return cluster_stats;
+        }
+
+        // Points the batch at a different copy of the same API batch, the meshes have to be identical
+        void set_source(benzene::Batch& batch){
+            this->batch = &batch;
+        }
+
         private:
+        void update_instance_data() const;
+        void cull(const transform_kernel::FrustumPlanes* frustum, const LodSelection* lod, const ClusterCulling* clusters) const;
+        // Culls the meshlets of the `n` instances in `indices`, which are drawn by `draw_commands[command]`, and returns how many instances are left
+        size_t cull_meshlets(const DrawMesh& mesh, const transform_kernel::FrustumPlanes* frustum, const ClusterCulling& clusters, uint32_t* indices, size_t n, size_t command) const;
+        // Puts the material of every command in draw_commands into the instance ring, the vertex shader looks it up for the draw it's in
+        RingBuffer<GL_SHADER_STORAGE_BUFFER>::Allocation upload_command_materials() const;
+        // Adds every LodDraw to `queue`, with `indirect` runs of meshes that can share state, including all levels of one mesh, go in as one multi-draw
+        // Without `gpu_visibility` the depth of a draw is the distance to its first visible instance, otherwise to the batch's first instance
+        void queue_draws(RenderQueue& queue, bool indirect, bool gpu_visibility) const;
+
+        // Every level of every mesh is drawn by its own command, in mesh order so the levels of a mesh can share one multi-draw
+        struct LodDraw {
+            uint32_t mesh, lod;
+            float error, next_error;
+        };
+
+        // Matches `MeshBounds` in the culling shader, std430, one per LodDraw
+        struct MeshBounds {
+            float radius;
+            float lod_error, next_lod_error;
+            uint32_t lod;
+        };
+
+        // Binding of the command materials, `firstDraw` in the shader is the index of a draw's first command in them
+        static constexpr GLuint command_material_binding = 6;
+
+        // Recorded when the commands are made, since they're only drawn once the RenderQueue is flushed
+        struct DrawState {
+            RingBuffer<GL_SHADER_STORAGE_BUFFER>::Allocation command_materials;
+            GLuint instance_stream;
+            size_t instance_stream_offset;
+            size_t first_indirect_command;
+        };
+
         benzene::Batch* batch;
         Program* program;
-        mutable Buffer<GL_SHADER_STORAGE_BUFFER> per_instance_buffer;
+        GeometryPool* pool;
+        RingBuffer<GL_SHADER_STORAGE_BUFFER>* instance_ring;
+        mutable Buffer<GL_SHADER_STORAGE_BUFFER> instance_buffer;
+        mutable size_t instance_count;
+        mutable transform_kernel::TransformStore transform_store;
+        mutable Buffer<GL_DRAW_INDIRECT_BUFFER> indirect_buffer;
+        mutable std::vector<gl::DrawCommand> draw_commands;
+        // First command and command count of every LodDraw, a LodDraw only has more than one command after meshlet culling
+        mutable std::vector<std::pair<size_t, size_t>> command_ranges;
+        mutable std::vector<uint32_t> visible_indices;
+        mutable size_t visible_count, visible_triangles;
+        mutable ClusterStats cluster_stats;
+        mutable DrawState draw_state;
+        Buffer<GL_SHADER_STORAGE_BUFFER> bounds_buffer;
+        mutable Buffer<GL_SHADER_STORAGE_BUFFER> gpu_visible_buffer;
+        // One flag per mesh instance, whether it survived occlusion culling last frame
+        mutable Buffer<GL_SHADER_STORAGE_BUFFER> visibility_buffer;
         std::vector<opengl::DrawMesh> meshes;
+        std::vector<LodDraw> lod_draws;
     };
 } // namespace benzene::opengl
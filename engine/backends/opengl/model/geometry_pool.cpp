@@ -0,0 +1,222 @@
+#include "geometry_pool.hpp"
+#include "../../../core/vertex_packing_simd.hpp"
+
+#include <algorithm>
+
+using namespace benzene::opengl;
+
+// Allow buffers to be mapped as readonly in debug mode, for apitrace
+static constexpr GLbitfield buffer_flags = GL_DYNAMIC_STORAGE_BIT | (debug ? GL_MAP_READ_BIT : 0);
+
+size_t benzene::opengl::vertex_format_stride(VertexFormat format){
+    switch (format){
+        case VertexFormat::Full: return sizeof(benzene::Mesh::Vertex);
+        case VertexFormat::Packed: return sizeof(vertex_packing::PackedVertex);
+    }
+
+    return 0;
+}
+
+const char* benzene::opengl::vertex_format_to_str(VertexFormat format){
+    switch (format){
+        case VertexFormat::Full: return "full";
+        case VertexFormat::Packed: return "packed";
+    }
+
+    return "unknown";
+}
+
+GeometryPool::GeometryPool(VertexFormat vertex_format, const std::vector<VertexAttribute>& attributes, size_t initial_vertices, size_t initial_indices): vertex_format{vertex_format}, vertex_stride{vertex_format_stride(vertex_format)}, next_handle{0}, generation{0} {
+    vbo = Buffer<GL_ARRAY_BUFFER>{vertex_stride * initial_vertices, nullptr, buffer_flags};
+    ebo = Buffer<GL_ELEMENT_ARRAY_BUFFER>{sizeof(Index) * initial_indices, nullptr, buffer_flags};
+    vertex_allocator = RangeAllocator{initial_vertices};
+    index_allocator = RangeAllocator{initial_indices};
+
+    glCreateVertexArrays(1, &vao);
+    for(const auto& attr : attributes){
+        glEnableVertexArrayAttrib(vao, attr.location); // Enable the location, so it provides the dynamic data and not the static one
+        if(attr.integer)
+            glVertexArrayAttribIFormat(vao, attr.location, attr.n, attr.type, attr.offset);
+        else
+            glVertexArrayAttribFormat(vao, attr.location, attr.n, attr.type, attr.normalized, attr.offset); // Tell it how to find the data
+        glVertexArrayAttribBinding(vao, attr.location, attr.binding); // Number must be the same as the one in the glVertexArrayVertexBuffer call
+    }
+    glVertexArrayBindingDivisor(vao, instance_binding, 1);
+
+    this->attach_buffers();
+}
+
+void GeometryPool::clean(){
+    glDeleteVertexArrays(1, &vao);
+
+    vbo.clean();
+    ebo.clean();
+    allocations.clear();
+}
+
+GeometryPool::Handle GeometryPool::allocate(const void* vertices, size_t vertex_count, const Index* indices, size_t index_count){
+    std::span<const Index> parts[] = {{indices, index_count}};
+    return this->allocate(vertices, vertex_count, parts);
+}
+
+GeometryPool::Handle GeometryPool::allocate(const void* vertices, size_t vertex_count, std::span<const std::span<const Index>> index_parts){
+    size_t index_count = 0;
+    for(const auto& part : index_parts)
+        index_count += part.size();
+
+    auto vertex_offset = vertex_allocator.allocate(vertex_count);
+    auto index_offset = index_allocator.allocate(index_count);
+    if(!vertex_offset || !index_offset){
+        // Give back whatever did fit, growing can move the free ranges around
+        if(vertex_offset)
+            vertex_allocator.free(*vertex_offset, vertex_count);
+        if(index_offset)
+            index_allocator.free(*index_offset, index_count);
+
+        this->grow(vertex_count, index_count);
+
+        vertex_offset = vertex_allocator.allocate(vertex_count);
+        index_offset = index_allocator.allocate(index_count);
+        assert(vertex_offset && index_offset);
+    }
+
+    if(vertex_count > 0)
+        vbo.write(vertices, *vertex_offset * vertex_stride, vertex_count * vertex_stride);
+    size_t written = 0;
+    for(const auto& part : index_parts){
+        if(part.size() > 0)
+            ebo.write(part.data(), (*index_offset + written) * sizeof(Index), part.size() * sizeof(Index));
+        written += part.size();
+    }
+
+    auto handle = next_handle++;
+    allocations[handle] = {.vertex_offset = *vertex_offset, .vertex_count = vertex_count, .index_offset = *index_offset, .index_count = index_count};
+    return handle;
+}
+
+void GeometryPool::free(Handle handle){
+    auto it = allocations.find(handle);
+    if(it == allocations.end())
+        return;
+
+    const auto& allocation = it->second;
+    vertex_allocator.free(allocation.vertex_offset, allocation.vertex_count);
+    index_allocator.free(allocation.index_offset, allocation.index_count);
+
+    allocations.erase(it);
+}
+
+gl::DrawCommand GeometryPool::draw_command(Handle handle) const {
+    const auto& allocation = allocations.at(handle);
+
+    gl::DrawCommand cmd{};
+    cmd.base_instance = 0;
+    cmd.instance_count = 1;
+
+    cmd.first_index = allocation.index_offset;
+    cmd.base_vertex = allocation.vertex_offset;
+
+    cmd.index_count = allocation.index_count;
+
+    return cmd;
+}
+
+void GeometryPool::grow(size_t min_vertices, size_t min_indices){
+    auto vertex_capacity = vertex_allocator.get_capacity();
+    auto index_capacity = index_allocator.get_capacity();
+
+    auto new_vertex_capacity = std::max(vertex_capacity * 2, vertex_capacity + min_vertices);
+    auto new_index_capacity = std::max(index_capacity * 2, index_capacity + min_indices);
+
+    auto new_vbo = Buffer<GL_ARRAY_BUFFER>{new_vertex_capacity * vertex_stride, nullptr, buffer_flags};
+    auto new_ebo = Buffer<GL_ELEMENT_ARRAY_BUFFER>{new_index_capacity * sizeof(Index), nullptr, buffer_flags};
+
+    // Offsets stay the same, so existing DrawCommands are still valid
+    vbo.copy_to(new_vbo, 0, 0, vertex_capacity * vertex_stride);
+    ebo.copy_to(new_ebo, 0, 0, index_capacity * sizeof(Index));
+
+    vbo.clean();
+    ebo.clean();
+    vbo = new_vbo;
+    ebo = new_ebo;
+
+    vertex_allocator.grow(new_vertex_capacity);
+    index_allocator.grow(new_index_capacity);
+
+    this->attach_buffers();
+
+    print("opengl/GeometryPool: Grew to {:d} vertices and {:d} indices\n", new_vertex_capacity, new_index_capacity);
+}
+
+void GeometryPool::compact(){
+    auto new_vbo = Buffer<GL_ARRAY_BUFFER>{vertex_allocator.get_capacity() * vertex_stride, nullptr, buffer_flags};
+    auto new_ebo = Buffer<GL_ELEMENT_ARRAY_BUFFER>{index_allocator.get_capacity() * sizeof(Index), nullptr, buffer_flags};
+
+    // Copying into fresh buffers means source and destination ranges can never overlap
+    std::vector<Allocation*> sorted{};
+    for(auto& [handle, allocation] : allocations)
+        sorted.push_back(&allocation);
+
+    std::sort(sorted.begin(), sorted.end(), [](const Allocation* a, const Allocation* b){ return a->vertex_offset < b->vertex_offset; });
+    size_t vertex_offset = 0;
+    for(auto* allocation : sorted){
+        if(allocation->vertex_count > 0)
+            vbo.copy_to(new_vbo, allocation->vertex_offset * vertex_stride, vertex_offset * vertex_stride, allocation->vertex_count * vertex_stride);
+        allocation->vertex_offset = vertex_offset;
+        vertex_offset += allocation->vertex_count;
+    }
+
+    std::sort(sorted.begin(), sorted.end(), [](const Allocation* a, const Allocation* b){ return a->index_offset < b->index_offset; });
+    size_t index_offset = 0;
+    for(auto* allocation : sorted){
+        if(allocation->index_count > 0)
+            ebo.copy_to(new_ebo, allocation->index_offset * sizeof(Index), index_offset * sizeof(Index), allocation->index_count * sizeof(Index));
+        allocation->index_offset = index_offset;
+        index_offset += allocation->index_count;
+    }
+
+    vbo.clean();
+    ebo.clean();
+    vbo = new_vbo;
+    ebo = new_ebo;
+
+    vertex_allocator.reset(vertex_offset);
+    index_allocator.reset(index_offset);
+
+    this->attach_buffers();
+    generation++;
+}
+
+float GeometryPool::fragmentation() const {
+    auto fragmentation = [](const RangeAllocator& allocator) -> float {
+        if(allocator.get_free() == 0)
+            return 0.0f;
+
+        return 1.0f - ((float)allocator.get_largest_free_block() / allocator.get_free());
+    };
+
+    return std::max(fragmentation(vertex_allocator), fragmentation(index_allocator));
+}
+
+void GeometryPool::attach_buffers(){
+    glVertexArrayVertexBuffer(vao, vertex_binding, vbo(), 0, vertex_stride); // Bind VBO0 to VAO
+    glVertexArrayElementBuffer(vao, ebo()); // Bind index buffer to VAO
+}
+
+GeometryPool::Stats GeometryPool::get_stats() const {
+    return {
+        .allocations = allocations.size(),
+        .vertices_used = vertex_allocator.get_used(), .vertex_capacity = vertex_allocator.get_capacity(),
+        .indices_used = index_allocator.get_used(), .index_capacity = index_allocator.get_capacity(),
+        .vertex_format = vertex_format,
+        .vertex_stride = vertex_stride,
+        .fragmentation = this->fragmentation(),
+        .free_vertex_blocks = vertex_allocator.get_free_block_count(), .free_index_blocks = index_allocator.get_free_block_count()
+    };
+}
+
+void GeometryPool::draw_debug_window(const Stats& stats){
+    ImGui::Text("Geometry pool: %zu allocations, %zu / %zu vertices, %zu / %zu indices\n", stats.allocations, stats.vertices_used, stats.vertex_capacity, stats.indices_used, stats.index_capacity);
+    ImGui::Text("Geometry pool vertex format: %s, %zu bytes per vertex, %zu bytes used\n", vertex_format_to_str(stats.vertex_format), stats.vertex_stride, stats.vertices_used * stats.vertex_stride);
+    ImGui::Text("Geometry pool fragmentation: %f (%zu free vertex blocks, %zu free index blocks)\n", stats.fragmentation, stats.free_vertex_blocks, stats.free_index_blocks);
+}
@@ -0,0 +1,114 @@
+#pragma once
+
+#include "../base.hpp"
+#include "../buffer.hpp"
+#include "../range_allocator.hpp"
+
+#include <span>
+#include <unordered_map>
+#include <vector>
+
+namespace benzene::opengl
+{
+    struct VertexAttribute {
+        GLint location;
+        GLenum type;
+        uintptr_t offset;
+        uint32_t n = 1;
+        bool normalized = false;
+        // Integer attributes reach the shader as ints instead of being converted to floats
+        bool integer = false;
+        // Attributes on GeometryPool::instance_binding advance once per instance instead of once per vertex
+        GLuint binding = 0;
+    };
+
+    // How the vertices of a benzene::Mesh are laid out in a pool's vertex buffer
+    enum class VertexFormat {
+        Full, // benzene::Mesh::Vertex as is
+        Packed // vertex_packing::PackedVertex
+    };
+    size_t vertex_format_stride(VertexFormat format);
+    const char* vertex_format_to_str(VertexFormat format);
+
+    // Sub-allocates the geometry of all meshes out of one vertex and one index buffer behind a single VAO,
+    // draws reference their slice through `first_index` and `base_vertex`
+    class GeometryPool {
+        public:
+        using Handle = uint32_t;
+        using Index = uint32_t;
+
+        static constexpr GLuint vertex_binding = 0;
+        static constexpr GLuint instance_binding = 1;
+
+        GeometryPool(): vertex_format{VertexFormat::Full}, vertex_stride{0}, vao{0}, next_handle{0}, generation{0} {}
+        GeometryPool(VertexFormat vertex_format, const std::vector<VertexAttribute>& attributes, size_t initial_vertices = 1 << 16, size_t initial_indices = 1 << 18);
+        void clean();
+
+        // `vertices` have to be in the pool's vertex format already
+        Handle allocate(const void* vertices, size_t vertex_count, const Index* indices, size_t index_count);
+        // Same, with the indices gathered from several arrays that end up back to back, so they don't have to be joined on the CPU first
+        Handle allocate(const void* vertices, size_t vertex_count, std::span<const std::span<const Index>> index_parts);
+        void free(Handle handle);
+
+        // Moves all live allocations to the start of the buffers, so freed holes can be reclaimed as one contiguous block
+        void compact();
+        float fragmentation() const;
+
+        gl::DrawCommand draw_command(Handle handle) const;
+
+        void bind() const {
+            glBindVertexArray(vao);
+        }
+
+        VertexFormat get_vertex_format() const {
+            return vertex_format;
+        }
+
+        GLuint vertex_array() const {
+            return vao;
+        }
+
+        // Sources the per-instance attributes from `buffer`, draws pick where they start reading in it with `base_instance`
+        void bind_instance_buffer(GLuint buffer, size_t offset, size_t stride) const {
+            glVertexArrayVertexBuffer(vao, instance_binding, buffer, offset, stride);
+        }
+
+        // Bumped every time allocations move, so cached DrawCommands can be detected as stale
+        uint64_t get_generation() const {
+            return generation;
+        }
+
+        struct Stats {
+            size_t allocations;
+            size_t vertices_used, vertex_capacity, indices_used, index_capacity;
+            VertexFormat vertex_format;
+            size_t vertex_stride;
+            float fragmentation;
+            size_t free_vertex_blocks, free_index_blocks;
+        };
+        Stats get_stats() const;
+        // Shows `stats` instead of the pool itself, the debug window may be drawn while the render thread is using the pool
+        static void draw_debug_window(const Stats& stats);
+
+        private:
+        struct Allocation {
+            size_t vertex_offset, vertex_count;
+            size_t index_offset, index_count;
+        };
+
+        void grow(size_t min_vertices, size_t min_indices);
+        void attach_buffers();
+
+        VertexFormat vertex_format;
+        size_t vertex_stride;
+        GLuint vao;
+
+        Buffer<GL_ARRAY_BUFFER> vbo;
+        Buffer<GL_ELEMENT_ARRAY_BUFFER> ebo;
+        RangeAllocator vertex_allocator, index_allocator;
+
+        std::unordered_map<Handle, Allocation> allocations;
+        Handle next_handle;
+        uint64_t generation;
+    };
+} // namespace benzene::opengl
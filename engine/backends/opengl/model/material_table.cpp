@@ -0,0 +1,57 @@
+#include "material_table.hpp"
+
+using namespace benzene::opengl;
+
+void MaterialTable::clean(){
+    entries.clear();
+    free_entries.clear();
+    lookup.clear();
+    buffer.clean();
+    dirty = false;
+    references = 0;
+}
+
+uint32_t MaterialTable::add(const Entry& entry){
+    references++;
+    auto [it, inserted] = lookup.try_emplace(entry, Shared{.index = 0, .references = 0});
+    it->second.references++;
+    if(!inserted)
+        return it->second.index;
+
+    dirty = true;
+    if(free_entries.empty()){
+        it->second.index = entries.size();
+        entries.push_back(entry);
+    } else {
+        it->second.index = free_entries.back();
+        free_entries.pop_back();
+        entries[it->second.index] = entry;
+    }
+
+    return it->second.index;
+}
+
+void MaterialTable::remove(uint32_t index){
+    references--;
+    auto it = lookup.find(entries[index]);
+    if(it == lookup.end() || --it->second.references > 0)
+        return;
+
+    lookup.erase(it);
+    free_entries.push_back(index);
+}
+
+void MaterialTable::bind(){
+    if(dirty){
+        auto size = entries.size() * sizeof(Entry);
+        if(size > buffer.get_size()){
+            buffer.clean();
+            buffer = Buffer<GL_SHADER_STORAGE_BUFFER>{2 * size, nullptr, GL_DYNAMIC_STORAGE_BIT};
+        }
+
+        buffer.write(entries.data(), 0, size);
+        dirty = false;
+    }
+
+    buffer.bind_base(binding);
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include "../base.hpp"
+#include "../buffer.hpp"
+
+#include <compare>
+#include <map>
+#include <vector>
+#include <cstdint>
+
+namespace benzene::opengl
+{
+    // Every parameter of every material, in one SSBO the shaders index with the material of the draw command instead of anything being set per draw.
+    // Meshes with the same parameters and textures share one entry, so the index also tells draws apart that really need different materials
+    class MaterialTable {
+        public:
+        // Matches `Material` in the forward shader, std430. The maps are TextureTable slots, their texels are multiplied by the colours
+        struct Entry {
+            float diffuse[3];
+            float shininess;
+            float specular[3];
+            uint32_t normal_map;
+            uint32_t diffuse_map, specular_map;
+            uint32_t padding[2];
+
+            auto operator<=>(const Entry&) const = default;
+        };
+
+        MaterialTable(): dirty{false}, references{0} {}
+        void clean();
+
+        // Returns the index of an identical entry if there is one, every add() needs its own remove()
+        uint32_t add(const Entry& entry);
+        void remove(uint32_t index);
+
+        // Uploads the table if anything changed since the last call and binds it
+        void bind();
+
+        // Distinct entries, and how many meshes use them
+        size_t get_size() const {
+            return lookup.size();
+        }
+
+        size_t get_reference_count() const {
+            return references;
+        }
+
+        static constexpr GLuint binding = 7;
+
+        private:
+        struct Shared {
+            uint32_t index;
+            size_t references;
+        };
+
+        std::vector<Entry> entries;
+        std::vector<uint32_t> free_entries;
+        std::map<Entry, Shared> lookup;
+        Buffer<GL_SHADER_STORAGE_BUFFER> buffer;
+        bool dirty;
+        size_t references;
+    };
+} // namespace benzene::opengl
@@ -0,0 +1,132 @@
+#include "render_queue.hpp"
+#include "batch.hpp"
+
+#include <algorithm>
+#include <optional>
+#include <cstring>
+
+using namespace benzene::opengl;
+
+uint64_t RenderQueue::make_key(uint32_t program, uint32_t geometry, uint32_t material, float depth){
+    // Positive floats sort like their bits, the top 16 keep the exponent and 7 bits of the mantissa
+    depth = std::max(depth, 0.0f);
+    uint32_t depth_bits;
+    std::memcpy(&depth_bits, &depth, sizeof(float));
+
+    return ((uint64_t)(program & 0xFF) << 56) | ((uint64_t)(geometry & 0xFFFFF) << 36) | ((uint64_t)(material & 0xFFFFF) << 16) | (depth_bits >> 16);
+}
+
+void RenderQueue::begin_frame(const glm::vec3& camera_pos){
+    this->camera_pos = camera_pos;
+
+    sorted_last_frame = sorted;
+    unsorted_last_frame = unsorted;
+    items_last_frame = items_this_frame;
+    sorted = {};
+    unsorted = {};
+    items_this_frame = 0;
+    programs.clear();
+    first_draw_uniforms.clear();
+}
+
+uint32_t RenderQueue::id_of(const Batch* batch){
+    auto [it, inserted] = batch_ids.try_emplace(batch, batch_ids.size());
+    return it->second;
+}
+
+void RenderQueue::push(const Item& item){
+    const auto* program = &item.batch->get_program();
+    auto program_id = std::find(programs.begin(), programs.end(), program) - programs.begin();
+    if((size_t)program_id == programs.size()){
+        programs.push_back(program);
+        first_draw_uniforms.push_back(program->get_uniform<int>("firstDraw"));
+    }
+
+    // Only the low bits of the vertex array name fit, sharing them merely groups two vertex arrays together
+    auto geometry = ((item.batch->get_pool().vertex_array() & 0xF) << 16) | (this->id_of(item.batch) & 0xFFFF);
+    items.emplace_back(make_key(program_id, geometry, item.material, item.depth), item);
+}
+
+void RenderQueue::flush(){
+    items_this_frame += items.size();
+    this->walk(false, unsorted);
+    if(sorting)
+        std::stable_sort(items.begin(), items.end(), [](const auto& a, const auto& b){ return a.first < b.first; });
+    this->walk(true, sorted);
+
+    items.clear();
+    batch_ids.clear();
+}
+
+void RenderQueue::walk(bool issue, StateChanges& changes){
+    Program* program = nullptr;
+    UniformHandle<int> first_draw_uniform{};
+    GLuint vertex_array = 0;
+    const Batch* batch = nullptr;
+    // Uniforms stay set in the program, but another program may have been used in between
+    std::optional<int> first_draw;
+
+    auto set_first_draw = [&](int value){
+        if(first_draw == value)
+            return;
+
+        first_draw = value;
+        changes.uniforms++;
+        if(issue)
+            program->set_uniform(first_draw_uniform, value);
+    };
+
+    for(const auto& [key, item] : items){
+        auto& item_program = item.batch->get_program();
+        if(&item_program != program){
+            program = &item_program;
+            first_draw_uniform = first_draw_uniforms[key >> 56];
+            first_draw.reset();
+            changes.programs++;
+            if(issue)
+                program->bind();
+        }
+
+        const auto& pool = item.batch->get_pool();
+        if(pool.vertex_array() != vertex_array){
+            vertex_array = pool.vertex_array();
+            changes.geometry++;
+            if(issue)
+                pool.bind();
+        }
+
+        if(item.batch != batch){
+            batch = item.batch;
+            changes.batches++;
+            if(issue)
+                batch->bind_state();
+        }
+
+        if(item.indirect){
+            set_first_draw(item.first_command);
+            changes.draws++;
+            if(issue)
+                gl::multi_draw_indirect<uint32_t>(batch->get_first_indirect_command() + item.first_command, item.command_count);
+            continue;
+        }
+
+        for(size_t i = item.first_command; i < (item.first_command + item.command_count); i++){
+            const auto& command = batch->get_draw_command(i);
+            if(command.instance_count == 0)
+                continue;
+
+            set_first_draw(i);
+            changes.draws++;
+            if(issue)
+                gl::draw<uint32_t>(command);
+        }
+    }
+}
+
+bool RenderQueue::draw_debug_window(Stats& stats){
+    bool toggled = ImGui::Checkbox("Sort draws by state", &stats.sorting);
+    ImGui::Text("Render queue: %zu items, %zu draw calls\n", stats.items, stats.sorted.draws);
+    ImGui::Text("State changes: %zu programs, %zu geometry, %zu batches, %zu uniforms\n", stats.sorted.programs, stats.sorted.geometry, stats.sorted.batches, stats.sorted.uniforms);
+    ImGui::Text("State changes in submission order: %zu, sorted: %zu\n", stats.unsorted.total(), stats.sorted.total());
+    return toggled;
+}
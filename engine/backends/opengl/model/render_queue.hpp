@@ -0,0 +1,86 @@
+#pragma once
+
+#include "../base.hpp"
+#include "../pipeline.hpp"
+
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include <cstdint>
+
+namespace benzene::opengl
+{
+    class Batch;
+
+    // GL state set while drawing, per frame
+    struct StateChanges {
+        size_t programs, geometry, batches, uniforms, draws;
+
+        size_t total() const {
+            return programs + geometry + batches + uniforms;
+        }
+    };
+
+    // Collects the draws of every batch and issues them once they're all in, sorted by a 64-bit key so draws that need the same state end up next to each other
+    class RenderQueue {
+        public:
+        // A range of a batch's draw commands, drawn with one multi-draw if `indirect` and one draw per command with instances otherwise
+        struct Item {
+            const Batch* batch;
+            uint32_t material;
+            // From the camera, nearer draws go first so they can occlude the ones behind them
+            float depth;
+            uint32_t first_command, command_count;
+            bool indirect;
+        };
+
+        RenderQueue(): camera_pos{0.0f}, sorting{true}, sorted{}, unsorted{}, sorted_last_frame{}, unsorted_last_frame{}, items_last_frame{0}, items_this_frame{0} {}
+
+        // From the most significant bits down: program, geometry, material and depth. Geometry is the vertex array and the batch,
+        // since every batch has its own instance buffers. Materials are only indices into the MaterialTable, so they go below anything that really binds something
+        static uint64_t make_key(uint32_t program, uint32_t geometry, uint32_t material, float depth);
+
+        void begin_frame(const glm::vec3& camera_pos);
+        void push(const Item& item);
+        // Sorts and issues everything pushed since the last flush, the batches' state has to stay as it was when they pushed their items until then
+        void flush();
+
+        const glm::vec3& get_camera_position() const {
+            return camera_pos;
+        }
+
+        struct Stats {
+            bool sorting;
+            size_t items;
+            StateChanges sorted, unsorted;
+        };
+        Stats get_stats() const {
+            return {.sorting = sorting, .items = items_last_frame, .sorted = sorted_last_frame, .unsorted = unsorted_last_frame};
+        }
+
+        void set_sorting(bool sorting){
+            this->sorting = sorting;
+        }
+
+        // Shows `stats` instead of the queue itself, the render thread may be filling it meanwhile. Returns true if sorting was toggled in `stats`
+        static bool draw_debug_window(Stats& stats);
+
+        private:
+        // Counts the state changes drawing `items` in their current order takes, and makes them if `issue` is set
+        void walk(bool issue, StateChanges& changes);
+        uint32_t id_of(const Batch* batch);
+
+        std::vector<std::pair<uint64_t, Item>> items;
+        std::vector<const Program*> programs;
+        // `firstDraw` of every program, by the index the program has in the keys
+        std::vector<UniformHandle<int>> first_draw_uniforms;
+        std::unordered_map<const Batch*, uint32_t> batch_ids;
+
+        glm::vec3 camera_pos;
+        bool sorting;
+        // This frame's changes so far, and what they would have been in the order the items were pushed
+        StateChanges sorted, unsorted;
+        StateChanges sorted_last_frame, unsorted_last_frame;
+        size_t items_last_frame, items_this_frame;
+    };
+} // namespace benzene::opengl
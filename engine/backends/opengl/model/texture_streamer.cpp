@@ -0,0 +1,363 @@
+#include "texture_streamer.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+using namespace benzene::opengl;
+
+namespace {
+    // Longer side of the placeholder level, in pixels
+    constexpr int placeholder_size = 32;
+    // Unpack offsets only have to be a multiple of the texel size, this also keeps the workers' copies aligned
+    constexpr size_t ring_alignment = 64;
+
+    // Without workers nothing would pick the job up until someone waits on it, so it's done right away
+    void run(std::function<void()> job, benzene::jobs::Counter& counter){
+        auto* scheduler = benzene::jobs::current();
+        if(scheduler && scheduler->get_worker_count() > 0)
+            scheduler->submit(std::move(job), counter);
+        else
+            job();
+    }
+
+    void wait(benzene::jobs::Counter& counter){
+        if(auto* scheduler = benzene::jobs::current())
+            scheduler->wait(counter);
+    }
+
+    GLenum pixel_format(int channels){
+        return (channels == 4) ? GL_RGBA : GL_RGB;
+    }
+
+    // How a level is cut into rows in the pixels, compressed levels only come in whole rows of 4x4 blocks
+    struct LevelLayout {
+        int width, height;
+        size_t row_height, row_size, offset;
+    };
+
+    LevelLayout layout_of(const benzene::Texture& texture, int level){
+        if(texture.get_compression() == benzene::Texture::Compression::None){
+            const auto [width, height] = texture.dimensions();
+            return {.width = width, .height = height, .row_height = 1, .row_size = (size_t)width * texture.get_channels(), .offset = 0};
+        }
+
+        const auto& l = texture.get_levels()[level];
+        auto block_rows = (size_t)(l.height + 3) / 4;
+        return {.width = l.width, .height = l.height, .row_height = 4, .row_size = l.size / block_rows, .offset = l.offset};
+    }
+
+    // Box filters the full level down to level_width x level_height
+    std::vector<uint8_t> downsample(const uint8_t* pixels, int width, int height, int channels, int level_width, int level_height){
+        std::vector<uint8_t> level(level_width * level_height * channels);
+        for(int y = 0; y < level_height; y++){
+            int y0 = y * height / level_height;
+            int y1 = std::max(y0 + 1, (y + 1) * height / level_height);
+            for(int x = 0; x < level_width; x++){
+                int x0 = x * width / level_width;
+                int x1 = std::max(x0 + 1, (x + 1) * width / level_width);
+
+                uint32_t sum[4] = {};
+                for(int sy = y0; sy < y1; sy++)
+                    for(int sx = x0; sx < x1; sx++)
+                        for(int c = 0; c < channels; c++)
+                            sum[c] += pixels[((size_t)sy * width + sx) * channels + c];
+
+                auto count = (uint32_t)((y1 - y0) * (x1 - x0));
+                for(int c = 0; c < channels; c++)
+                    level[((size_t)y * level_width + x) * channels + c] = (uint8_t)((sum[c] + count / 2) / count);
+            }
+        }
+
+        return level;
+    }
+}
+
+TextureStreamer::TextureStreamer(size_t ring_size, size_t budget): ring_size{ring_size}, budget{budget}, head{0}, streamed_last_frame{0}, streamed_total{0}, completed{0} {
+    ring = Buffer<GL_PIXEL_UNPACK_BUFFER>{ring_size, nullptr, GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT};
+    base = (uint8_t*)ring.map();
+}
+
+void TextureStreamer::clean(){
+    // Workers might still be reading pixels or writing into the ring
+    for(auto& item : items)
+        wait(*item.preparing);
+
+    for(auto& band : bands){
+        wait(*band.staged);
+        if(band.fence)
+            glDeleteSync(band.fence);
+    }
+
+    items.clear();
+    bands.clear();
+    ring.clean();
+    base = nullptr;
+}
+
+void TextureStreamer::enqueue(GLuint texture, const benzene::Texture& source){
+    bool compressed = source.get_compression() != benzene::Texture::Compression::None;
+    int coarsest = compressed ? (int)source.get_levels().size() - 1 : 0;
+
+    // Compressed textures have their coarse levels already, those are streamed first instead
+    int placeholder_level = 0;
+    const auto [width, height] = source.dimensions();
+    if(!compressed)
+        while(std::max(width >> placeholder_level, height >> placeholder_level) > placeholder_size)
+            placeholder_level++;
+
+    auto& item = items.emplace_back(Item{
+        .texture = texture, .source = source, .prepared = std::make_shared<Prepared>(), .preparing = std::make_unique<jobs::Counter>(),
+        .level = coarsest, .rows_staged = 0, .rows_uploaded = std::vector<size_t>(coarsest + 1, 0), .resident_level = coarsest + 1,
+        .placeholder_level = placeholder_level, .generation = 0, .placeholder_uploaded = false, .finished = false, .cancelled = false
+    });
+
+    // Getting the pixels may mean decoding the file again, which is exactly the kind of work that shouldn't happen on the render thread
+    run([prepared = item.prepared, source, compressed, placeholder_level]{
+        try {
+            const auto [width, height] = source.dimensions();
+            auto channels = source.get_channels();
+            prepared->pixels = source.acquire_pixels();
+
+            if(!compressed){
+                prepared->placeholder_width = std::max(width >> placeholder_level, 1);
+                prepared->placeholder_height = std::max(height >> placeholder_level, 1);
+                prepared->placeholder = downsample(prepared->pixels.get(), width, height, channels, prepared->placeholder_width, prepared->placeholder_height);
+            }
+            prepared->failed = false;
+        } catch(const std::exception&){
+            prepared->failed = true;
+        }
+    }, *item.preparing);
+}
+
+void TextureStreamer::cancel(GLuint texture){
+    // Jobs that are still running hold on to what they need, the entries go away once they're done
+    for(auto& item : items)
+        if(item.texture == texture)
+            item.cancelled = true;
+
+    for(auto& band : bands)
+        if(band.texture == texture)
+            band.texture = 0;
+}
+
+TextureStreamer::Item* TextureStreamer::find(GLuint texture){
+    for(auto& item : items)
+        if(item.texture == texture && !item.cancelled && !item.finished)
+            return &item;
+
+    return nullptr;
+}
+
+std::pair<int, int> TextureStreamer::sampled_range(const Item& item){
+    // The coarsest level is the first one in, until then it's sampled undefined like nothing else was there either
+    if(item.source.get_compression() != benzene::Texture::Compression::None){
+        auto coarsest = (int)item.rows_uploaded.size() - 1;
+        return {std::min(item.resident_level, coarsest), coarsest};
+    }
+
+    return {item.placeholder_level, item.placeholder_level};
+}
+
+void TextureStreamer::uploaded(Item& item, int level){
+    auto [first, last] = sampled_range(item);
+    if(level >= first && level <= last)
+        item.generation++;
+}
+
+std::optional<TextureStreamer::SampledLevels> TextureStreamer::get_sampled_levels(GLuint texture) const {
+    for(const auto& item : items){
+        if(item.texture != texture || item.cancelled || item.finished)
+            continue;
+
+        auto [first, last] = sampled_range(item);
+        return SampledLevels{.first = first, .last = last, .generation = item.generation};
+    }
+
+    return std::nullopt;
+}
+
+std::optional<size_t> TextureStreamer::allocate(size_t size){
+    size = (size + ring_alignment - 1) / ring_alignment * ring_alignment;
+    if(size > ring_size)
+        return std::nullopt;
+
+    if(bands.empty()){
+        head = size;
+        return 0;
+    }
+
+    // Free space is from the head up to the oldest band, wrapping around the end of the ring. Head and tail never meet, so they can't be mistaken for an empty ring
+    auto tail = bands.front().offset;
+    if(head > tail){
+        if((head + size) <= ring_size){
+            head += size;
+            return head - size;
+        }
+
+        if(size < tail){
+            head = size;
+            return 0;
+        }
+    } else if((head + size) < tail){
+        head += size;
+        return head - size;
+    }
+
+    return std::nullopt;
+}
+
+void TextureStreamer::update(){
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+    // Bands the workers are done copying go to the GPU right away
+    ring.bind();
+    for(auto& band : bands){
+        if(band.issued || !band.staged->done())
+            continue;
+
+        if(band.texture != 0){
+            if(band.compressed)
+                glCompressedTextureSubImage2D(band.texture, band.level, 0, band.first_row, band.width, band.rows, band.format, band.size, (const void*)band.offset);
+            else
+                glTextureSubImage2D(band.texture, band.level, 0, band.first_row, band.width, band.rows, band.format, GL_UNSIGNED_BYTE, (const void*)band.offset);
+            band.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+            if(auto* item = this->find(band.texture)){
+                item->rows_uploaded[band.level] += band.rows;
+                uploaded(*item, band.level);
+            }
+        }
+        band.issued = true;
+    }
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+    for(auto& item : items){
+        if(item.cancelled || item.finished || !item.preparing->done())
+            continue;
+
+        auto& prepared = *item.prepared;
+        if(prepared.failed){
+            print("opengl/TextureStreamer: Failed to get the pixels of a {:s} texture, it stays undefined\n", item.source.get_shader_name());
+            item.cancelled = true;
+            continue;
+        }
+
+        // Placeholders are small enough to go straight from client memory
+        if(!item.placeholder_uploaded){
+            if(!prepared.placeholder.empty()){
+                glTextureSubImage2D(item.texture, item.placeholder_level, 0, 0, prepared.placeholder_width, prepared.placeholder_height, pixel_format(item.source.get_channels()), GL_UNSIGNED_BYTE, prepared.placeholder.data());
+                uploaded(item, item.placeholder_level);
+            }
+            prepared.placeholder = {};
+            item.placeholder_uploaded = true;
+        }
+
+        bool done = false;
+        if(item.source.get_compression() != benzene::Texture::Compression::None){
+            // Levels come in from the coarsest, every one that's complete down from there can be sampled
+            while(item.resident_level > 0 && item.rows_uploaded[item.resident_level - 1] == (size_t)item.source.get_levels()[item.resident_level - 1].height)
+                item.resident_level--;
+
+            done = item.resident_level == 0;
+        } else if(item.rows_uploaded[0] == (size_t)item.source.dimensions().second){
+            // The uploads of every band were issued before this, so the mipmaps are built from the whole level
+            glGenerateTextureMipmap(item.texture);
+            done = true;
+        }
+
+        if(done){
+            prepared.pixels.reset();
+            item.source.release_after_upload();
+            item.finished = true;
+            completed++;
+        }
+    }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+    // Bands retire in ring order, which is also the order their fences signal in
+    while(!bands.empty() && bands.front().issued){
+        auto& band = bands.front();
+        if(band.fence){
+            auto status = glClientWaitSync(band.fence, 0, 0);
+            if(status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+                break;
+            glDeleteSync(band.fence);
+        }
+
+        bands.pop_front();
+    }
+
+    std::erase_if(items, [](const Item& item){
+        return (item.cancelled || item.finished) && item.preparing->done();
+    });
+
+    // Textures are streamed in the order they were added, so the first ones become sharp first instead of all of them at once
+    size_t staged = 0;
+    for(auto& item : items){
+        if(item.cancelled || item.finished || !item.placeholder_uploaded)
+            continue;
+
+        bool compressed = item.source.get_compression() != benzene::Texture::Compression::None;
+        auto format = compressed ? gl::compressed_format(item.source.get_compression(), item.source.get_gamut()) : pixel_format(item.source.get_channels());
+        while(item.level >= 0 && staged < budget){
+            auto layout = layout_of(item.source, item.level);
+            if(item.rows_staged >= (size_t)layout.height){
+                item.level--;
+                item.rows_staged = 0;
+                continue;
+            }
+
+            // A single row wider than the budget still gets through, one per frame
+            auto rows_left = ((size_t)layout.height - item.rows_staged + layout.row_height - 1) / layout.row_height;
+            auto rows = std::min<size_t>(rows_left, std::max<size_t>((budget - staged) / layout.row_size, (staged == 0) ? 1 : 0));
+            rows = std::min(rows, std::max<size_t>(ring_size / 2 / layout.row_size, 1));
+            if(rows == 0)
+                break;
+
+            auto offset = this->allocate(rows * layout.row_size);
+            if(!offset)
+                break;
+
+            auto& band = bands.emplace_back(Band{
+                .texture = item.texture, .offset = *offset, .size = rows * layout.row_size, .level = item.level,
+                .first_row = item.rows_staged, .rows = std::min(rows * layout.row_height, (size_t)layout.height - item.rows_staged), .width = layout.width,
+                .format = format, .compressed = compressed, .staged = std::make_unique<jobs::Counter>(), .fence = nullptr, .issued = false
+            });
+
+            auto first = layout.offset + item.rows_staged / layout.row_height * layout.row_size;
+            run([destination = base + band.offset, pixels = item.prepared->pixels, first, size = band.size]{
+                std::memcpy(destination, pixels.get() + first, size);
+            }, *band.staged);
+
+            item.rows_staged += band.rows;
+            staged += band.size;
+        }
+
+        if(staged >= budget)
+            break;
+    }
+
+    streamed_last_frame = staged;
+    streamed_total += staged;
+}
+
+TextureStreamer::Stats TextureStreamer::get_stats() const {
+    size_t pending = 0;
+    for(const auto& item : items)
+        pending += (!item.cancelled && !item.finished) ? 1 : 0;
+
+    return {.pending = pending, .completed = completed, .streamed_last_frame = streamed_last_frame, .streamed_total = streamed_total, .ring_size = ring_size, .bands_in_flight = bands.size(), .budget = budget};
+}
+
+bool TextureStreamer::draw_debug_window(Stats& stats){
+    ImGui::Text("Texture streaming: %zu pending, %zu done, %zu bytes staged last frame, %zu bytes total\n", stats.pending, stats.completed, stats.streamed_last_frame, stats.streamed_total);
+    ImGui::Text("Texture staging ring: %zu bytes, %zu bands in flight\n", stats.ring_size, stats.bands_in_flight);
+
+    int budget_kib = stats.budget / 1024;
+    if(!ImGui::SliderInt("Texture upload budget (KiB per frame)", &budget_kib, 64, 64 * 1024))
+        return false;
+
+    stats.budget = (size_t)budget_kib * 1024;
+    return true;
+}
@@ -0,0 +1,119 @@
+#pragma once
+
+#include "../base.hpp"
+#include "../buffer.hpp"
+
+#include <deque>
+#include <memory>
+#include <optional>
+#include <utility>
+#include <vector>
+
+namespace benzene::opengl
+{
+    // Uploads textures a bit every frame instead of all at once. Worker threads copy rows of texels into a persistently mapped pixel unpack ring,
+    // the render thread turns at most `budget` bytes of them per frame into uploads, fenced so their part of the ring is only reused once the GPU read it.
+    // Until a texture's full level is resident it only samples a small placeholder level, which a worker makes from the same pixels.
+    // Compressed textures bring their own mip chain, it's streamed from the coarsest level to the finest in rows of blocks and each level is sampled as soon as it's complete.
+    // Texture state is left alone so bindless handles can be made for textures while they stream, the TextureTable keeps sampling within get_sampled_levels() instead
+    class TextureStreamer {
+        public:
+        TextureStreamer(): ring_size{0}, budget{0}, head{0}, base{nullptr}, streamed_last_frame{0}, streamed_total{0}, completed{0} {}
+        TextureStreamer(size_t ring_size, size_t budget);
+        void clean();
+
+        // `texture` needs immutable storage for its whole mip chain, `source` keeps the pixels around until they're uploaded
+        void enqueue(GLuint texture, const benzene::Texture& source);
+        // Stops streaming into `texture`, for textures deleted before they were done
+        void cancel(GLuint texture);
+
+        // Uploads whatever the workers staged since the last call and stages the next rows within the budget, once per frame on the render thread
+        void update();
+
+        // Levels of a streaming texture that may be sampled, `generation` changes whenever texels are uploaded into any of them
+        struct SampledLevels {
+            int first, last;
+            uint64_t generation;
+
+            bool operator==(const SampledLevels&) const = default;
+        };
+
+        // What of `texture` may be sampled while it's streaming in, nothing once every level is resident or if it was never enqueued
+        std::optional<SampledLevels> get_sampled_levels(GLuint texture) const;
+
+        struct Stats {
+            size_t pending, completed;
+            size_t streamed_last_frame, streamed_total;
+            size_t ring_size, bands_in_flight;
+            size_t budget;
+        };
+        Stats get_stats() const;
+        void set_budget(size_t budget){
+            this->budget = budget;
+        }
+
+        // Shows `stats` instead of the streamer itself, it may be uploading on the render thread meanwhile. Returns true if the budget in `stats` was changed
+        static bool draw_debug_window(Stats& stats);
+
+        private:
+        // Written by the worker preparing a texture, only read once its counter is done
+        struct Prepared {
+            std::shared_ptr<const uint8_t> pixels;
+            std::vector<uint8_t> placeholder;
+            int placeholder_width, placeholder_height;
+            bool failed;
+        };
+
+        struct Item {
+            GLuint texture;
+            benzene::Texture source;
+            std::shared_ptr<Prepared> prepared;
+            std::unique_ptr<jobs::Counter> preparing;
+            // Levels are staged from `level` down to 0, uncompressed textures only stream level 0
+            int level;
+            size_t rows_staged;
+            // Per level, rows of pixels the uploads were issued for
+            std::vector<size_t> rows_uploaded;
+            // Finest level every coarser level is complete below, for compressed textures
+            int resident_level;
+            // Level of the placeholder, for uncompressed textures
+            int placeholder_level;
+            // Counts uploads into levels that were being sampled, see SampledLevels
+            uint64_t generation;
+            bool placeholder_uploaded, finished, cancelled;
+        };
+
+        // Rows of one of a texture's levels in the ring, `texture` is 0 if it was cancelled
+        struct Band {
+            GLuint texture;
+            size_t offset, size;
+            int level;
+            size_t first_row, rows;
+            int width;
+            // The client format of uncompressed rows, or the internal format of compressed ones
+            GLenum format;
+            bool compressed;
+            std::unique_ptr<jobs::Counter> staged;
+            GLsync fence;
+            bool issued;
+        };
+
+        Item* find(GLuint texture);
+        static std::pair<int, int> sampled_range(const Item& item);
+        // Bumps the generation of `item` if `level` is one it's sampling
+        static void uploaded(Item& item, int level);
+        // Contiguous room in the ring behind every band that's still in flight
+        std::optional<size_t> allocate(size_t size);
+
+        size_t ring_size, budget;
+        size_t head;
+        uint8_t* base;
+        Buffer<GL_PIXEL_UNPACK_BUFFER> ring;
+
+        std::deque<Item> items;
+        // In ring order
+        std::deque<Band> bands;
+
+        size_t streamed_last_frame, streamed_total, completed;
+    };
+} // namespace benzene::opengl
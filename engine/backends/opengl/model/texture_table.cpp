@@ -0,0 +1,224 @@
+#include "texture_table.hpp"
+#include "batch.hpp"
+
+#include <algorithm>
+
+using namespace benzene::opengl;
+
+namespace {
+    // Layers a new array starts with, it doubles every time it runs out
+    constexpr size_t initial_layers = 4;
+
+    enum Neutral { White, FlatNormal };
+}
+
+TextureTable::TextureTable(TextureStreamer& streamer): streamer{&streamer}, bindless{GLAD_GL_ARB_bindless_texture != 0}, dirty{true}, max_layers{0}, without_layer{0} {
+    GLint layers = 0;
+    glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &layers);
+    max_layers = layers;
+
+    print("opengl/TextureTable: Sampling textures through {:s}\n", bindless ? "bindless handles" : "texture arrays");
+
+    const uint8_t pixels[2][3] = {{255, 255, 255}, {128, 128, 255}};
+    for(int i = 0; i < 2; i++){
+        neutral[i] = Texture::create(1, 1, 1, GL_RGB8);
+        glTextureSubImage2D(neutral[i], 0, 0, 0, 1, 1, GL_RGB, GL_UNSIGNED_BYTE, pixels[i]);
+        neutral_slots[i] = this->add(neutral[i], 0);
+    }
+}
+
+void TextureTable::clean(){
+    for(const auto& slot : slots)
+        if(slot.texture != 0 && slot.handle != 0)
+            glMakeTextureHandleNonResidentARB(slot.handle);
+
+    glDeleteTextures(2, neutral);
+    for(auto& array : arrays)
+        glDeleteTextures(1, &array.texture);
+
+    slots.clear();
+    entries.clear();
+    free_slots.clear();
+    arrays.clear();
+    buffer.clean();
+}
+
+uint32_t TextureTable::add(GLuint texture, uint32_t fallback){
+    uint32_t index;
+    if(free_slots.empty()){
+        index = slots.size();
+        slots.emplace_back();
+        entries.emplace_back();
+    } else {
+        index = free_slots.back();
+        free_slots.pop_back();
+    }
+
+    GLint levels = 0;
+    glGetTextureParameteriv(texture, GL_TEXTURE_IMMUTABLE_LEVELS, &levels);
+    auto& slot = slots[index];
+    auto& entry = entries[index];
+    slot = Slot{.texture = texture, .handle = 0, .layer = std::nullopt, .sampled = std::nullopt, .levels = levels, .streaming = true};
+    entry = Entry{.handle = 0, .array = 0, .layer = 0, .min_lod = 0.0f, .max_lod = 0.0f};
+
+    if(bindless){
+        // None of the texture's state can change after this, which is why the streamer leaves its base and max level alone
+        slot.handle = glGetTextureHandleARB(texture);
+        glMakeTextureHandleResidentARB(slot.handle);
+        entry.handle = slot.handle;
+    } else {
+        GLint format = 0, width = 0, height = 0;
+        glGetTextureLevelParameteriv(texture, 0, GL_TEXTURE_INTERNAL_FORMAT, &format);
+        glGetTextureLevelParameteriv(texture, 0, GL_TEXTURE_WIDTH, &width);
+        glGetTextureLevelParameteriv(texture, 0, GL_TEXTURE_HEIGHT, &height);
+
+        slot.layer = this->allocate_layer(format, width, height, levels);
+        if(!slot.layer){
+            print("opengl/TextureTable: No texture array left for a {:d}x{:d} texture, it samples a default texture instead\n", width, height);
+            entry = entries[fallback];
+            slot.streaming = false;
+            without_layer++;
+            dirty = true;
+            return index;
+        }
+
+        entry.array = slot.layer->first;
+        entry.layer = slot.layer->second;
+    }
+
+    this->refresh(index);
+    dirty = true;
+    return index;
+}
+
+void TextureTable::remove(uint32_t index){
+    auto& slot = slots[index];
+    if(slot.handle != 0)
+        glMakeTextureHandleNonResidentARB(slot.handle);
+    else if(slot.layer)
+        arrays[slot.layer->first].free_layers.push_back(slot.layer->second);
+    else if(!bindless)
+        without_layer--;
+
+    slot = Slot{.texture = 0, .handle = 0, .layer = std::nullopt, .sampled = std::nullopt, .levels = 0, .streaming = false};
+    free_slots.push_back(index);
+}
+
+uint32_t TextureTable::default_for(const std::string& shader_name) const {
+    // Colour maps are multiplied by the material's colours, white leaves just those
+    return (shader_name == "normal") ? neutral_slots[FlatNormal] : neutral_slots[White];
+}
+
+std::optional<std::pair<uint32_t, uint32_t>> TextureTable::allocate_layer(GLenum format, int width, int height, int levels){
+    for(uint32_t i = 0; i < arrays.size(); i++){
+        auto& array = arrays[i];
+        if(array.format != format || array.width != width || array.height != height || array.levels != levels)
+            continue;
+
+        if(!array.free_layers.empty()){
+            auto layer = array.free_layers.back();
+            array.free_layers.pop_back();
+            return std::pair{i, layer};
+        }
+
+        if(array.used == array.capacity){
+            // A full array can't grow any further, the next one of the same shape takes over
+            if(array.capacity == max_layers)
+                continue;
+
+            // Arrays have immutable storage, so a full one is replaced by one twice its size with every layer copied over
+            auto capacity = std::min(array.capacity * 2, max_layers);
+            auto grown = Texture::create(width, height, levels, format, capacity);
+            for(int level = 0; level < levels; level++)
+                glCopyImageSubData(array.texture, GL_TEXTURE_2D_ARRAY, level, 0, 0, 0, grown, GL_TEXTURE_2D_ARRAY, level, 0, 0, 0, std::max(width >> level, 1), std::max(height >> level, 1), array.used);
+
+            glDeleteTextures(1, &array.texture);
+            array.texture = grown;
+            array.capacity = capacity;
+        }
+
+        return std::pair{i, (uint32_t)array.used++};
+    }
+
+    if(arrays.size() == max_arrays)
+        return std::nullopt;
+
+    auto capacity = std::min(initial_layers, max_layers);
+    arrays.push_back(Array{
+        .texture = Texture::create(width, height, levels, format, capacity), .format = format, .width = width, .height = height, .levels = levels,
+        .capacity = capacity, .used = 1, .free_layers = {}
+    });
+    return std::pair{(uint32_t)arrays.size() - 1, 0u};
+}
+
+void TextureTable::refresh(uint32_t index){
+    auto& slot = slots[index];
+    auto sampled = streamer->get_sampled_levels(slot.texture);
+    slot.streaming = sampled.has_value();
+    if(!sampled)
+        sampled = TextureStreamer::SampledLevels{.first = 0, .last = slot.levels - 1, .generation = 0};
+
+    if(sampled == slot.sampled)
+        return;
+    slot.sampled = sampled;
+
+    // Anything new in the sampled levels is copied again, be it a level, the placeholder or rows of a level that isn't complete yet.
+    // Copying the whole range also keeps the coarse levels in step with the mipmaps generated at the end
+    if(slot.layer){
+        const auto& array = arrays[slot.layer->first];
+        for(int level = sampled->first; level <= sampled->last; level++)
+            glCopyImageSubData(slot.texture, GL_TEXTURE_2D, level, 0, 0, 0, array.texture, GL_TEXTURE_2D_ARRAY, level, 0, 0, slot.layer->second, std::max(array.width >> level, 1), std::max(array.height >> level, 1), 1);
+    }
+
+    // Bindless handles see new texels by themselves, only the range they're clamped to needs uploading
+    auto& entry = entries[index];
+    auto min_lod = (float)sampled->first, max_lod = slot.streaming ? (float)sampled->last : all_levels;
+    if(entry.min_lod != min_lod || entry.max_lod != max_lod){
+        entry.min_lod = min_lod;
+        entry.max_lod = max_lod;
+        dirty = true;
+    }
+}
+
+void TextureTable::update(){
+    for(uint32_t i = 0; i < slots.size(); i++)
+        if(slots[i].streaming)
+            this->refresh(i);
+
+    if(!dirty)
+        return;
+
+    auto size = entries.size() * sizeof(Entry);
+    if(size > buffer.get_size()){
+        buffer.clean();
+        buffer = Buffer<GL_SHADER_STORAGE_BUFFER>{2 * size, nullptr, GL_DYNAMIC_STORAGE_BIT};
+    }
+
+    buffer.write(entries.data(), 0, size);
+    dirty = false;
+}
+
+void TextureTable::bind() const {
+    buffer.bind_base(binding);
+
+    if(!bindless)
+        for(size_t i = 0; i < arrays.size(); i++)
+            glBindTextureUnit(i, arrays[i].texture);
+}
+
+TextureTable::Stats TextureTable::get_stats() const {
+    size_t layers = 0;
+    for(const auto& array : arrays)
+        layers += array.used - array.free_layers.size();
+
+    return {.textures = slots.size() - free_slots.size(), .layers = layers, .arrays = arrays.size(), .without_layer = without_layer, .bindless = bindless};
+}
+
+void TextureTable::draw_debug_window(const Stats& stats){
+    if(stats.bindless){
+        ImGui::Text("Texture table: %zu textures, bindless\n", stats.textures);
+        return;
+    }
+
+    ImGui::Text("Texture table: %zu textures, %zu layers in %zu / %zu arrays, %zu without a layer\n", stats.textures, stats.layers, stats.arrays, max_arrays, stats.without_layer);
+}
@@ -0,0 +1,97 @@
+#pragma once
+
+#include "../base.hpp"
+#include "../buffer.hpp"
+#include "texture_streamer.hpp"
+
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace benzene::opengl
+{
+    // Every texture a shader may sample, in one SSBO the fragment shader indexes instead of anything being bound per draw.
+    // With GL_ARB_bindless_texture a slot holds the texture's resident 64-bit handle. Without it, textures of the same format, size and
+    // level count are copied into layers of one GL_TEXTURE_2D_ARRAY, all of them bound once per frame, and a slot holds the array and layer.
+    // The textures keep their own storage in that case, it's what the streamer uploads into before its levels are copied over
+    class TextureTable {
+        public:
+        TextureTable(): streamer{nullptr}, bindless{false}, dirty{false}, max_layers{0}, without_layer{0} {}
+        TextureTable(TextureStreamer& streamer);
+        void clean();
+
+        // Gives `texture`, which needs immutable storage, a slot. Slots of textures that couldn't get an array layer sample `fallback` instead
+        uint32_t add(GLuint texture, uint32_t fallback);
+        void remove(uint32_t slot);
+
+        // Slot of a neutral 1x1 texture for the kind of texture `shader_name` is, for meshes without one
+        uint32_t default_for(const std::string& shader_name) const;
+
+        // Follows the levels streaming textures may sample and uploads the table if anything changed, once per frame after the streamer's update
+        void update();
+        void bind() const;
+
+        bool is_bindless() const {
+            return bindless;
+        }
+
+        struct Stats {
+            size_t textures, layers, arrays, without_layer;
+            bool bindless;
+        };
+        Stats get_stats() const;
+        // Shows `stats` instead of the table itself, the render thread may be changing it meanwhile
+        static void draw_debug_window(const Stats& stats);
+
+        // Texture units the arrays are bound to, the rest are left to the renderers
+        static constexpr size_t max_arrays = 14;
+        static constexpr GLuint binding = 8;
+        // Upper level of detail of slots whose textures have every level, the shader skips clamping for them
+        static constexpr float all_levels = 1000.0f;
+
+        private:
+        // Matches `TextureEntry` in the forward shader, std430
+        struct Entry {
+            uint64_t handle;
+            uint32_t array, layer;
+            float min_lod, max_lod;
+        };
+
+        struct Slot {
+            GLuint texture;
+            uint64_t handle;
+            std::optional<std::pair<uint32_t, uint32_t>> layer;
+            // Levels sampled right now and the upload generation they were copied at, nothing until the first update
+            std::optional<TextureStreamer::SampledLevels> sampled;
+            int levels;
+            bool streaming;
+        };
+
+        struct Array {
+            GLuint texture;
+            GLenum format;
+            int width, height, levels;
+            size_t capacity, used;
+            std::vector<uint32_t> free_layers;
+        };
+
+        // Points the slot's entry at the levels the streamer says may be sampled, copying them into the slot's layer first
+        void refresh(uint32_t slot);
+        std::optional<std::pair<uint32_t, uint32_t>> allocate_layer(GLenum format, int width, int height, int levels);
+
+        TextureStreamer* streamer;
+        bool bindless, dirty;
+        size_t max_layers, without_layer;
+
+        std::vector<Slot> slots;
+        std::vector<Entry> entries;
+        std::vector<uint32_t> free_slots;
+        std::vector<Array> arrays;
+        Buffer<GL_SHADER_STORAGE_BUFFER> buffer;
+
+        // White and a flat normal, see default_for()
+        GLuint neutral[2];
+        uint32_t neutral_slots[2];
+    };
+} // namespace benzene::opengl
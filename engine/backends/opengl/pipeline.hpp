@@ -6,8 +6,11 @@
 #include "../../core/format.hpp"
 #include <stdexcept>
 
+#include <algorithm>
 #include <string>
+#include <string_view>
 #include <cstring>
+#include <type_traits>
 #include <vector>
 
 #include <glm/gtc/type_ptr.hpp>
@@ -52,12 +55,52 @@ namespace benzene::opengl
         uint32_t handle;
     };
     
+    // FNV-1a, usable at compile time so names given as literals cost nothing to look up
+    constexpr uint64_t hash_name(std::string_view name){
+        uint64_t hash = 0xcbf29ce484222325;
+        for(char c : name){
+            hash ^= (uint8_t)c;
+            hash *= 0x100000001b3;
+        }
+        return hash;
+    }
+
+    // Name of a uniform hashed at compile time, made by "name"_uniform
+    struct UniformName {
+        uint64_t hash;
+    };
+
+    consteval UniformName operator""_uniform(const char* name, size_t size){
+        return UniformName{hash_name({name, size})};
+    }
+
+    // Location of a uniform of type T, resolved once by Program::get_uniform(). Setting one does no lookup at all,
+    // it stays -1 for uniforms the program doesn't use, which the GL ignores like it does for unknown names
+    template<typename T>
+    struct UniformHandle {
+        GLint location = -1;
+    };
+
     class Program {
         public:
         void add_shader(GLenum kind, const std::string& src){
             shaders.emplace_back(kind, src);
         }
 
+        // Same as above, with a `#define` for every entry of `defines` inserted right after the `#version` line
+        void add_shader(GLenum kind, const std::string& src, const std::vector<std::string>& defines){
+            auto version_end = src.find('\n');
+            if(src.compare(0, 8, "#version") != 0 || version_end == std::string::npos)
+                throw std::runtime_error("benzene/opengl: Shader defines need a shader starting with #version");
+
+            std::string defined = src.substr(0, version_end + 1);
+            for(const auto& define : defines)
+                defined += "#define " + define + "\n";
+            defined += src.substr(version_end + 1);
+
+            shaders.emplace_back(kind, defined);
+        }
+
         void compile(){
             handle = glCreateProgram();
 
@@ -100,61 +143,78 @@ namespace benzene::opengl
                 glDetachShader(handle, shader());
                 shader.clean(); // Not needed after this
             }
+
+            uniforms = this->introspect(GL_UNIFORM);
+            inputs = this->introspect(GL_PROGRAM_INPUT);
+        }
+
+        // Fails if the uniform exists with a type other than T, ints also set bools, samplers and images
+        template<typename T>
+        UniformHandle<T> get_uniform(std::string_view name) const {
+            const auto* uniform = find(uniforms, hash_name(name));
+            if(!uniform)
+                return {};
+
+            bool matches = (uniform->type == uniform_type_v<T>);
+            if constexpr (std::is_same_v<T, int>)
+                matches = std::none_of(std::begin(float_types), std::end(float_types), [&](GLenum type){ return type == uniform->type; });
+
+            if(!matches){
+                print("benzene/opengl: Uniform {:s} has type {:#x}, not {:#x}\n", std::string{name}, uniform->type, uniform_type_v<T>);
+                throw std::runtime_error("benzene/opengl: Uniform handle of the wrong type");
+            }
+
+            return UniformHandle<T>{uniform->location};
+        }
+
+        template<typename T>
+        void set_uniform(UniformHandle<T> uniform, const T& value){
+            this->upload(uniform.location, value);
+        }
+
+        // Sets `n` elements of an array uniform, starting at the one `uniform` was resolved for
+        void set_uniform(UniformHandle<glm::vec4> uniform, const glm::vec4* values, size_t n){
+            glProgramUniform4fv(handle, uniform.location, n, glm::value_ptr(values[0]));
+        }
+
+        // Looked up in the resolved uniforms, without building or hashing a string
+        template<typename T>
+        void set_uniform(UniformName name, const T& value){
+            const auto* uniform = find(uniforms, name.hash);
+            this->upload(uniform ? uniform->location : -1, value);
         }
 
         void set_uniform(const std::string& name, glm::mat4 matrix){
-            auto loc = this->get_uniform_location(name);
-            glProgramUniformMatrix4fv(handle, loc, 1, GL_FALSE, glm::value_ptr(matrix));
+            this->upload(this->get_uniform_location(name), matrix);
         }
 
         void set_uniform(const std::string& name, glm::mat3 matrix){
-            /*
-            For some reason when using `GLM_FORCE_DEFAULT_ALIGNED_GENTYPES` `glm::value_ptr` doesn't work on `glm::mat3`s and outputs corrupted data
-            so we create our own temporary array
-            see: https://stackoverflow.com/questions/61447393/glmvalue-ptr-broken-for-glmmat3 for future reference
-            */
-            float tmp[3][3] = {};
-            for(int i = 0; i < 3; i++)
-                for(int j = 0; j < 3; j++)
-                    tmp[i][j] = matrix[i][j];
-            
-            auto loc = this->get_uniform_location(name);
-            glProgramUniformMatrix3fv(handle, loc, 1, GL_FALSE, (const GLfloat*)tmp);
+            this->upload(this->get_uniform_location(name), matrix);
         }
 
         void set_uniform(const std::string& name, int i){
-            auto loc = this->get_uniform_location(name);
-            glProgramUniform1i(handle, loc, i);
+            this->upload(this->get_uniform_location(name), i);
         }
 
         void set_uniform(const std::string& name, float f){
-            auto loc = this->get_uniform_location(name);
-            glProgramUniform1f(handle, loc, f);
+            this->upload(this->get_uniform_location(name), f);
         }
 
         void set_uniform(const std::string& name, glm::vec2 vec){
-            auto loc = this->get_uniform_location(name);
-            glProgramUniform2f(handle, loc, vec.x, vec.y);
+            this->upload(this->get_uniform_location(name), vec);
         }
 
         void set_uniform(const std::string& name, glm::vec3 vec){
-            auto loc = this->get_uniform_location(name);
-            glProgramUniform3f(handle, loc, vec.x, vec.y, vec.z);
+            this->upload(this->get_uniform_location(name), vec);
         }
 
         void set_uniform(const std::string& name, glm::vec4 vec){
-            auto loc = this->get_uniform_location(name);
-            glProgramUniform4f(handle, loc, vec.x, vec.y, vec.z, vec.w);
+            this->upload(this->get_uniform_location(name), vec);
         }
 
-        GLint get_vertex_attrib_location(const std::string& name){
-            auto location = vertex_attribute_location_cache.find(name);
-            if(location != vertex_attribute_location_cache.end())
-                return location->second;
-
-            auto loc = glGetAttribLocation(handle, name.c_str());
-            vertex_attribute_location_cache[name] = loc;
-            return loc;
+        GLint get_vertex_attrib_location(const std::string& name) const {
+            const auto* input = find(inputs, hash_name(name));
+            return input ? input->location : -1;
         }
 
         void clean(){
@@ -170,18 +230,112 @@ namespace benzene::opengl
         }
 
         private:
-        GLint get_uniform_location(const std::string& name){
-            auto location = uniform_location_cache.find(name);
-            if(location != uniform_location_cache.end())
-                return location->second;
+        // An active uniform or vertex input, found by the hash of its name
+        struct Resource {
+            uint64_t hash;
+            GLint location;
+            GLenum type;
+        };
+
+        template<typename T>
+        static constexpr GLenum uniform_type_v = std::is_same_v<T, int> ? GL_INT : std::is_same_v<T, float> ? GL_FLOAT :
+            std::is_same_v<T, glm::vec2> ? GL_FLOAT_VEC2 : std::is_same_v<T, glm::vec3> ? GL_FLOAT_VEC3 : std::is_same_v<T, glm::vec4> ? GL_FLOAT_VEC4 :
+            std::is_same_v<T, glm::mat3> ? GL_FLOAT_MAT3 : std::is_same_v<T, glm::mat4> ? GL_FLOAT_MAT4 : GL_NONE;
+        static constexpr GLenum float_types[] = {GL_FLOAT, GL_FLOAT_VEC2, GL_FLOAT_VEC3, GL_FLOAT_VEC4, GL_FLOAT_MAT2, GL_FLOAT_MAT3, GL_FLOAT_MAT4};
+
+        // Every active resource of `interface` with a location, sorted by hash. Arrays are listed as their first element,
+        // they can also be found by their bare name or any other element
+        std::vector<Resource> introspect(GLenum interface) const {
+            GLint count = 0, max_length = 0;
+            glGetProgramInterfaceiv(handle, interface, GL_ACTIVE_RESOURCES, &count);
+            glGetProgramInterfaceiv(handle, interface, GL_MAX_NAME_LENGTH, &max_length);
+
+            std::vector<Resource> resources{};
+            std::string name(std::max(max_length, 1), '\0');
+            for(GLint i = 0; i < count; i++){
+                const GLenum properties[] = {GL_LOCATION, GL_TYPE, GL_ARRAY_SIZE};
+                GLint values[3] = {};
+                glGetProgramResourceiv(handle, interface, i, 3, properties, 3, nullptr, values);
+
+                // Members of uniform blocks and built-in inputs don't have one
+                if(values[0] < 0)
+                    continue;
+
+                GLsizei length = 0;
+                glGetProgramResourceName(handle, interface, i, name.size(), &length, name.data());
+                std::string_view resource{name.data(), (size_t)length};
+                resources.push_back(Resource{.hash = hash_name(resource), .location = values[0], .type = (GLenum)values[1]});
+
+                if(!resource.ends_with("[0]"))
+                    continue;
+
+                auto base = std::string{resource.substr(0, resource.size() - 3)};
+                resources.push_back(Resource{.hash = hash_name(base), .location = values[0], .type = (GLenum)values[1]});
+                for(GLint j = 1; j < values[2]; j++){
+                    auto element = base + "[" + std::to_string(j) + "]";
+                    resources.push_back(Resource{.hash = hash_name(element), .location = glGetProgramResourceLocation(handle, interface, element.c_str()), .type = (GLenum)values[1]});
+                }
+            }
+
+            std::sort(resources.begin(), resources.end(), [](const auto& a, const auto& b){ return a.hash < b.hash; });
+            auto collision = std::adjacent_find(resources.begin(), resources.end(), [](const auto& a, const auto& b){ return a.hash == b.hash; });
+            if(collision != resources.end())
+                throw std::runtime_error("benzene/opengl: Two names in a shader program hash to the same value");
+
+            return resources;
+        }
+
+        static const Resource* find(const std::vector<Resource>& resources, uint64_t hash){
+            auto it = std::lower_bound(resources.begin(), resources.end(), hash, [](const auto& resource, uint64_t hash){ return resource.hash < hash; });
+            return (it != resources.end() && it->hash == hash) ? &*it : nullptr;
+        }
+
+        GLint get_uniform_location(const std::string& name) const {
+            const auto* uniform = find(uniforms, hash_name(name));
+            return uniform ? uniform->location : -1;
+        }
+
+        void upload(GLint loc, glm::mat4 matrix){
+            glProgramUniformMatrix4fv(handle, loc, 1, GL_FALSE, glm::value_ptr(matrix));
+        }
+
+        void upload(GLint loc, glm::mat3 matrix){
+            /*
+            For some reason when using `GLM_FORCE_DEFAULT_ALIGNED_GENTYPES` `glm::value_ptr` doesn't work on `glm::mat3`s and outputs corrupted data
+            so we create our own temporary array
+            see: https://stackoverflow.com/questions/61447393/glmvalue-ptr-broken-for-glmmat3 for future reference
+            */
+            float tmp[3][3] = {};
+            for(int i = 0; i < 3; i++)
+                for(int j = 0; j < 3; j++)
+                    tmp[i][j] = matrix[i][j];
+            
+            glProgramUniformMatrix3fv(handle, loc, 1, GL_FALSE, (const GLfloat*)tmp);
+        }
+
+        void upload(GLint loc, int i){
+            glProgramUniform1i(handle, loc, i);
+        }
+
+        void upload(GLint loc, float f){
+            glProgramUniform1f(handle, loc, f);
+        }
+
+        void upload(GLint loc, glm::vec2 vec){
+            glProgramUniform2f(handle, loc, vec.x, vec.y);
+        }
 
-            auto loc = glGetUniformLocation(handle, name.c_str());
-            uniform_location_cache[name] = loc;
-            return loc;
+        void upload(GLint loc, glm::vec3 vec){
+            glProgramUniform3f(handle, loc, vec.x, vec.y, vec.z);
         }
-        
+
+        void upload(GLint loc, glm::vec4 vec){
+            glProgramUniform4f(handle, loc, vec.x, vec.y, vec.z, vec.w);
+        }
+
         uint32_t handle;
         std::vector<Shader> shaders;
-        std::unordered_map<std::string, GLint> uniform_location_cache, vertex_attribute_location_cache;
+        // Resolved once the program is linked
+        std::vector<Resource> uniforms, inputs;
     };
 } // namespace benzene::opengl
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <map>
+#include <algorithm>
+#include <iterator>
+#include <optional>
+#include <cstddef>
+#include <cassert>
+
+namespace benzene::opengl
+{
+    // First-fit free-list allocator over an abstract range [0, capacity), it only does the bookkeeping, the caller owns the actual memory
+    class RangeAllocator {
+        public:
+        RangeAllocator(): capacity{0}, free_size{0}, free_ranges{} {}
+        RangeAllocator(size_t capacity): capacity{capacity}, free_size{capacity}, free_ranges{} {
+            if(capacity > 0)
+                free_ranges[0] = capacity;
+        }
+
+        std::optional<size_t> allocate(size_t size){
+            if(size == 0)
+                return 0;
+
+            for(auto it = free_ranges.begin(); it != free_ranges.end(); it++){
+                auto [offset, range_size] = *it;
+                if(range_size < size)
+                    continue;
+
+                free_ranges.erase(it);
+                if(range_size > size)
+                    free_ranges[offset + size] = range_size - size;
+
+                free_size -= size;
+                return offset;
+            }
+
+            return std::nullopt;
+        }
+
+        void free(size_t offset, size_t size){
+            if(size == 0)
+                return;
+
+            assert((offset + size) <= capacity);
+            free_size += size;
+
+            auto next = free_ranges.lower_bound(offset);
+            // Merge with the following range if they touch
+            if(next != free_ranges.end() && (offset + size) == next->first){
+                size += next->second;
+                next = free_ranges.erase(next);
+            }
+
+            // And with the preceding one
+            if(next != free_ranges.begin()){
+                auto prev = std::prev(next);
+                if((prev->first + prev->second) == offset){
+                    prev->second += size;
+                    return;
+                }
+            }
+
+            free_ranges[offset] = size;
+        }
+
+        void grow(size_t new_capacity){
+            assert(new_capacity >= capacity);
+            auto old_capacity = capacity;
+            capacity = new_capacity;
+
+            this->free(old_capacity, new_capacity - old_capacity);
+        }
+
+        // Marks [0, used) as allocated and the rest as free, used after compacting the backing memory
+        void reset(size_t used){
+            assert(used <= capacity);
+            free_ranges.clear();
+            free_size = capacity - used;
+            if(free_size > 0)
+                free_ranges[used] = free_size;
+        }
+
+        size_t get_capacity() const { return capacity; }
+        size_t get_free() const { return free_size; }
+        size_t get_used() const { return capacity - free_size; }
+        size_t get_free_block_count() const { return free_ranges.size(); }
+
+        size_t get_largest_free_block() const {
+            size_t largest = 0;
+            for(const auto& [offset, size] : free_ranges)
+                largest = std::max(largest, size);
+
+            return largest;
+        }
+
+        private:
+        size_t capacity, free_size;
+        std::map<size_t, size_t> free_ranges; // offset -> size
+    };
+} // namespace benzene::opengl
@@ -1,23 +1,46 @@
 #include "forward.hpp"
 
+#include <chrono>
+
 using namespace benzene::opengl;
 
-ForwardRenderer::ForwardRenderer(int width, int height): main_program{} {
-    main_program.add_shader(GL_VERTEX_SHADER, R"(#version 420 core
-		#extension GL_ARB_shader_storage_buffer_object : require
+ForwardRenderer::ForwardRenderer(int width, int height): main_program{}, vertex_format{VertexFormat::Full}, framebuffer_height{(size_t)height}, frustum_culling{true}, visible_instances{0}, total_instances{0}, visible_triangles{0}, visible_counts_known{true}, lod_selection{}, lod_selection_enabled{true}, lod_pixel_threshold{1.0f}, cluster_culling{.camera_pos = {}, .backface = true}, meshlet_culling{false}, cluster_stats{}, cluster_benchmark_remaining{0}, cluster_benchmark_stats{}, cluster_benchmark_time{0.0}, submission_time{0.0f}, debug_state{} {
+	instance_ring = RingBuffer<GL_SHADER_STORAGE_BUFFER>{initial_instance_ring_size};
+	texture_streamer = TextureStreamer{texture_staging_size, default_texture_upload_budget};
+	texture_table = TextureTable{texture_streamer};
+	frame_uniforms = FrameUniforms{{
+		{.position = {-300.0f, 200.0f, 0.0f}, .ambient = {0.2f, 0.2f, 0.2f}, .diffuse = {0.5f, 0.5f, 0.5f}, .specular = {1.0f, 1.0f, 1.0f}}
+	}};
+	projection = glm::perspective(glm::radians(45.0f), (float)width / height, near_plane, far_plane);
 
-		uniform mat4 viewMatrix;
-		uniform mat4 projectionMatrix;
+	this->create_pipeline();
+}
 
-		struct Light {
-			vec3 position;
-			vec3 ambient;
-			vec3 diffuse;
-			vec3 specular;
-		};
+void ForwardRenderer::create_pipeline(){
+	auto defines = FrameUniforms::defines();
+	if(vertex_format == VertexFormat::Packed)
+		defines.push_back("PACKED_VERTICES");
+	if(GLAD_GL_ARB_shader_draw_parameters)
+		defines.push_back("DRAW_PARAMETERS");
+	if(texture_table.is_bindless())
+		defines.push_back("BINDLESS_TEXTURES");
+	if(GLAD_GL_NV_gpu_shader5)
+		defines.push_back("NONUNIFORM_TEXTURES");
+	defines.push_back("MAX_TEXTURE_ARRAYS " + std::to_string(TextureTable::max_arrays));
+	defines.push_back("ALL_LEVELS " + std::to_string(TextureTable::all_levels));
+
+	main_program = Program{};
+    main_program.add_shader(GL_VERTEX_SHADER, R"(#version 420 core
+		#extension GL_ARB_shader_storage_buffer_object : require
+		#ifdef DRAW_PARAMETERS
+		#extension GL_ARB_shader_draw_parameters : require
+		#define DRAW_ID gl_DrawIDARB
+		#else
+		// Without it every multi-draw only holds commands of one material, see DrawMesh::shares_state_with
+		#define DRAW_ID 0
+		#endif
 
-		uniform Light light;
-		uniform vec3 cameraPos;
+		FRAME_UNIFORMS
 
 		struct InstanceData {
 			mat4 modelMatrix;
@@ -27,25 +50,54 @@ ForwardRenderer::ForwardRenderer(int width, int height): main_program{} {
 		layout (std140, binding = 0) buffer PerInstanceData {
 			InstanceData data[];
 		} instanceData;
+
+		// Material of every command of the batch, firstDraw is where the commands of the current draw start
+		layout (std430, binding = 6) readonly buffer CommandMaterials {
+			uint commandMaterials[];
+		};
+		uniform int firstDraw;
 		
 		layout (location = 0) in vec3 inPosition;
+		layout (location = 3) in vec2 inUv;
+
+		#ifdef PACKED_VERTICES
+		// Octahedral normals and tangents, see vertex_packing::octahedral_encode
+		layout (location = 1) in vec2 inNormal;
+		layout (location = 2) in vec2 inTangent;
+
+		vec3 octahedralDecode(vec2 e) {
+			vec3 n = vec3(e.xy, 1.0 - abs(e.x) - abs(e.y));
+			float t = max(-n.z, 0.0);
+			n.xy += mix(vec2(t), vec2(-t), greaterThanEqual(n.xy, vec2(0.0)));
+			return normalize(n);
+		}
+
+		vec3 vertexNormal() { return octahedralDecode(inNormal); }
+		vec3 vertexTangent() { return octahedralDecode(inTangent); }
+		#else
 		layout (location = 1) in vec3 inNormal;
 		layout (location = 2) in vec3 inTangent;
-		layout (location = 3) in vec2 inUv;
+
+		vec3 vertexNormal() { return inNormal; }
+		vec3 vertexTangent() { return inTangent; }
+		#endif
+		layout (location = 4) in uint inInstanceIndex; // Index into instanceData of the visible instance being drawn
 		
 		out VS_OUT {
 			vec3 fragPos;
-			vec3 tangentLightPos;
+			mat3 TBN;
 			vec3 tangentCameraPos;
 			vec3 tangentFragPos;
 			vec2 uv;
+			flat uint material;
 		} vs_out;
 
 		void main() {
-		   	gl_Position = projectionMatrix * viewMatrix * instanceData.data[gl_InstanceID].modelMatrix * vec4(inPosition.xyz, 1.0);
+			InstanceData instance = instanceData.data[inInstanceIndex];
+		   	gl_Position = viewProjectionMatrix * instance.modelMatrix * vec4(inPosition.xyz, 1.0);
 		
-			vec3 T = normalize(mat3(instanceData.data[gl_InstanceID].normalMatrix) * inTangent);
-		   	vec3 N = normalize(mat3(instanceData.data[gl_InstanceID].normalMatrix) * inNormal);
+			vec3 T = normalize(mat3(instance.normalMatrix) * vertexTangent());
+		   	vec3 N = normalize(mat3(instance.normalMatrix) * vertexNormal());
 			
 			T = normalize(T - dot(T, N) * N);
 
@@ -55,37 +107,83 @@ ForwardRenderer::ForwardRenderer(int width, int height): main_program{} {
 
 
 			vs_out.uv = inUv;
-			vs_out.fragPos = vec3(instanceData.data[gl_InstanceID].modelMatrix * vec4(inPosition, 1.0));
-			vs_out.tangentLightPos = TBN * light.position;
+			vs_out.material = commandMaterials[firstDraw + DRAW_ID];
+			vs_out.fragPos = vec3(instance.modelMatrix * vec4(inPosition, 1.0));
+			vs_out.TBN = TBN;
 			vs_out.tangentCameraPos = TBN * cameraPos;
 			vs_out.tangentFragPos = TBN * vs_out.fragPos;
-		})");
+		})", defines);
 
 	main_program.add_shader(GL_FRAGMENT_SHADER, R"(#version 420 core
+		#extension GL_ARB_shader_storage_buffer_object : require
+		#ifdef BINDLESS_TEXTURES
+		#extension GL_ARB_bindless_texture : require
+		#endif
+
+		// Textures are picked by the material of the draw command, through a flat varying. Without an extension allowing any index
+		// that's only valid since every command has exactly one material, so the index is the same for every fragment of a command
+		#ifdef NONUNIFORM_TEXTURES
+		#extension GL_NV_gpu_shader5 : require
+		#endif
+
+		// See MaterialTable::Entry, the maps are indices into textures and multiply the colours
 		struct Material {
-			sampler2D diffuse;
-			sampler2D specular;
-			sampler2D normal;
+			vec3 diffuse;
 			float shininess;
+			vec3 specular;
+			uint normalMap;
+			uint diffuseMap;
+			uint specularMap;
 		};
 
-		struct Light {
-			vec3 position;
-			vec3 ambient;
-			vec3 diffuse;
-			vec3 specular;
+		layout (std430, binding = 7) readonly buffer Materials {
+			Material materials[];
 		};
 
-		uniform Light light;
-		uniform Material material;
-		
+		// See TextureTable::Entry
+		struct TextureEntry {
+			uvec2 handle;
+			uint array;
+			uint layer;
+			float minLod;
+			float maxLod;
+		};
+
+		layout (std430, binding = 8) readonly buffer Textures {
+			TextureEntry textures[];
+		};
+
+		#ifndef BINDLESS_TEXTURES
+		layout (binding = 0) uniform sampler2DArray textureArrays[MAX_TEXTURE_ARRAYS];
+		#endif
+
+		// Textures that are still streaming in only have some of their levels, the level of detail is kept within those
+		vec4 sampleTexture(uint index, vec2 uv) {
+			TextureEntry entry = textures[index];
+			#ifdef BINDLESS_TEXTURES
+			sampler2D image = sampler2D(entry.handle);
+			float lod = textureQueryLod(image, uv).y;
+			if (entry.maxLod >= ALL_LEVELS)
+				return texture(image, uv);
+			return textureLod(image, uv, clamp(lod, entry.minLod, entry.maxLod));
+			#else
+			vec3 coords = vec3(uv, float(entry.layer));
+			float lod = textureQueryLod(textureArrays[entry.array], uv).y;
+			if (entry.maxLod >= ALL_LEVELS)
+				return texture(textureArrays[entry.array], coords);
+			return textureLod(textureArrays[entry.array], coords, clamp(lod, entry.minLod, entry.maxLod));
+			#endif
+		}
+
+		FRAME_UNIFORMS
 		
 		in VS_OUT {
 			vec3 fragPos;
-			vec3 tangentLightPos;
+			mat3 TBN;
 			vec3 tangentCameraPos;
 			vec3 tangentFragPos;
 			vec2 uv;
+			flat uint material;
 		} fs_in;
 		
 		const bool blinn = true;
@@ -93,66 +191,285 @@ ForwardRenderer::ForwardRenderer(int width, int height): main_program{} {
 		
 		out vec4 fragColour;
 		void main() {
-		   	vec3 normal = normalize(texture(material.normal, fs_in.uv).rgb * 2.0 - 1.0);
-		   	vec3 lightDir = normalize(light.position - fs_in.tangentFragPos);
+		   	Material material = materials[fs_in.material];
+		   	vec3 albedo = material.diffuse * sampleTexture(material.diffuseMap, fs_in.uv).rgb;
+
+		   	// BC5 normal maps only keep x and y, z is rebuilt from them for every normal map so both kinds work
+		   	vec2 normalXY = sampleTexture(material.normalMap, fs_in.uv).rg * 2.0 - 1.0;
+		   	vec3 normal = normalize(vec3(normalXY, sqrt(max(1.0 - dot(normalXY, normalXY), 0.0))));
 		   	vec3 cameraDir = normalize(fs_in.tangentCameraPos - fs_in.tangentFragPos);
-		   
-		   	vec3 ambient = light.ambient * texture(material.diffuse, fs_in.uv).rgb;
-		   
-		   	float diffuseIntensity = max(dot(normal, lightDir), 0.0);
-		   	vec3 diffuse = light.diffuse * diffuseIntensity * texture(material.diffuse, fs_in.uv).rgb;
-
-			float specularIntensity;
-			if (blinn){
-				vec3 halfwayDir = normalize(lightDir + cameraDir);
-				specularIntensity = pow(max(dot(normal, halfwayDir), 0.0), material.shininess);
-			} else {
-				vec3 reflectDir = reflect(-lightDir, normal);
-				specularIntensity = pow(max(dot(cameraDir, reflectDir), 0.0), material.shininess);
+		   	vec3 specularColour = material.specular * sampleTexture(material.specularMap, fs_in.uv).rgb;
+
+			vec3 result = vec3(0.0);
+			for(uint i = 0u; i < lightCount; i++){
+				Light light = lights[i];
+				vec3 lightDir = normalize(fs_in.TBN * light.position - fs_in.tangentFragPos);
+
+				vec3 ambient = light.ambient * albedo;
+
+				float diffuseIntensity = max(dot(normal, lightDir), 0.0);
+				vec3 diffuse = light.diffuse * diffuseIntensity * albedo;
+
+				float specularIntensity;
+				if (blinn){
+					vec3 halfwayDir = normalize(lightDir + cameraDir);
+					specularIntensity = pow(max(dot(normal, halfwayDir), 0.0), material.shininess);
+				} else {
+					vec3 reflectDir = reflect(-lightDir, normal);
+					specularIntensity = pow(max(dot(cameraDir, reflectDir), 0.0), material.shininess);
+				}
+				vec3 specular = light.specular * specularIntensity * specularColour;
+
+				result += ambient + diffuse + specular;
 			}
-			vec3 specular = light.specular * specularIntensity * texture(material.specular, fs_in.uv).rgb;
-		   
-		   	vec3 result = ambient + diffuse + specular;
 		   	fragColour = vec4(result, 1.0);
-		})");
+		})", defines);
 
 	main_program.compile();
 
-	main_program.set_uniform("light.position", glm::vec3{-300.0f, 200.0f, 0.0f});
-	main_program.set_uniform("light.ambient", glm::vec3{0.2f, 0.2f, 0.2f});
-	main_program.set_uniform("light.diffuse", glm::vec3{0.5f, 0.5f, 0.5f});
-	main_program.set_uniform("light.specular", glm::vec3{1.0f, 1.0f, 1.0f});
+	std::vector<VertexAttribute> attributes{};
+	if(vertex_format == VertexFormat::Packed){
+		using vertex_packing::PackedVertex;
+		attributes = {
+			{.location = main_program.get_vertex_attrib_location("inPosition"), .type = GL_HALF_FLOAT, .offset = offsetof(PackedVertex, pos), .n = 3},
+			{.location = main_program.get_vertex_attrib_location("inNormal"), .type = gl::type_to_enum_v<short>, .offset = offsetof(PackedVertex, normal), .n = 2, .normalized = true},
+			{.location = main_program.get_vertex_attrib_location("inTangent"), .type = gl::type_to_enum_v<short>, .offset = offsetof(PackedVertex, tangent), .n = 2, .normalized = true},
+			{.location = main_program.get_vertex_attrib_location("inUv"), .type = GL_HALF_FLOAT, .offset = offsetof(PackedVertex, uv), .n = 2}
+		};
+	} else {
+		attributes = {
+			{.location = main_program.get_vertex_attrib_location("inPosition"), .type = gl::type_to_enum_v<float>, .offset = offsetof(benzene::Mesh::Vertex, pos), .n = 3},
+			{.location = main_program.get_vertex_attrib_location("inNormal"), .type = gl::type_to_enum_v<float>, .offset = offsetof(benzene::Mesh::Vertex, normal), .n = 3},
+			{.location = main_program.get_vertex_attrib_location("inTangent"), .type = gl::type_to_enum_v<float>, .offset = offsetof(benzene::Mesh::Vertex, tangent), .n = 3},
+			{.location = main_program.get_vertex_attrib_location("inUv"), .type = gl::type_to_enum_v<float>, .offset = offsetof(benzene::Mesh::Vertex, uv), .n = 2}
+		};
+	}
+	attributes.push_back({.location = main_program.get_vertex_attrib_location("inInstanceIndex"), .type = gl::type_to_enum_v<uint32_t>, .offset = 0, .n = 1, .integer = true, .binding = GeometryPool::instance_binding});
+
+	geometry_pool = GeometryPool{vertex_format, attributes};
 
-	main_program.set_uniform("projectionMatrix", glm::perspective(glm::radians(45.0f), (float)width / height, 0.1f, 10000.0f));
 }
 
-ForwardRenderer::~ForwardRenderer(){
+void ForwardRenderer::destroy_pipeline(){
     for(auto& [id, model] : internal_batches)
 		model.clean();
+	internal_batches.clear();
 
+	geometry_pool.clean();
+	material_table.clean();
 	main_program.clean();
 }
 
+void ForwardRenderer::set_vertex_format(VertexFormat format){
+	if(format == vertex_format)
+		return;
+
+	// Every batch gets rebuilt from its API batch during the next draw
+	this->destroy_pipeline();
+	vertex_format = format;
+	this->create_pipeline();
+}
+
+ForwardRenderer::~ForwardRenderer(){
+	this->destroy_pipeline();
+	texture_table.clean();
+	texture_streamer.clean();
+	instance_ring.clean();
+	frame_uniforms.clean();
+}
+
 void ForwardRenderer::framebuffer_resize_callback(size_t width, size_t height){
-	main_program.set_uniform("projectionMatrix", glm::perspective(glm::radians(45.0f), (float)width / height, 0.1f, 10000.0f));
+	framebuffer_height = height;
+	projection = glm::perspective(glm::radians(45.0f), (float)width / height, near_plane, far_plane);
 }
 
-void ForwardRenderer::draw(std::unordered_map<benzene::ModelId, benzene::Batch*>& batches, benzene::FrameData& frame_data){
-	camera.process_input(frame_data.delta_time);
+void ForwardRenderer::draw(std::unordered_map<benzene::ModelId, benzene::Batch*>& batches, const Camera& camera, [[maybe_unused]] benzene::FrameData& frame_data){
     // First things first, create state of batches that the backend understands
     for(auto& [id, batch] : batches){
 		if(internal_batches.count(id) == 0 || batch->is_updated()){
-		    internal_batches[id].clean();
-			internal_batches[id] = Batch{*batch, main_program};
+			// Built before the old one is cleaned, so textures both use keep their references and don't stream in again
+			Batch rebuilt{*batch, main_program, geometry_pool, texture_streamer, texture_table, material_table, instance_ring};
+			internal_batches[id].clean();
+			internal_batches[id] = std::move(rebuilt);
 		}
+
+		// With the render thread the API batch is a snapshot that alternates between frames
+		internal_batches[id].set_source(*batch);
     }
 
+	// New textures trickle in over the next frames instead of stalling this one
+	texture_streamer.update();
+	texture_table.update();
+
+	// Reuploaded batches leave holes behind in the pool, once they make up most of the free space pack everything together again
+	if(geometry_pool.fragmentation() > max_geometry_fragmentation)
+		geometry_pool.compact();
+
     glClearColor(this->clear_colour.r, this->clear_colour.g, this->clear_colour.b, this->clear_colour.a);
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-	main_program.set_uniform("viewMatrix", camera.get_view_matrix());
-	main_program.set_uniform("cameraPos", camera.get_position());
+	// The only per-frame uniforms, shared by every program through one block
+	frame_uniforms.begin_frame(camera, projection);
+
+	frustum = transform_kernel::extract_frustum(projection * camera.get_view_matrix());
+	// An object space length at distance d covers length * projection[1][1] * (height / 2) / d pixels
+	lod_selection = {.camera_pos = camera.get_position(), .pixels_per_unit = projection[1][1] * framebuffer_height * 0.5f / lod_pixel_threshold};
+	cluster_culling.camera_pos = camera.get_position();
+	this->prepare_submission(camera);
+
+	auto submission_begin = std::chrono::high_resolution_clock::now();
+	// Everything any draw samples is in these, nothing texture or material related is bound per draw
+	texture_table.bind();
+	material_table.bind();
+	instance_ring.begin_frame();
+	render_queue.begin_frame(camera.get_position());
+	for(const auto& [id, object] : internal_batches)
+		this->submit(object);
+	this->finish_submission();
+	// Batches only queue their draws, they're issued here ordered by the state they need
+	render_queue.flush();
+	instance_ring.end_frame();
+	frame_uniforms.end_frame();
+	auto submission_end = std::chrono::high_resolution_clock::now();
+	submission_time = (float)std::chrono::duration<double, std::milli>(submission_end - submission_begin).count();
+
+	this->count_visible_instances();
+
+	if(cluster_benchmark_remaining > 0){
+		cluster_benchmark_stats += cluster_stats;
+		cluster_benchmark_time += submission_time;
+
+		if(--cluster_benchmark_remaining == 0){
+			auto percentage = [this](size_t n){ return (cluster_benchmark_stats.triangles > 0) ? 100.0 * n / cluster_benchmark_stats.triangles : 0.0; };
+			print("opengl/ForwardRenderer: Meshlet culling over {:d} frames, {:d} triangles tested per frame, {:.1f}% frustum culled, {:.1f}% backface culled, {:.3f} ms CPU submission per frame\n",
+				cluster_benchmark_frames, cluster_benchmark_stats.triangles / cluster_benchmark_frames,
+				percentage(cluster_benchmark_stats.frustum_culled), percentage(cluster_benchmark_stats.backface_culled), cluster_benchmark_time / cluster_benchmark_frames);
+		}
+	}
+};
+
+void ForwardRenderer::count_visible_instances(){
+	visible_counts_known = true;
+	visible_instances = 0;
+	total_instances = 0;
+	visible_triangles = 0;
+	cluster_stats = {};
+	for(const auto& [id, object] : internal_batches){
+		visible_instances += object.get_visible_count();
+		total_instances += object.get_total_count();
+		visible_triangles += object.get_visible_triangle_count();
+		cluster_stats += object.get_cluster_stats();
+	}
+}
+
+void ForwardRenderer::submit(const opengl::Batch& batch){
+	batch.draw(render_queue, this->get_cull_frustum(), this->get_lod_selection(), this->get_cluster_culling());
+}
+
+void ForwardRenderer::benchmark_uniforms(){
+	auto time = [](auto&& f) -> double {
+		auto begin = std::chrono::high_resolution_clock::now();
+		for(size_t i = 0; i < uniform_benchmark_calls; i++)
+			f((int)i);
+		auto end = std::chrono::high_resolution_clock::now();
+
+		return std::chrono::duration<double, std::nano>(end - begin).count() / uniform_benchmark_calls;
+	};
+
+	// Every call ends in the same glProgramUniform1i, the differences are what it takes to find the location
+	auto handle = main_program.get_uniform<int>("firstDraw");
+	uniform_benchmark = {
+		{"String", time([this](int i){ main_program.set_uniform("firstDraw", i); })},
+		{"Hashed name", time([this](int i){ main_program.set_uniform("firstDraw"_uniform, i); })},
+		{"Handle", time([this, handle](int i){ main_program.set_uniform(handle, i); })}
+	};
+}
+
+void ForwardRenderer::publish_debug_state(){
+	debug_state = {
+		.submission_time = submission_time,
+		.frustum_culling = frustum_culling,
+		.visible_instances = visible_instances, .total_instances = total_instances, .visible_triangles = visible_triangles,
+		.visible_counts_known = visible_counts_known,
+		.lod_selection_enabled = lod_selection_enabled,
+		.lod_pixel_threshold = lod_pixel_threshold,
+		.meshlet_culling = meshlet_culling, .backface_culling = cluster_culling.backface, .cluster_benchmark_running = (cluster_benchmark_remaining > 0),
+		.cluster_stats = cluster_stats,
+		.instance_ring_size = instance_ring.get_region_size(), .instance_ring_stalls = instance_ring.get_stall_count(),
+		.vertex_format = vertex_format,
+		.geometry_pool = geometry_pool.get_stats(),
+		.texture_streamer = texture_streamer.get_stats(),
+		.texture_table = texture_table.get_stats(),
+		.materials = material_table.get_size(), .material_references = material_table.get_reference_count(),
+		.render_queue = render_queue.get_stats(),
+		.uniform_benchmark = uniform_benchmark
+	};
+}
+
+void ForwardRenderer::draw_debug_window(){
+	// Only the copy is read, and whatever the widgets change is applied before the next frame instead of while this one may be drawn
+	auto& state = debug_state;
+	auto apply = [this](auto& setting, auto value){ this->defer([&setting, value]{ setting = value; }); };
+
+	ImGui::Text("CPU submission time: %f ms\n", state.submission_time);
+
+	if(ImGui::Checkbox("Frustum culling", &state.frustum_culling))
+		apply(frustum_culling, state.frustum_culling);
+	if(state.visible_counts_known)
+		ImGui::Text("Visible mesh instances: %zu / %zu\n", state.visible_instances, state.total_instances);
+	else
+		ImGui::Text("Visible mesh instances: not read back / %zu\n", state.total_instances);
+
+	if(ImGui::Checkbox("LOD selection", &state.lod_selection_enabled))
+		apply(lod_selection_enabled, state.lod_selection_enabled);
+	if(ImGui::SliderFloat("LOD error threshold (pixels)", &state.lod_pixel_threshold, 0.25f, 16.0f))
+		apply(lod_pixel_threshold, state.lod_pixel_threshold);
+	if(state.visible_counts_known)
+		ImGui::Text("Visible triangles: %zu\n", state.visible_triangles);
+	else
+		ImGui::Text("Visible triangles: not read back\n");
+
+	if(ImGui::Checkbox("Meshlet culling", &state.meshlet_culling))
+		apply(meshlet_culling, state.meshlet_culling);
+	if(ImGui::Checkbox("Meshlet backface culling", &state.backface_culling))
+		apply(cluster_culling.backface, state.backface_culling);
+	if(state.cluster_stats.triangles > 0)
+		ImGui::Text("Meshlet triangles culled: %.1f%% frustum, %.1f%% backface of %zu\n", 100.0 * state.cluster_stats.frustum_culled / state.cluster_stats.triangles, 100.0 * state.cluster_stats.backface_culled / state.cluster_stats.triangles, state.cluster_stats.triangles);
+	if(ImGui::Button("Benchmark meshlet culling") && !state.cluster_benchmark_running){
+		state.cluster_benchmark_running = true;
+		this->defer([this]{
+			cluster_benchmark_remaining = cluster_benchmark_frames;
+			cluster_benchmark_stats = {};
+			cluster_benchmark_time = 0.0;
+		});
+	}
+
+	ImGui::Text("Instance ring: %zu bytes per frame, %zu fence stalls\n", state.instance_ring_size, state.instance_ring_stalls);
+
+	bool packed_vertices = (state.vertex_format == VertexFormat::Packed);
+	if(ImGui::Checkbox("Packed vertices", &packed_vertices))
+		this->defer([this, packed_vertices]{ this->set_vertex_format(packed_vertices ? VertexFormat::Packed : VertexFormat::Full); });
+
+	GeometryPool::draw_debug_window(state.geometry_pool);
+	if(ImGui::Button("Compact geometry pool"))
+		this->defer([this]{ geometry_pool.compact(); });
+
+	if(TextureStreamer::draw_debug_window(state.texture_streamer))
+		this->defer([this, budget = state.texture_streamer.budget]{ texture_streamer.set_budget(budget); });
+	TextureTable::draw_debug_window(state.texture_table);
+	ImGui::Text("Materials: %zu (%zu meshes)\n", state.materials, state.material_references);
+	if(RenderQueue::draw_debug_window(state.render_queue))
+		this->defer([this, sorting = state.render_queue.sorting]{ render_queue.set_sorting(sorting); });
+
+	// Only runs on this thread and only touches the results it writes, so it needs no deferring
+	if(ImGui::Button("Benchmark transform kernels"))
+		transform_benchmark = transform_kernel::benchmark(transform_benchmark_instances);
+	for(const auto& result : transform_benchmark)
+		ImGui::Text("%s: %f instances/us, max relative error %g\n", result.name, result.instances_per_us, result.max_error);
 
-    for(const auto& [id, object] : internal_batches)
-        object.draw();
-};
\ No newline at end of file
+	// Makes GL calls, so it has to run wherever the context is current
+	if(ImGui::Button("Benchmark uniform updates"))
+		this->defer([this]{ this->benchmark_uniforms(); });
+	for(const auto& [name, ns] : state.uniform_benchmark)
+		ImGui::Text("%s: %f ns per call\n", name, ns);
+}
\ No newline at end of file
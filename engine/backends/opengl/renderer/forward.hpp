@@ -3,6 +3,7 @@
 #include "../base.hpp"
 #include "../pipeline.hpp"
 #include "../model/batch.hpp"
+#include "frame_uniforms.hpp"
 
 #include "../../../core/camera.hpp"
 
@@ -13,14 +14,109 @@ namespace benzene::opengl
         ForwardRenderer(int width, int height);
         ~ForwardRenderer();
 
-        void draw(std::unordered_map<benzene::ModelId, benzene::Batch*>& batches, benzene::FrameData& frame_data);
+        void draw(std::unordered_map<benzene::ModelId, benzene::Batch*>& batches, const Camera& camera, benzene::FrameData& frame_data);
 
         void framebuffer_resize_callback(size_t width, size_t height);
+        void draw_debug_window();
+        void publish_debug_state();
+
+        // Rebuilds the program, the geometry pool and every batch
+        void set_vertex_format(VertexFormat format);
+
+        protected:
+        void create_pipeline();
+        void destroy_pipeline();
+
+        virtual void submit(const opengl::Batch& batch);
+        // Called once per frame after the frustum is updated and before any batch is submitted
+        virtual void prepare_submission([[maybe_unused]] const Camera& camera) {}
+        // Called once per frame after every batch has been submitted
+        virtual void finish_submission() {}
+        // Sets visible_instances, total_instances and visible_counts_known for the frame that was just submitted
+        virtual void count_visible_instances();
+        // Times setting `firstDraw` by its name as a string, by its hashed name and through a handle
+        void benchmark_uniforms();
+
+        const transform_kernel::FrustumPlanes* get_cull_frustum() const {
+            return frustum_culling ? &frustum : nullptr;
+        }
+
+        const LodSelection* get_lod_selection() const {
+            return lod_selection_enabled ? &lod_selection : nullptr;
+        }
+
+        const ClusterCulling* get_cluster_culling() const {
+            return meshlet_culling ? &cluster_culling : nullptr;
+        }
+
+        static constexpr float near_plane = 0.1f, far_plane = 10000.0f;
+        static constexpr float max_geometry_fragmentation = 0.5f;
+        static constexpr size_t initial_instance_ring_size = 1024 * sizeof(gl::InstanceData);
+        static constexpr size_t texture_staging_size = 16 * 1024 * 1024, default_texture_upload_budget = 4 * 1024 * 1024;
 
-        private:
         Program main_program;
+        VertexFormat vertex_format;
+        GeometryPool geometry_pool;
+        TextureStreamer texture_streamer;
+        TextureTable texture_table;
+        MaterialTable material_table;
+        RingBuffer<GL_SHADER_STORAGE_BUFFER> instance_ring;
+        RenderQueue render_queue;
+        FrameUniforms frame_uniforms;
         std::unordered_map<ModelId, opengl::Batch> internal_batches;
 
-        Camera camera;
+        glm::mat4 projection;
+        size_t framebuffer_height;
+        transform_kernel::FrustumPlanes frustum;
+        bool frustum_culling;
+        size_t visible_instances, total_instances, visible_triangles;
+        // False when culling happened somewhere the visible counts weren't read back from
+        bool visible_counts_known;
+
+        LodSelection lod_selection;
+        bool lod_selection_enabled;
+        // How many pixels a level's error may cover on screen before the next more detailed level is drawn instead
+        float lod_pixel_threshold;
+
+        ClusterCulling cluster_culling;
+        // Off by default, instances that lose some of their meshlets can no longer share one instanced command with the rest
+        bool meshlet_culling;
+        ClusterStats cluster_stats;
+
+        // Meshlet culling is measured over this many frames from where the camera is, then logged
+        static constexpr size_t cluster_benchmark_frames = 300;
+        size_t cluster_benchmark_remaining;
+        ClusterStats cluster_benchmark_stats;
+        double cluster_benchmark_time;
+
+        float submission_time;
+
+        static constexpr size_t transform_benchmark_instances = 100'000;
+        std::vector<transform_kernel::BenchmarkResult> transform_benchmark;
+
+        static constexpr size_t uniform_benchmark_calls = 100'000;
+        // Nanoseconds per call for every way of setting a uniform
+        std::vector<std::pair<const char*, double>> uniform_benchmark;
+
+        // What the debug window shows, as of the end of the last frame
+        struct DebugState {
+            float submission_time;
+            bool frustum_culling;
+            size_t visible_instances, total_instances, visible_triangles;
+            bool visible_counts_known;
+            bool lod_selection_enabled;
+            float lod_pixel_threshold;
+            bool meshlet_culling, backface_culling, cluster_benchmark_running;
+            ClusterStats cluster_stats;
+            size_t instance_ring_size, instance_ring_stalls;
+            VertexFormat vertex_format;
+            GeometryPool::Stats geometry_pool;
+            TextureStreamer::Stats texture_streamer;
+            TextureTable::Stats texture_table;
+            size_t materials, material_references;
+            RenderQueue::Stats render_queue;
+            std::vector<std::pair<const char*, double>> uniform_benchmark;
+        };
+        DebugState debug_state;
     };
 } // namespace benzene::opengl
@@ -0,0 +1,52 @@
+#include "frame_uniforms.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+using namespace benzene::opengl;
+
+FrameUniforms::FrameUniforms(const std::vector<Light>& lights): ring{sizeof(Block)} {
+    if(lights.size() > max_lights)
+        print("opengl/FrameUniforms: {:d} lights, only the first {:d} are used\n", lights.size(), max_lights);
+
+    for(size_t i = 0; i < std::min(lights.size(), max_lights); i++){
+        const auto& light = lights[i];
+        this->lights.push_back(PackedLight{.position = light.position, .padding0 = 0.0f, .ambient = light.ambient, .padding1 = 0.0f, .diffuse = light.diffuse, .padding2 = 0.0f, .specular = light.specular, .padding3 = 0.0f});
+    }
+}
+
+void FrameUniforms::clean(){
+    ring.clean();
+    lights.clear();
+}
+
+void FrameUniforms::begin_frame(const Camera& camera, const glm::mat4& projection){
+    ring.begin_frame();
+
+    Block block{};
+    block.view = camera.get_view_matrix();
+    block.projection = projection;
+    block.view_projection = projection * block.view;
+    block.camera_pos = camera.get_position();
+    block.light_count = lights.size();
+    std::copy(lights.begin(), lights.end(), block.lights);
+
+    auto allocation = ring.allocate(sizeof(Block));
+    std::memcpy(allocation.ptr, &block, sizeof(Block));
+    RingBuffer<GL_UNIFORM_BUFFER>::bind_range(binding, allocation);
+}
+
+void FrameUniforms::end_frame(){
+    ring.end_frame();
+}
+
+std::vector<std::string> FrameUniforms::defines(){
+    // One line, so it fits in a #define
+    return {
+        "MAX_LIGHTS " + std::to_string(max_lights),
+        "FRAME_UNIFORMS "
+        "struct Light { vec3 position; vec3 ambient; vec3 diffuse; vec3 specular; }; "
+        "layout (std140, binding = " + std::to_string(binding) + ") uniform Frame { "
+        "mat4 viewMatrix; mat4 projectionMatrix; mat4 viewProjectionMatrix; vec3 cameraPos; uint lightCount; Light lights[MAX_LIGHTS]; };"
+    };
+}
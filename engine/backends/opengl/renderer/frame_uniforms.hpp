@@ -0,0 +1,62 @@
+#pragma once
+
+#include "../base.hpp"
+#include "../ring_buffer.hpp"
+
+#include "../../../core/camera.hpp"
+
+#include <string>
+#include <vector>
+
+namespace benzene::opengl
+{
+    // Camera and lights in one std140 uniform block, written once per frame into a fenced ring and bound at `binding`,
+    // which every program declaring the block through defines() reads instead of having its own copies set by name
+    class FrameUniforms {
+        public:
+        struct Light {
+            glm::vec3 position, ambient, diffuse, specular;
+        };
+
+        FrameUniforms() {}
+        // Lights past max_lights are left out
+        FrameUniforms(const std::vector<Light>& lights);
+        void clean();
+
+        // Writes this frame's block and binds it, the region it's in is fenced by end_frame() once everything reading it was issued
+        void begin_frame(const Camera& camera, const glm::mat4& projection);
+        void end_frame();
+
+        // Defines FRAME_UNIFORMS, which declares the block where it's used in a shader, and MAX_LIGHTS
+        static std::vector<std::string> defines();
+
+        static constexpr GLuint binding = 0;
+        static constexpr size_t max_lights = 8;
+
+        private:
+        // Matches `Light` in defines(), std140 pads every vec3 to 16 bytes
+        struct PackedLight {
+            glm::vec3 position;
+            float padding0;
+            glm::vec3 ambient;
+            float padding1;
+            glm::vec3 diffuse;
+            float padding2;
+            glm::vec3 specular;
+            float padding3;
+        };
+
+        // Matches `Frame` in defines()
+        struct Block {
+            glm::mat4 view;
+            glm::mat4 projection;
+            glm::mat4 view_projection;
+            glm::vec3 camera_pos;
+            uint32_t light_count;
+            PackedLight lights[max_lights];
+        };
+
+        RingBuffer<GL_UNIFORM_BUFFER> ring;
+        std::vector<PackedLight> lights;
+    };
+} // namespace benzene::opengl
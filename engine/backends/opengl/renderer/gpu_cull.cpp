@@ -0,0 +1,398 @@
+#include "gpu_cull.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <string>
+
+using namespace benzene::opengl;
+
+GpuCullRenderer::GpuCullRenderer(int width, int height): IndirectRenderer{width, height}, cull_program{}, depth_reduce_program{}, cull_uniforms{}, cull_stats{}, depth_copy{}, depth_pyramid{0}, depth_pyramid_levels{0}, occlusion_culling{true}, draw_distance{0.0f}, read_back_visibility{false}, cull_debug_state{} {
+	cull_program.add_shader(GL_COMPUTE_SHADER, R"(#version 420 core
+		#extension GL_ARB_compute_shader : require
+		#extension GL_ARB_shader_storage_buffer_object : require
+
+		layout (local_size_x = 64) in;
+
+		struct InstanceData {
+			mat4 modelMatrix;
+			mat4 normalMatrix;
+		};
+
+		layout (std140, binding = 0) readonly buffer PerInstanceData {
+			InstanceData data[];
+		} instanceData;
+
+		struct MeshBounds {
+			float radius;
+			float lodError;
+			float nextLodError;
+			uint lod;
+		};
+
+		layout (std430, binding = 1) readonly buffer PerMeshBounds {
+			MeshBounds data[];
+		} meshBounds;
+
+		struct DrawCommand {
+			uint indexCount;
+			uint instanceCount;
+			uint firstIndex;
+			uint baseVertex;
+			uint baseInstance;
+		};
+
+		layout (std430, binding = 2) buffer DrawCommands {
+			DrawCommand data[];
+		} drawCommands;
+
+		layout (std430, binding = 3) writeonly buffer VisibleInstances {
+			uint data[];
+		} visibleInstances;
+
+		layout (std430, binding = 4) buffer Visibility {
+			uint data[];
+		} visibility;
+
+		layout (std430, binding = 5) buffer CullStats {
+			uint drawn;
+			uint frustumCulled;
+			uint occlusionCulled;
+			uint triangles;
+		} stats;
+
+		const int phaseSingle = 0;
+		const int phaseEarly = 1;
+		const int phaseLate = 2;
+
+		uniform int instanceCount;
+		uniform int firstCommand;
+		uniform int cullPhase;
+		uniform bool frustumCulling;
+		uniform vec4 frustumPlanes[6]; // Normalized and pointing inwards
+		uniform float drawDistance;
+		uniform bool lodSelection;
+		uniform float lodPixelsPerUnit;
+
+		FRAME_UNIFORMS
+		uniform float nearPlane;
+		uniform sampler2D depthPyramid;
+		uniform int depthPyramidLevels;
+
+		// Screen space bounds of a perspective projected sphere, from "2D Polyhedral Bounds of a Clipped, Perspective-Projected 3D Sphere" (Mara, McGuire 2013)
+		// `c` is in view space with z pointing away from the camera, returns false if the sphere crosses the near plane
+		bool projectSphere(vec3 c, float r, out vec4 aabb) {
+			if(c.z < r + nearPlane)
+				return false;
+
+			vec3 cr = c * r;
+			float czr2 = c.z * c.z - r * r;
+
+			float vx = sqrt(c.x * c.x + czr2);
+			float minx = (vx * c.x - cr.z) / (vx * c.z + cr.x);
+			float maxx = (vx * c.x + cr.z) / (vx * c.z - cr.x);
+
+			float vy = sqrt(c.y * c.y + czr2);
+			float miny = (vy * c.y - cr.z) / (vy * c.z + cr.y);
+			float maxy = (vy * c.y + cr.z) / (vy * c.z - cr.y);
+
+			aabb = vec4(minx * projectionMatrix[0][0], miny * projectionMatrix[1][1], maxx * projectionMatrix[0][0], maxy * projectionMatrix[1][1]) * 0.5 + 0.5;
+			return true;
+		}
+
+		bool isOccluded(vec3 center, float radius) {
+			vec3 c = (viewMatrix * vec4(center, 1.0)).xyz;
+			c.z = -c.z;
+
+			vec4 aabb;
+			if(!projectSphere(c, radius, aabb))
+				return false;
+
+			// Pick the level where the bounds cover at most 2x2 texels, those 4 texels then contain the whole sphere
+			vec2 size = (aabb.zw - aabb.xy) * vec2(textureSize(depthPyramid, 0));
+			int level = min(int(ceil(log2(max(max(size.x, size.y), 1.0)))), depthPyramidLevels - 1);
+
+			// Every level halves and rounds down, the same sizes glTextureStorage2D gave the pyramid
+			ivec2 levelSize = max(textureSize(depthPyramid, 0) >> level, ivec2(1));
+			ivec2 lo = clamp(ivec2(aabb.xy * vec2(levelSize)), ivec2(0), levelSize - 1);
+			ivec2 hi = clamp(ivec2(aabb.zw * vec2(levelSize)), ivec2(0), levelSize - 1);
+
+			float furthest = max(max(texelFetch(depthPyramid, lo, level).r, texelFetch(depthPyramid, ivec2(hi.x, lo.y), level).r),
+			                     max(texelFetch(depthPyramid, ivec2(lo.x, hi.y), level).r, texelFetch(depthPyramid, hi, level).r));
+
+			// Window space depth of the point on the sphere closest to the camera
+			float z = c.z - radius;
+			float nearest = (-projectionMatrix[2][2] + projectionMatrix[3][2] / z) * 0.5 + 0.5;
+			return nearest > furthest;
+		}
+
+		// One invocation per instance along x and one row of work groups per level of every mesh along y
+		void main() {
+			uint instance = gl_GlobalInvocationID.x;
+			uint draw = gl_GlobalInvocationID.y;
+			if(instance >= uint(instanceCount))
+				return;
+
+			mat4 model = instanceData.data[instance].modelMatrix;
+			MeshBounds bounds = meshBounds.data[draw];
+			uint visibilityIndex = draw * uint(instanceCount) + instance;
+
+			vec3 center = model[3].xyz;
+			float scale = max(max(length(model[0].xyz), length(model[1].xyz)), length(model[2].xyz));
+			float radius = bounds.radius * scale;
+			float distance = length(center - cameraPos);
+
+			// Exactly one level of a mesh is selected for any instance, the other levels leave it alone without counting it as culled
+			float pixels = scale * lodPixelsPerUnit;
+			bool lodSelected = lodSelection ? (bounds.lodError * pixels <= distance && bounds.nextLodError * pixels > distance) : (bounds.lod == 0u);
+			if(!lodSelected){
+				if(cullPhase == phaseLate)
+					visibility.data[visibilityIndex] = 0u;
+				return;
+			}
+
+			bool inside = true;
+			if(frustumCulling)
+				for(int i = 0; i < 6; i++)
+					inside = inside && (dot(frustumPlanes[i].xyz, center) + frustumPlanes[i].w >= -radius);
+
+			inside = inside && (drawDistance <= 0.0 || (distance - radius) <= drawDistance);
+
+			// The early pass only sees part of the instances, so the late pass does the counting for both
+			if(!inside){
+				if(cullPhase != phaseEarly)
+					atomicAdd(stats.frustumCulled, 1u);
+				if(cullPhase == phaseLate)
+					visibility.data[visibilityIndex] = 0u;
+				return;
+			}
+
+			if(cullPhase == phaseEarly && visibility.data[visibilityIndex] == 0u)
+				return;
+
+			if(cullPhase == phaseLate){
+				bool wasVisible = visibility.data[visibilityIndex] != 0u;
+				bool occluded = isOccluded(center, radius);
+				visibility.data[visibilityIndex] = occluded ? 0u : 1u;
+
+				// Instances that were visible last frame have already been drawn by the early pass, occluded or not
+				if(wasVisible)
+					return;
+
+				if(occluded){
+					atomicAdd(stats.occlusionCulled, 1u);
+					return;
+				}
+			}
+
+			uint command = uint(firstCommand) + draw;
+			atomicAdd(stats.drawn, 1u);
+			atomicAdd(stats.triangles, drawCommands.data[command].indexCount / 3u);
+			uint slot = atomicAdd(drawCommands.data[command].instanceCount, 1u);
+			visibleInstances.data[drawCommands.data[command].baseInstance + slot] = instance;
+		})", FrameUniforms::defines());
+
+	cull_program.compile();
+
+	depth_reduce_program.add_shader(GL_COMPUTE_SHADER, R"(#version 420 core
+		#extension GL_ARB_compute_shader : require
+
+		layout (local_size_x = 8, local_size_y = 8) in;
+
+		uniform sampler2D source;
+		uniform int sourceLevel;
+		layout (r32f, binding = 0) writeonly uniform image2D destination;
+
+		// Every texel takes the furthest of the 2x2 texels below it, along an odd edge the last texel also takes the column or row left over
+		void main() {
+			ivec2 pos = ivec2(gl_GlobalInvocationID.xy);
+			ivec2 sourceSize = textureSize(source, sourceLevel);
+			ivec2 size = max(sourceSize / 2, ivec2(1));
+			if(any(greaterThanEqual(pos, size)))
+				return;
+
+			ivec2 extent = ivec2(2) + ivec2(equal(pos, size - 1)) * (sourceSize - size * 2);
+
+			float furthest = 0.0;
+			for(int y = 0; y < extent.y; y++)
+				for(int x = 0; x < extent.x; x++)
+					furthest = max(furthest, texelFetch(source, min(pos * 2 + ivec2(x, y), sourceSize - 1), sourceLevel).r);
+
+			imageStore(destination, pos, vec4(furthest));
+		})");
+
+	depth_reduce_program.compile();
+	depth_reduce_program.set_uniform("source", (int)depth_pyramid_unit);
+
+	cull_program.set_uniform("depthPyramid", (int)depth_pyramid_unit);
+	cull_program.set_uniform("nearPlane", near_plane);
+	cull_uniforms = CullUniforms{
+		.frustum_culling = cull_program.get_uniform<int>("frustumCulling"), .frustum_planes = cull_program.get_uniform<glm::vec4>("frustumPlanes"),
+		.draw_distance = cull_program.get_uniform<float>("drawDistance"), .lod_selection = cull_program.get_uniform<int>("lodSelection"),
+		.lod_pixels_per_unit = cull_program.get_uniform<float>("lodPixelsPerUnit")
+	};
+
+	cull_stats_buffer = Buffer<GL_SHADER_STORAGE_BUFFER>{sizeof(CullStats), nullptr, GL_DYNAMIC_STORAGE_BIT};
+
+	this->create_depth_pyramid(width, height);
+}
+
+GpuCullRenderer::~GpuCullRenderer(){
+	this->clean_depth_pyramid();
+	cull_stats_buffer.clean();
+	depth_reduce_program.clean();
+	cull_program.clean();
+}
+
+void GpuCullRenderer::framebuffer_resize_callback(size_t width, size_t height){
+	IndirectRenderer::framebuffer_resize_callback(width, height);
+
+	this->clean_depth_pyramid();
+	this->create_depth_pyramid(width, height);
+}
+
+void GpuCullRenderer::create_depth_pyramid(size_t width, size_t height){
+	width = std::max(width, (size_t)2);
+	height = std::max(height, (size_t)2);
+
+	// Blitting depth needs identical formats on both ends, so match whatever the default framebuffer got
+	auto attachment_bits = [](GLenum attachment, GLenum size_parameter){
+		// Querying the size of a missing attachment is an error rather than 0
+		GLint type = GL_NONE, bits = 0;
+		glGetNamedFramebufferAttachmentParameteriv(0, attachment, GL_FRAMEBUFFER_ATTACHMENT_OBJECT_TYPE, &type);
+		if(type != GL_NONE)
+			glGetNamedFramebufferAttachmentParameteriv(0, attachment, size_parameter, &bits);
+		return bits;
+	};
+	auto depth_bits = attachment_bits(GL_DEPTH, GL_FRAMEBUFFER_ATTACHMENT_DEPTH_SIZE);
+	auto stencil_bits = attachment_bits(GL_STENCIL, GL_FRAMEBUFFER_ATTACHMENT_STENCIL_SIZE);
+
+	Framebuffer::Attachment attachment{.container = Framebuffer::Attachment::Container::Texture, .type = Framebuffer::Attachment::Type::Depth, .format = GL_DEPTH_COMPONENT24};
+	if(stencil_bits > 0){
+		attachment.type = Framebuffer::Attachment::Type::DepthStencil;
+		attachment.format = (depth_bits == 32) ? GL_DEPTH32F_STENCIL8 : GL_DEPTH24_STENCIL8;
+	} else if(depth_bits == 32) {
+		attachment.format = GL_DEPTH_COMPONENT32F;
+	} else if(depth_bits == 16) {
+		attachment.format = GL_DEPTH_COMPONENT16;
+	}
+
+	depth_copy.emplace(width, height, std::vector<Framebuffer::Attachment>{attachment});
+	depth_copy_size = {width, height};
+
+	depth_pyramid_size = {width / 2, height / 2};
+	depth_pyramid_levels = (size_t)std::floor(std::log2(std::max(depth_pyramid_size.first, depth_pyramid_size.second))) + 1;
+
+	glCreateTextures(GL_TEXTURE_2D, 1, &depth_pyramid);
+	glTextureStorage2D(depth_pyramid, depth_pyramid_levels, GL_R32F, depth_pyramid_size.first, depth_pyramid_size.second);
+	glTextureParameteri(depth_pyramid, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+	glTextureParameteri(depth_pyramid, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTextureParameteri(depth_pyramid, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTextureParameteri(depth_pyramid, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+	cull_program.set_uniform("depthPyramidLevels", (int)depth_pyramid_levels);
+}
+
+void GpuCullRenderer::clean_depth_pyramid(){
+	if(depth_copy)
+		depth_copy->clean();
+	depth_copy.reset();
+
+	glDeleteTextures(1, &depth_pyramid);
+	depth_pyramid = 0;
+}
+
+void GpuCullRenderer::build_depth_pyramid(){
+	auto [width, height] = depth_copy_size;
+	glBlitNamedFramebuffer(0, (*depth_copy)(), 0, 0, width, height, 0, 0, width, height, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+
+	depth_reduce_program.bind();
+	for(size_t level = 0; level < depth_pyramid_levels; level++){
+		// Level 0 is reduced from the depth copy, every other level from the one below it
+		glBindTextureUnit(depth_pyramid_unit, (level == 0) ? depth_copy->get_attachment(0) : depth_pyramid);
+		depth_reduce_program.set_uniform("sourceLevel"_uniform, (level == 0) ? 0 : (int)(level - 1));
+		glBindImageTexture(0, depth_pyramid, level, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+
+		auto level_width = std::max(depth_pyramid_size.first >> level, (size_t)1);
+		auto level_height = std::max(depth_pyramid_size.second >> level, (size_t)1);
+		glDispatchCompute((level_width + 7) / 8, (level_height + 7) / 8, 1);
+		glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+	}
+
+	glBindTextureUnit(depth_pyramid_unit, depth_pyramid);
+}
+
+void GpuCullRenderer::prepare_submission([[maybe_unused]] const Camera& camera){
+	glm::vec4 planes[6];
+	for(int i = 0; i < 6; i++){
+		const auto& plane = frustum.planes[i];
+		planes[i] = glm::vec4{plane[0], plane[1], plane[2], plane[3]};
+	}
+
+	cull_program.set_uniform(cull_uniforms.frustum_culling, (int)this->frustum_culling);
+	cull_program.set_uniform(cull_uniforms.frustum_planes, planes, 6);
+	cull_program.set_uniform(cull_uniforms.draw_distance, this->draw_distance);
+	cull_program.set_uniform(cull_uniforms.lod_selection, (int)this->lod_selection_enabled);
+	cull_program.set_uniform(cull_uniforms.lod_pixels_per_unit, this->lod_selection.pixels_per_unit);
+
+	constexpr uint32_t zero = 0;
+	glClearNamedBufferData(cull_stats_buffer(), GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, &zero);
+	cull_stats_buffer.bind_base(5);
+}
+
+void GpuCullRenderer::submit(const opengl::Batch& batch){
+	batch.draw_gpu_culled(render_queue, cull_program, occlusion_culling ? GpuCullPhase::Early : GpuCullPhase::Single);
+}
+
+void GpuCullRenderer::finish_submission(){
+	if(occlusion_culling){
+		// Everything visible last frame has to be drawn before what it occludes is tested against its depth
+		render_queue.flush();
+		this->build_depth_pyramid();
+		for(const auto& [id, object] : internal_batches)
+			object.draw_gpu_culled(render_queue, cull_program, GpuCullPhase::Late);
+	}
+
+	if(read_back_visibility){
+		glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+		cull_stats_buffer.read(&cull_stats, 0, sizeof(CullStats));
+	}
+}
+
+void GpuCullRenderer::count_visible_instances(){
+	IndirectRenderer::count_visible_instances();
+
+	// The batches only know their totals, what survived culling never leaves the GPU unless it is read back
+	visible_counts_known = read_back_visibility;
+	if(read_back_visibility){
+		visible_instances = cull_stats.drawn;
+		visible_triangles = cull_stats.triangles;
+	}
+}
+
+void GpuCullRenderer::publish_debug_state(){
+	ForwardRenderer::publish_debug_state();
+	cull_debug_state = {
+		.occlusion_culling = occlusion_culling,
+		.draw_distance = draw_distance,
+		.read_back_visibility = read_back_visibility,
+		.cull_stats = cull_stats,
+		.depth_pyramid_size = depth_pyramid_size,
+		.depth_pyramid_levels = depth_pyramid_levels
+	};
+}
+
+void GpuCullRenderer::draw_debug_window(){
+	ForwardRenderer::draw_debug_window();
+
+	auto& state = cull_debug_state;
+	if(ImGui::Checkbox("Occlusion culling (Hi-Z)", &state.occlusion_culling))
+		this->defer([this, enabled = state.occlusion_culling]{ occlusion_culling = enabled; });
+	if(ImGui::SliderFloat("Draw distance (0 = unlimited)", &state.draw_distance, 0.0f, 5000.0f))
+		this->defer([this, distance = state.draw_distance]{ draw_distance = distance; });
+	if(ImGui::Checkbox("Read back GPU visibility (stalls)", &state.read_back_visibility))
+		this->defer([this, enabled = state.read_back_visibility]{ read_back_visibility = enabled; });
+	if(state.read_back_visibility){
+		ImGui::Text("Frustum / distance culled: %u, occlusion culled: %u\n", state.cull_stats.frustum_culled, state.cull_stats.occlusion_culled);
+		ImGui::Text("Depth pyramid: %zux%zu, %zu levels\n", state.depth_pyramid_size.first, state.depth_pyramid_size.second, state.depth_pyramid_levels);
+	}
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include "indirect.hpp"
+#include "../framebuffer.hpp"
+
+#include <optional>
+
+namespace benzene::opengl
+{
+    // Same as the IndirectRenderer, but culling runs in a compute shader that writes the instance counts of the indirect commands.
+    // Sticks to GL 4.3 features so a software driver like Mesa's llvmpipe can run it, though nothing in the tree runs it there automatically
+    class GpuCullRenderer : public IndirectRenderer {
+        public:
+        GpuCullRenderer(int width, int height);
+        ~GpuCullRenderer();
+
+        void framebuffer_resize_callback(size_t width, size_t height) override;
+        void draw_debug_window() override;
+        void publish_debug_state() override;
+
+        protected:
+        void submit(const opengl::Batch& batch) override;
+        void prepare_submission(const Camera& camera) override;
+        void finish_submission() override;
+        void count_visible_instances() override;
+
+        private:
+        void create_depth_pyramid(size_t width, size_t height);
+        void clean_depth_pyramid();
+        // Copies the depth buffer drawn so far and reduces it into the depth pyramid
+        void build_depth_pyramid();
+
+        Program cull_program, depth_reduce_program;
+
+        // Set every frame, the ones set per batch are looked up by their hashed names instead
+        struct CullUniforms {
+            UniformHandle<int> frustum_culling;
+            UniformHandle<glm::vec4> frustum_planes;
+            UniformHandle<float> draw_distance;
+            UniformHandle<int> lod_selection;
+            UniformHandle<float> lod_pixels_per_unit;
+        };
+        CullUniforms cull_uniforms;
+
+        // Matches `CullStats` in the culling shader
+        struct CullStats {
+            uint32_t drawn;
+            uint32_t frustum_culled;
+            uint32_t occlusion_culled;
+            uint32_t triangles;
+        };
+        Buffer<GL_SHADER_STORAGE_BUFFER> cull_stats_buffer;
+        CullStats cull_stats;
+
+        // The default framebuffer is multisampled and can't be sampled from, so its depth is resolved into here first
+        std::optional<Framebuffer> depth_copy;
+        std::pair<size_t, size_t> depth_copy_size;
+        // Every texel holds the furthest depth of the texels it covers in the level below, level 0 is half the framebuffer
+        GLuint depth_pyramid;
+        std::pair<size_t, size_t> depth_pyramid_size;
+        size_t depth_pyramid_levels;
+        static constexpr GLuint depth_pyramid_unit = 15;
+
+        bool occlusion_culling;
+        // Instances further away than this are culled, 0 draws at any distance
+        float draw_distance;
+        // Stalls at the end of every frame until culling is done, only needed for the counters in the debug window
+        bool read_back_visibility;
+
+        // Same as ForwardRenderer::DebugState
+        struct CullDebugState {
+            bool occlusion_culling;
+            float draw_distance;
+            bool read_back_visibility;
+            CullStats cull_stats;
+            std::pair<size_t, size_t> depth_pyramid_size;
+            size_t depth_pyramid_levels;
+        };
+        CullDebugState cull_debug_state;
+    };
+} // namespace benzene::opengl
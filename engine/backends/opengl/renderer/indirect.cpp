@@ -0,0 +1,7 @@
+#include "indirect.hpp"
+
+using namespace benzene::opengl;
+
+void IndirectRenderer::submit(const opengl::Batch& batch){
+	batch.draw_indirect(render_queue, this->get_cull_frustum(), this->get_lod_selection(), this->get_cluster_culling());
+}
@@ -0,0 +1,15 @@
+#pragma once
+
+#include "forward.hpp"
+
+namespace benzene::opengl
+{
+    // Same pipeline as the ForwardRenderer, but every batch is submitted through glMultiDrawElementsIndirect
+    class IndirectRenderer : public ForwardRenderer {
+        public:
+        IndirectRenderer(int width, int height): ForwardRenderer{width, height} {}
+
+        protected:
+        void submit(const opengl::Batch& batch) override;
+    };
+} // namespace benzene::opengl
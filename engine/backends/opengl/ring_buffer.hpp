@@ -0,0 +1,140 @@
+#pragma once
+
+#include "base.hpp"
+#include "buffer.hpp"
+
+#include <array>
+#include <vector>
+
+namespace benzene::opengl {
+    // Persistently mapped buffer split into one region per frame in flight, every region is guarded by a fence so the CPU
+    // never overwrites data the GPU might still be reading. Allocations are only valid for the frame they were made in
+    template<GLenum target, size_t frames_in_flight = 3>
+    class RingBuffer {
+        public:
+        struct Allocation {
+            void* ptr;
+            size_t offset, size;
+            // The ring's buffer when the allocation was made, it may have been replaced by a larger one since
+            GLuint buffer;
+        };
+
+        RingBuffer(): region_size{0}, alignment{1}, head{0}, frame{0}, base{nullptr}, fences{}, stalls{0} {}
+        RingBuffer(size_t region_size): head{0}, frame{0}, fences{}, stalls{0} {
+            GLint offset_alignment = 1;
+            if constexpr (target == GL_SHADER_STORAGE_BUFFER)
+                glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &offset_alignment);
+            else if constexpr (target == GL_UNIFORM_BUFFER)
+                glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &offset_alignment);
+            alignment = std::max<size_t>(offset_alignment, 16);
+
+            this->create(align(std::max<size_t>(region_size, 1)));
+        }
+
+        void clean(){
+            for(auto& fence : fences){
+                if(fence)
+                    glDeleteSync(fence);
+                fence = nullptr;
+            }
+
+            for(auto& old : retired)
+                old.clean();
+            retired.clear();
+            buffer.clean();
+            base = nullptr;
+        }
+
+        // Waits until the GPU is done with the region this frame is going to write into
+        void begin_frame(){
+            this->wait(frame % frames_in_flight);
+            head = 0;
+        }
+
+        // Fences the region written this frame, so it isn't reused until the GPU has consumed it
+        void end_frame(){
+            auto& fence = fences[frame % frames_in_flight];
+            assert(!fence);
+            fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+            // Every draw reading from them has been issued by now, the GL keeps them alive until those are done
+            for(auto& old : retired)
+                old.clean();
+            retired.clear();
+
+            frame++;
+        }
+
+        // Growing the ring replaces its buffer, allocations made before that stay in the old one until end_frame(), see Allocation::buffer
+        Allocation allocate(size_t size){
+            size = align(size);
+            if((head + size) > region_size){
+                // Everything in flight has to drain before the ring can be replaced, this should only happen for the first few frames
+                for(size_t i = 0; i < frames_in_flight; i++)
+                    this->wait(i);
+
+                retired.push_back(buffer);
+                this->create(align(std::max(region_size * 2, head + size)));
+                print("opengl/RingBuffer: Grew to {:d} bytes per frame\n", region_size);
+            }
+
+            auto offset = (frame % frames_in_flight) * region_size + head;
+            head += size;
+
+            return Allocation{.ptr = base + offset, .offset = offset, .size = size, .buffer = buffer()};
+        }
+
+        static void bind_range(GLint binding, const Allocation& allocation){
+            glBindBufferRange(target, binding, allocation.buffer, allocation.offset, allocation.size);
+        }
+
+        const Buffer<target>& get_buffer() const {
+            return buffer;
+        }
+
+        size_t get_region_size() const { return region_size; }
+        size_t get_stall_count() const { return stalls; }
+
+        private:
+        size_t align(size_t size) const {
+            return (size + alignment - 1) & ~(alignment - 1);
+        }
+
+        void create(size_t size){
+            region_size = size;
+            head = 0;
+
+            buffer = Buffer<target>{region_size * frames_in_flight, nullptr, GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT};
+            base = (uint8_t*)buffer.map();
+        }
+
+        void wait(size_t region){
+            auto& fence = fences[region];
+            if(!fence)
+                return;
+
+            // Poll first, only flush and block if the GPU really is behind
+            auto status = glClientWaitSync(fence, 0, 0);
+            if(status == GL_TIMEOUT_EXPIRED){
+                stalls++;
+                do {
+                    status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1'000'000'000);
+                } while(status == GL_TIMEOUT_EXPIRED);
+            }
+
+            if(status == GL_WAIT_FAILED)
+                throw std::runtime_error("opengl/RingBuffer: Failed to wait on fence");
+
+            glDeleteSync(fence);
+            fence = nullptr;
+        }
+
+        size_t region_size, alignment, head, frame;
+        uint8_t* base;
+        Buffer<target> buffer;
+        // Replaced this frame, with allocations still to be drawn from
+        std::vector<Buffer<target>> retired;
+        std::array<GLsync, frames_in_flight> fences;
+        size_t stalls;
+    };
+} // namespace benzene::opengl
@@ -265,7 +265,7 @@ namespace benzene::vulkan
             sampler = instance->device.createSampler(sampler_info);
         }
 
-        Texture(Instance* instance, benzene::Texture& tex): Texture{instance, (size_t)tex.dimensions().first, (size_t)tex.dimensions().second, tex.bytes().data()} {}
+        Texture(Instance* instance, benzene::Texture& tex): Texture{instance, (size_t)tex.dimensions().first, (size_t)tex.dimensions().second, tex.acquire_pixels().get()} {}
 
         void clean(){
             instance->device.destroySampler(sampler);
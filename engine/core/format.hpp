@@ -2,6 +2,7 @@
 
 #include <utility>
 #include <string.h>
+#include <stdio.h>
 #include <assert.h>
 #include <optional>
 
@@ -121,6 +122,18 @@ namespace format
 			format_number(v, int_buf, base, capital);
 			out.write(int_buf);
 		};
+
+		template<typename OutputIt>
+		void format_floating(format_output_it<OutputIt>& out, format_args args, double v){
+			if(!args.type)
+				args.type = 'f';
+
+			// Only the type and precision are supported, snprintf does the actual work
+			const char spec[] = {'%', '.', '*', *args.type, '\0'};
+			char buf[64]{};
+			snprintf(buf, sizeof(buf), spec, (int)args.precision.value_or(6), v);
+			out.write(buf);
+		}
 	}
 
 	template<typename T>
@@ -176,6 +189,20 @@ namespace format
 
 	#undef INT_IMPL
 
+	#define FLOAT_IMPL(T) \
+		template<> \
+		struct formatter<T> { \
+			template<typename OutputIt> \
+			static void format(format_output_it<OutputIt>& it, [[maybe_unused]] format_args args, T item){ \
+				internal::format_floating(it, args, (double)item); \
+			} \
+		};
+
+	FLOAT_IMPL(float)
+	FLOAT_IMPL(double)
+
+	#undef FLOAT_IMPL
+
 	template<>
 	struct formatter<char> {
 		template<typename OutputIt>
@@ -271,6 +298,12 @@ namespace format
 							options.sign = *fmt;
 						else if(*fmt == '#')
 							options.alternate = true;
+						else if(*fmt == '.'){ // Precision
+							size_t precision = 0;
+							while(fmt[1] >= '0' && fmt[1] <= '9')
+								precision = precision * 10 + (*++fmt - '0');
+							options.precision = precision;
+						}
 						else if(*fmt == ':')
 							;
 						else
@@ -0,0 +1,274 @@
+#include <benzene/jobs.hpp>
+#include "format.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+using namespace benzene::jobs;
+
+namespace {
+    struct ThreadState {
+        Scheduler* owner = nullptr;
+        size_t queue = 0;
+    };
+    thread_local ThreadState this_thread_state{};
+
+    Scheduler* current_scheduler = nullptr;
+}
+
+Scheduler::Scheduler(const Config& config){
+    size_t n_workers = config.n_workers;
+    if(n_workers == 0){
+        auto hardware_threads = std::thread::hardware_concurrency();
+        n_workers = (hardware_threads > 1) ? (hardware_threads - 1) : 0;
+    }
+
+    n_queues = n_workers + 1;
+    queues = std::make_unique<Queue[]>(n_queues);
+
+    workers.reserve(n_workers);
+    for(size_t i = 0; i < n_workers; i++)
+        workers.emplace_back([this, i, config]{ this->worker_main(i, config); });
+
+    print("benzene/jobs: Started {:d} worker(s)\n", n_workers);
+}
+
+Scheduler::~Scheduler(){
+    {
+        std::lock_guard lock{sleep_mutex};
+        running.store(false);
+    }
+    sleep_cv.notify_all();
+
+    for(auto& worker : workers)
+        worker.join();
+}
+
+void Scheduler::worker_main(size_t index, const Config& config){
+    this_thread_state = {.owner = this, .queue = index + 1};
+
+    #ifdef __linux__
+    auto name = format_to_str("benzene-job{:d}", index);
+    pthread_setname_np(pthread_self(), name.substr(0, 15).c_str());
+
+    if(config.pin_workers){
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET((config.first_core + index) % std::max(std::thread::hardware_concurrency(), 1u), &set);
+        if(pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0)
+            print("benzene/jobs: Failed to pin worker {:d}\n", index);
+    }
+    #else
+    (void)config;
+    #endif
+
+    while(running.load(std::memory_order_acquire)){
+        if(this->try_run_one())
+            continue;
+
+        std::unique_lock lock{sleep_mutex};
+        sleep_cv.wait(lock, [this]{ return !running.load() || n_queued.load() > 0; });
+    }
+}
+
+void Scheduler::push(Job job){
+    auto& queue = queues[(this_thread_state.owner == this) ? this_thread_state.queue : 0];
+    {
+        std::lock_guard lock{queue.mutex};
+        queue.jobs.push_back(std::move(job));
+    }
+    n_queued.fetch_add(1);
+
+    // Taking the lock makes sure a worker can't miss the wakeup between checking n_queued and going to sleep
+    { std::lock_guard lock{sleep_mutex}; }
+    sleep_cv.notify_one();
+}
+
+bool Scheduler::try_run_one(){
+    if(n_queued.load(std::memory_order_acquire) == 0)
+        return false;
+
+    auto own = (this_thread_state.owner == this) ? this_thread_state.queue : 0;
+    for(size_t i = 0; i < n_queues; i++){
+        auto index = (own + i) % n_queues;
+        auto& queue = queues[index];
+
+        std::unique_lock lock{queue.mutex};
+        if(queue.jobs.size() == 0)
+            continue;
+
+        Job job{};
+        if(index == own){
+            job = std::move(queue.jobs.back());
+            queue.jobs.pop_back();
+        } else {
+            job = std::move(queue.jobs.front());
+            queue.jobs.pop_front();
+            n_stolen.fetch_add(1, std::memory_order_relaxed);
+        }
+        lock.unlock();
+
+        n_queued.fetch_sub(1);
+        this->run(job);
+        return true;
+    }
+
+    return false;
+}
+
+void Scheduler::run(Job& job){
+    try {
+        job.f();
+    } catch(...) {
+        std::lock_guard lock{job.counter->error_mutex};
+        if(!job.counter->error)
+            job.counter->error = std::current_exception();
+    }
+
+    n_executed.fetch_add(1, std::memory_order_relaxed);
+    job.counter->pending.fetch_sub(1, std::memory_order_acq_rel);
+}
+
+void Scheduler::submit(std::function<void()> job, Counter& counter){
+    counter.pending.fetch_add(1, std::memory_order_relaxed);
+    this->push({.f = std::move(job), .counter = &counter});
+}
+
+void Scheduler::wait(Counter& counter){
+    while(!counter.done())
+        if(!this->try_run_one())
+            std::this_thread::yield();
+
+    std::lock_guard lock{counter.error_mutex};
+    if(counter.error){
+        auto error = counter.error;
+        counter.error = nullptr;
+        std::rethrow_exception(error);
+    }
+}
+
+void Scheduler::parallel_for(size_t begin, size_t end, size_t grain, const std::function<void(size_t, size_t)>& f){
+    if(begin >= end)
+        return;
+
+    grain = std::max(grain, (size_t)1);
+    auto n_chunks = (end - begin + grain - 1) / grain;
+    if(n_chunks == 1 || workers.size() == 0){
+        f(begin, end);
+        return;
+    }
+
+    Counter counter{};
+    for(size_t chunk = 1; chunk < n_chunks; chunk++){
+        auto first = begin + chunk * grain;
+        auto last = std::min(first + grain, end);
+        this->submit([&f, first, last]{ f(first, last); }, counter);
+    }
+
+    // Pushed last so the calling thread pops it straight back off its own queue while the workers steal the rest
+    this->submit([&f, begin, grain]{ f(begin, begin + grain); }, counter);
+    this->wait(counter);
+}
+
+TaskGraph::TaskId TaskGraph::add(std::function<void()> task){
+    auto& node = nodes.emplace_back();
+    node.task = std::move(task);
+    return nodes.size() - 1;
+}
+
+void TaskGraph::depends_on(TaskId task, TaskId dependency){
+    if(task >= nodes.size() || dependency >= nodes.size())
+        throw std::out_of_range("benzene/jobs: Task id out of range");
+
+    nodes[dependency].successors.push_back(task);
+    nodes[task].n_dependencies++;
+}
+
+std::vector<TaskGraph::TaskId> TaskGraph::topological_order() const {
+    // Kahn's algorithm, a cycle would otherwise make wait() spin forever
+    std::vector<size_t> remaining(nodes.size());
+    std::vector<TaskId> ready{};
+    for(size_t i = 0; i < nodes.size(); i++){
+        remaining[i] = nodes[i].n_dependencies;
+        if(remaining[i] == 0)
+            ready.push_back(i);
+    }
+
+    std::vector<TaskId> order{};
+    order.reserve(nodes.size());
+    while(ready.size() > 0){
+        auto id = ready.back();
+        ready.pop_back();
+        order.push_back(id);
+
+        for(auto successor : nodes[id].successors)
+            if(--remaining[successor] == 0)
+                ready.push_back(successor);
+    }
+
+    if(order.size() != nodes.size())
+        throw std::runtime_error("benzene/jobs: Task graph contains a cycle");
+
+    return order;
+}
+
+void TaskGraph::run(Scheduler& scheduler){
+    topological_order();
+
+    std::vector<TaskId> roots{};
+    for(size_t i = 0; i < nodes.size(); i++){
+        nodes[i].remaining.store(nodes[i].n_dependencies, std::memory_order_relaxed);
+        if(nodes[i].n_dependencies == 0)
+            roots.push_back(i);
+    }
+
+    Counter counter{};
+    std::function<void(TaskId)> start = [&](TaskId id){
+        scheduler.submit([&, id]{
+            auto& node = nodes[id];
+            node.task();
+
+            // Successors are submitted before this job counts as finished, so the counter can't reach zero early
+            for(auto successor : node.successors)
+                if(nodes[successor].remaining.fetch_sub(1, std::memory_order_acq_rel) == 1)
+                    start(successor);
+        }, counter);
+    };
+
+    for(auto root : roots)
+        start(root);
+
+    scheduler.wait(counter);
+}
+
+void TaskGraph::run(){
+    for(auto id : topological_order())
+        nodes[id].task();
+}
+
+Scheduler* benzene::jobs::current(){
+    return current_scheduler;
+}
+
+void benzene::jobs::set_current(Scheduler* scheduler){
+    current_scheduler = scheduler;
+}
+
+void benzene::jobs::parallel_for(size_t begin, size_t end, size_t grain, const std::function<void(size_t, size_t)>& f){
+    if(current_scheduler)
+        current_scheduler->parallel_for(begin, end, grain, f);
+    else if(begin < end)
+        f(begin, end);
+}
+
+void benzene::jobs::run(TaskGraph& graph){
+    if(current_scheduler)
+        graph.run(*current_scheduler);
+    else
+        graph.run();
+}
@@ -11,29 +11,166 @@
 #include "display.hpp"
 
 #include "format.hpp"
+#include "material_loader.hpp"
+#include "mesh_cache.hpp"
+#include "mesh_optimizer.hpp"
+#include "mesh_simplifier.hpp"
+#include "meshlets.hpp"
+#include "obj_loader.hpp"
+#include "texture_baker.hpp"
+#include "utils.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <mutex>
+
+namespace {
+    // Pixels that some benzene::Texture still holds, keyed by file path or by contents
+    struct SharedPixels {
+        std::weak_ptr<benzene::Texture::Pixels> pixels;
+        int width, height, channels;
+        uint64_t hash;
+        benzene::Texture::Compression compression;
+        std::vector<benzene::Texture::Level> levels;
+    };
+
+    std::mutex shared_pixels_mutex;
+    std::unordered_map<std::string, SharedPixels> shared_files;
+    std::unordered_map<uint64_t, SharedPixels> shared_contents;
+
+    uint64_t pixel_hash(const uint8_t* pixels, size_t size, int width, int height, int channels){
+        auto hash = benzene::content_hash((const std::byte*)pixels, size);
+        return hash ^ ((((uint64_t)width << 32) | ((uint64_t)height << 8) | (uint64_t)channels) * 0x9e3779b97f4a7c15);
+    }
+
+    // Takes ownership of stb_image's buffer instead of copying it
+    std::shared_ptr<const uint8_t> decode(const std::string& filename, int& width, int& height, int& channels){
+        // Per thread, material textures are decoded on the job system
+        stbi_set_flip_vertically_on_load_thread(true);
+
+        // Backends take 3 or 4 channels, greyscale images like specular maps are widened to RGB(A) while decoding
+        auto* data = stbi_info(filename.c_str(), &width, &height, &channels) ? stbi_load(filename.c_str(), &width, &height, &channels, (channels < 3) ? (channels + 2) : channels) : nullptr;
+        if(!data) {
+            print("benzene/texture: Failed to load texture data, error: {:s}\n", stbi_failure_reason());
+            throw std::runtime_error("benzene/texture: Failed to load image data from file");
+        }
+        channels = (channels < 3) ? (channels + 2) : channels;
+
+        return std::shared_ptr<const uint8_t>{data, [](const uint8_t* data){ stbi_image_free((void*)data); }};
+    }
+}
 
-benzene::Texture benzene::Texture::load_from_file(const std::string& filename, const std::string& shader_name, benzene::Texture::Gamut gamut){
-    int width, height, channels;
-    stbi_set_flip_vertically_on_load(true);
+bool benzene::Texture::find_shared(const std::string& key, Residency residency, Texture& tex){
+    {
+        std::lock_guard lock{shared_pixels_mutex};
+        auto it = shared_files.find(key);
+        if(it == shared_files.end())
+            return false;
+
+        tex.pixels = it->second.pixels.lock();
+        if(!tex.pixels)
+            return false;
+
+        tex.width = it->second.width;
+        tex.height = it->second.height;
+        tex.channels = it->second.channels;
+        tex.hash = it->second.hash;
+        tex.compression = it->second.compression;
+        tex.levels = it->second.levels;
+    }
 
-    auto* data = stbi_load(filename.c_str(), &width, &height, &channels, STBI_default);
-    if(!data) {
-        print("benzene/texture: Failed to load texture data, error: {:s}\n", stbi_failure_reason());
-        throw std::runtime_error("benzene/texture: Failed to load image data from file");
+    // Anyone asking to keep the pixels wins, they may have been released already
+    if(residency == Residency::Keep){
+        {
+            std::lock_guard lock{tex.pixels->mutex};
+            tex.pixels->residency = Residency::Keep;
+        }
+        tex.acquire_pixels();
     }
 
+    return true;
+}
+
+benzene::Texture benzene::Texture::load_from_file(const std::string& filename, const std::string& shader_name, benzene::Texture::Gamut gamut, benzene::Texture::Residency residency){
     Texture tex{};
     tex.shader_name = shader_name;
-    tex.width = width;
-    tex.height = height;
-    tex.channels = channels;
     tex.gamut = gamut;
 
-    size_t size = width * height * channels;
-    tex.data.resize(size);
-    memcpy(tex.data.data(), data, size);
+    // Different spellings of the same path share an entry, the gamut only matters once the pixels are uploaded
+    auto key = std::filesystem::absolute(filename).lexically_normal().string();
+    if(find_shared(key, residency, tex))
+        return tex;
+
+    auto data = decode(filename, tex.width, tex.height, tex.channels);
+    size_t size = tex.width * tex.height * tex.channels;
+    tex.hash = pixel_hash(data.get(), size, tex.width, tex.height, tex.channels);
+    tex.pixels = std::make_shared<Pixels>();
+    tex.pixels->data = std::move(data);
+    tex.pixels->size = size;
+    tex.pixels->source = filename;
+    tex.pixels->residency = residency;
 
-    stbi_image_free(data);
+    std::lock_guard lock{shared_pixels_mutex};
+    shared_files[key] = {.pixels = tex.pixels, .width = tex.width, .height = tex.height, .channels = tex.channels, .hash = tex.hash, .compression = tex.compression, .levels = {}};
+
+    return tex;
+}
+
+benzene::Texture benzene::Texture::load_baked(const std::string& filename, const std::string& shader_name, benzene::Texture::Gamut gamut, benzene::Texture::Compression compression, benzene::Texture::Residency residency){
+    if(compression == Compression::None)
+        return load_from_file(filename, shader_name, gamut, residency);
+
+    Texture tex{};
+    tex.shader_name = shader_name;
+    tex.gamut = gamut;
+
+    // The mips are filtered differently for every gamut, so unlike plain files each one is a texture of its own
+    auto cache_path = texture_baker::path_for(filename, compression, gamut);
+    auto key = std::filesystem::absolute(cache_path).lexically_normal().string();
+    if(find_shared(key, residency, tex))
+        return tex;
+
+    uint64_t source_hash;
+    {
+        MappedFile source{filename};
+        source_hash = content_hash(source.data(), source.size());
+    }
+
+    auto baked = texture_baker::read(cache_path);
+    if(!baked || baked->source_hash != source_hash || baked->compression != compression || baked->gamut != gamut){
+        int width, height, channels;
+        auto data = decode(filename, width, height, channels);
+        baked = texture_baker::bake(data.get(), width, height, channels, gamut, compression);
+        baked->source_hash = source_hash;
+        data.reset();
+
+        // Mapping the file right back means the levels point into it like they would on the next run, and the pixels can be read from it again.
+        // Without the file there's nothing to read them from, so they stay in memory
+        std::optional<texture_baker::Baked> written{};
+        if(texture_baker::write(cache_path, *baked))
+            written = texture_baker::read(cache_path);
+
+        if(written)
+            baked = std::move(written);
+        else
+            residency = Residency::Keep;
+    }
+
+    tex.width = baked->width;
+    tex.height = baked->height;
+    tex.channels = baked->channels;
+    tex.compression = compression;
+    tex.levels = baked->levels;
+    tex.hash = source_hash ^ (((uint64_t)compression + 1) * 0x9e3779b97f4a7c15);
+    tex.pixels = std::make_shared<Pixels>();
+    tex.pixels->data = std::move(baked->data);
+    tex.pixels->size = baked->size;
+    tex.pixels->source = cache_path;
+    tex.pixels->residency = residency;
+
+    std::lock_guard lock{shared_pixels_mutex};
+    shared_files[key] = {.pixels = tex.pixels, .width = tex.width, .height = tex.height, .channels = tex.channels, .hash = tex.hash, .compression = tex.compression, .levels = tex.levels};
 
     return tex;
 }
@@ -46,132 +183,324 @@ benzene::Texture benzene::Texture::load_from_colour(glm::vec3 colour, const std:
     tex.channels = 3;
     tex.gamut = Gamut::Linear;
 
-    tex.data.push_back(colour.r * 255);
-    tex.data.push_back(colour.g * 255);
-    tex.data.push_back(colour.b * 255);
+    const uint8_t rgb[3] = {(uint8_t)(colour.r * 255), (uint8_t)(colour.g * 255), (uint8_t)(colour.b * 255)};
+    tex.hash = pixel_hash(rgb, 3, tex.width, tex.height, tex.channels);
+
+    std::lock_guard lock{shared_pixels_mutex};
+    auto& shared = shared_contents[tex.hash];
+    tex.pixels = shared.pixels.lock();
+    if(!tex.pixels || !std::equal(rgb, rgb + 3, tex.pixels->data.get())){
+        auto* data = new uint8_t[3]{rgb[0], rgb[1], rgb[2]};
+        tex.pixels = std::make_shared<Pixels>();
+        tex.pixels->data = std::shared_ptr<const uint8_t>{data, std::default_delete<const uint8_t[]>{}};
+        tex.pixels->size = 3;
+        tex.pixels->residency = Residency::Keep;
+        shared = {.pixels = tex.pixels, .width = tex.width, .height = tex.height, .channels = tex.channels, .hash = tex.hash, .compression = tex.compression, .levels = {}};
+    }
 
     return tex;
 }
 
-void benzene::Batch::load_mesh_data_from_file(const std::string& folder, const std::string& file){
-    assert(folder[folder.size() - 1] == '/');
-    assert(file[0] != '/');
-    const std::string file_path = folder + file;
+std::shared_ptr<const uint8_t> benzene::Texture::acquire_pixels() const {
+    if(!pixels)
+        return nullptr;
+
+    std::lock_guard lock{pixels->mutex};
+    if(!pixels->data && !pixels->source.empty() && compression != Compression::None){
+        // Baked textures are mapped from their .bzt file again, its source image doesn't matter anymore
+        auto baked = texture_baker::read(pixels->source);
+        if(!baked || baked->width != width || baked->height != height || baked->compression != compression || baked->levels != levels){
+            print("benzene/texture: {:s} changed since it was first loaded\n", pixels->source);
+            throw std::runtime_error("benzene/texture: Texture source changed");
+        }
 
-    tinyobj::attrib_t attrib{};
-    std::vector<tinyobj::shape_t> shapes{};
-    std::vector<tinyobj::material_t> materials{};
-    std::string warning{}, error{};
-    
-    if(!tinyobj::LoadObj(&attrib, &shapes, &materials, &warning, &error, file_path.c_str(), folder.c_str(), true)){
-        print("benzene/Mesh: Failed to load object from {:s}, warning: {:s}, error: {:s}n\n", file_path, warning, error);
-        throw std::runtime_error("benzene/Mesh: Failed to load object");
+        pixels->data = std::move(baked->data);
+    } else if(!pixels->data && !pixels->source.empty()){
+        int width, height, channels;
+        auto data = decode(pixels->source, width, height, channels);
+        if(width != this->width || height != this->height || channels != this->channels){
+            print("benzene/texture: {:s} changed since it was first loaded\n", pixels->source);
+            throw std::runtime_error("benzene/texture: Texture source changed");
+        }
+
+        pixels->data = std::move(data);
+    }
+
+    return pixels->data;
+}
+
+void benzene::Texture::release_after_upload() const {
+    if(!pixels)
+        return;
+
+    // Whoever still holds the pointer from acquire_pixels() keeps the memory alive until it's done with it
+    std::lock_guard lock{pixels->mutex};
+    if(pixels->residency == Residency::ReleaseAfterUpload)
+        pixels->data.reset();
+}
+
+// Parses an OBJ file and turns every shape into an optimized mesh
+static std::vector<benzene::Mesh> load_obj(const std::string& folder, const std::string& file_path){
+    using namespace benzene;
+
+    auto parse_begin = std::chrono::steady_clock::now();
+    auto model = obj::load(file_path, folder);
+    if constexpr (true){
+        auto parse_time = std::chrono::duration<double>(std::chrono::steady_clock::now() - parse_begin).count();
+        auto megabytes = std::filesystem::file_size(file_path) / (1024.0 * 1024.0);
+        print("benzene/Model: Parsed {:.1f} MB of OBJ in {:.3f} ms, {:.1f} MB/s\n", megabytes, parse_time * 1000.0, megabytes / parse_time);
     }
     
     bool have_surface_normals = true;
-    if(attrib.normals.size() == 0)
+    if(model.normals.size() == 0)
         have_surface_normals = false;//throw std::runtime_error("benzene/Model: Tried to load model with no normal vectors\n");
     
-    if(attrib.texcoords.size() == 0)
+    if(model.uvs.size() == 0)
         throw std::runtime_error("benzene/Model: Tried to load model with no uv's\n");
     
-    auto process_mesh = [have_surface_normals, &attrib](const tinyobj::shape_t& shape) -> benzene::Mesh {
-        std::vector<benzene::Mesh::Vertex> vertices{};
-        for(const auto& index : shape.mesh.indices){
-            Mesh::Vertex vertex{};
-
-            vertex.pos = {
-                attrib.vertices[3 * index.vertex_index],
-                attrib.vertices[3 * index.vertex_index + 1],
-                attrib.vertices[3 * index.vertex_index + 2]
-            };
-
-            vertex.uv = {
-                attrib.texcoords[2 * index.texcoord_index],
-                attrib.texcoords[2 * index.texcoord_index + 1]
-            };
+    // Corners are assembled in parallel blocks, large shapes would otherwise keep one worker busy long after the others are done
+    constexpr size_t corner_grain = 1 << 14;
+    auto process_mesh = [have_surface_normals, &model](const obj::Shape& shape) -> benzene::Mesh {
+        std::vector<benzene::Mesh::Vertex> vertices(shape.indices.size());
+        jobs::parallel_for(0, vertices.size(), corner_grain, [&](size_t begin, size_t end){
+            for(size_t i = begin; i < end; i++){
+                const auto& index = shape.indices[i];
+                auto& vertex = vertices[i];
+
+                vertex.pos = {
+                    model.positions[3 * index.vertex],
+                    model.positions[3 * index.vertex + 1],
+                    model.positions[3 * index.vertex + 2]
+                };
 
-            if(have_surface_normals){
-                vertex.normal = {
-                    attrib.normals[3 * index.normal_index],
-                    attrib.normals[3 * index.normal_index + 1],
-                    attrib.normals[3 * index.normal_index + 2]
-                };                
+                if(index.uv >= 0){
+                    vertex.uv = {
+                        model.uvs[2 * index.uv],
+                        model.uvs[2 * index.uv + 1]
+                    };
+                }
+
+                if(have_surface_normals && index.normal >= 0){
+                    vertex.normal = {
+                        model.normals[3 * index.normal],
+                        model.normals[3 * index.normal + 1],
+                        model.normals[3 * index.normal + 2]
+                    };
+                }
             }
-
-            vertices.push_back(vertex);
-        }
+        });
 
         if(!have_surface_normals){
             assert((vertices.size() % 3) == 0);
 
-            for(size_t i = 0; i < vertices.size(); i += 3){
-                auto& v1 = vertices[i];
-                auto& v2 = vertices[i + 1];
-                auto& v3 = vertices[i + 2];
+            // Whole triangles per block, every triangle only touches its own corners
+            jobs::parallel_for(0, vertices.size() / 3, corner_grain, [&](size_t begin, size_t end){
+                for(size_t i = begin * 3; i < end * 3; i += 3){
+                    auto& v1 = vertices[i];
+                    auto& v2 = vertices[i + 1];
+                    auto& v3 = vertices[i + 2];
 
-                auto calculate_surface_normal = [](glm::vec3 p1, glm::vec3 p2, glm::vec3 p3) -> glm::vec3 {
-                    // https://www.khronos.org/opengl/wiki/Calculating_a_Surface_Normal#Algorithm
-                    auto U = p2 - p1;
-                    auto V = p3 - p1;
+                    auto calculate_surface_normal = [](glm::vec3 p1, glm::vec3 p2, glm::vec3 p3) -> glm::vec3 {
+                        // https://www.khronos.org/opengl/wiki/Calculating_a_Surface_Normal#Algorithm
+                        auto U = p2 - p1;
+                        auto V = p3 - p1;
 
-                    return glm::normalize(glm::cross(U, V));
-                };
+                        return glm::normalize(glm::cross(U, V));
+                    };
 
-                auto calculate_surface_tangent = [](Mesh::Vertex v0, Mesh::Vertex v1, Mesh::Vertex v2) -> glm::vec3 {
-                    auto dv1 = v1.pos - v0.pos;
-                    auto dv2 = v2.pos - v0.pos;
+                    auto calculate_surface_tangent = [](Mesh::Vertex v0, Mesh::Vertex v1, Mesh::Vertex v2) -> glm::vec3 {
+                        auto dv1 = v1.pos - v0.pos;
+                        auto dv2 = v2.pos - v0.pos;
 
-                    auto duv1 = v1.uv - v0.uv;
-                    auto duv2 = v2.uv - v0.uv;
+                        auto duv1 = v1.uv - v0.uv;
+                        auto duv2 = v2.uv - v0.uv;
 
-                    auto f = 1.0f / (duv1.x * duv2.y - duv1.y * duv2.x);
+                        auto f = 1.0f / (duv1.x * duv2.y - duv1.y * duv2.x);
 
-                    return glm::normalize((dv1 * duv2.y - dv2 * duv1.y) * f);
-                };
+                        return glm::normalize((dv1 * duv2.y - dv2 * duv1.y) * f);
+                    };
 
-                auto normal = calculate_surface_normal(v1.pos, v2.pos, v3.pos);
-                auto tangent = calculate_surface_tangent(v1, v2, v3);
+                    auto normal = calculate_surface_normal(v1.pos, v2.pos, v3.pos);
+                    auto tangent = calculate_surface_tangent(v1, v2, v3);
 
-                v1.normal = v2.normal = v3.normal = normal;
-                v1.tangent = v2.tangent = v3.tangent = tangent;
-            }
+                    v1.normal = v2.normal = v3.normal = normal;
+                    v1.tangent = v2.tangent = v3.tangent = tangent;
+                }
+            });
         }
 
         Mesh mesh{};
-        std::unordered_map<benzene::Mesh::Vertex, uint32_t> unique_vertices{};
-        for(auto& vertex : vertices){
-            if(unique_vertices.count(vertex) == 0){
-                unique_vertices[vertex] = mesh.vertices.size();
-                mesh.vertices.push_back(vertex);
-            }
-            mesh.indices.push_back(unique_vertices[vertex]);
-        }
+        mesh_optimizer::deduplicate(vertices, mesh);
+
+        auto [before, after] = mesh_optimizer::optimize(mesh);
 
         if constexpr (true)
-            if(mesh.vertices.size() < vertices.size())
-                print("benzene/Model: Optimized submesh from {:d} vertices to {:d} unique vertices\n", vertices.size(), mesh.vertices.size());
+            print("benzene/Model: Optimized submesh from {:d} vertices to {:d} unique vertices, ACMR {:.3f} -> {:.3f}, ATVR {:.3f} -> {:.3f}\n", vertices.size(), mesh.vertices.size(), before.acmr, after.acmr, before.atvr, after.atvr);
+
+        // A mesh that fits in one meshlet can't cull any of its triangles
+        if(mesh.indices.size() > (meshlets::max_triangles * 3))
+            mesh.meshlets = meshlets::build(mesh.vertices, mesh.indices);
+
+        auto material_id = (shape.material_ids.size() > 0) ? shape.material_ids[0] : -1;
+        if(material_id >= 0 && (size_t)material_id < model.materials.size()){
+            const auto& material = model.materials[material_id];
+            // Exporters on Windows tend to write backslashes
+            auto map_path = [](std::string path){
+                std::replace(path.begin(), path.end(), '\\', '/');
+                return path;
+            };
+
+            mesh.material.name = material.name;
+            mesh.material.shininess = material.shininess;
+            mesh.material.diffuse = {material.diffuse[0], material.diffuse[1], material.diffuse[2]};
+            mesh.material.specular = {material.specular[0], material.specular[1], material.specular[2]};
+            mesh.material.diffuse_map = map_path(material.diffuse_texname);
+            mesh.material.specular_map = map_path(material.specular_texname);
+            // `norm` if the library has it, plenty of them put normal maps under `map_bump` instead
+            mesh.material.normal_map = map_path(material.normal_texname.empty() ? material.bump_texname : material.normal_texname);
+        }
 
+        mesh.bounds = mesh_cache::compute_bounds(mesh);
         return mesh;
     };
 
-    this->meshes.clear();
+    // Shapes are independent, so each one is triangulated, given normals, deduplicated and optimized on its own worker
+    std::vector<Mesh> meshes(model.shapes.size());
+    jobs::parallel_for(0, model.shapes.size(), 1, [&](size_t begin, size_t end){
+        for(size_t i = begin; i < end; i++)
+            meshes[i] = process_mesh(model.shapes[i]);
+    });
+
+    return meshes;
+}
+
+void benzene::Batch::load_mesh_data_from_file(const std::string& folder, const std::string& file, const LodConfig* lod_config, const TextureConfig& texture_config){
+    assert(folder[folder.size() - 1] == '/');
+    assert(file[0] != '/');
+    const std::string file_path = folder + file;
+    auto load_begin = std::chrono::steady_clock::now();
+
+    // The cache is tied to the model's contents rather than its timestamp, so it survives copies and checkouts but never outlives an edit
+    uint64_t source_hash = 0;
+    std::vector<std::string> libraries{};
+    try {
+        MappedFile source{file_path};
+        source_hash = content_hash(source.data(), source.size());
+        libraries = obj::material_libraries(source.data(), source.size());
+    } catch(const std::exception&){
+        print("benzene/Mesh: Failed to open {:s}\n", file_path);
+        throw std::runtime_error("benzene/Mesh: Failed to load object");
+    }
 
-    for(const auto& shape : shapes)
-        this->meshes.push_back(process_mesh(shape));
+    // Materials are cached along with the meshes, so editing, adding or removing a material library the model names is an edit too
+    for(const auto& library : libraries){
+        auto library_hash = content_hash((const std::byte*)library.data(), library.size());
+        try {
+            MappedFile contents{folder + library};
+            library_hash ^= content_hash(contents.data(), contents.size()) * 0x9e3779b97f4a7c15;
+        } catch(const std::exception&){
+            // Missing, or empty and so impossible to map, only its name counts then
+        }
+
+        source_hash = (source_hash * 0x100000001b3) ^ library_hash;
+    }
+
+    // Writing the cache, baking textures and building LODs all only need the meshes, and don't touch the same parts of them
+    jobs::TaskGraph graph{};
+    auto cache_path = mesh_cache::path_for(file_path);
+    bool from_cache = false;
+    auto load = graph.add([&]{
+        auto cached = mesh_cache::read(cache_path, source_hash);
+        from_cache = cached.has_value();
+        if(from_cache)
+            this->meshes = std::move(*cached);
+        else
+            this->meshes = load_obj(folder, file_path);
+
+        if constexpr (true){
+            auto load_time = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - load_begin).count();
+            print("benzene/Model: {:s} {:s} in {:.3f} ms\n", from_cache ? "Mapped cached" : "Parsed", file_path, load_time);
+        }
+
+        if constexpr (true){
+            size_t tris = 0;
+            for(const auto& mesh : this->meshes)
+                tris += (mesh.get_indices().size() / 3);
+            print("benzene/Model: Loaded model with {:d} submesh(es) and {:d} triangles\n", this->meshes.size(), tris);
+        }
+    });
+
+    auto write = graph.add([&]{
+        if(!from_cache)
+            mesh_cache::write(cache_path, source_hash, this->meshes);
+    });
+    graph.depends_on(write, load);
+
+    auto textures = graph.add([&]{
+        material_loader::load_textures(folder, this->meshes, texture_config);
+    });
+    graph.depends_on(textures, load);
+
+    if(lod_config){
+        auto lods = graph.add([&]{
+            this->generate_lods(*lod_config, file_path + ".lod");
+        });
+        graph.depends_on(lods, load);
+    }
+
+    jobs::run(graph);
+}
+
+void benzene::Batch::generate_lods(const LodConfig& config, const std::string& cache_file){
+    auto key = mesh_simplifier::lod_cache_key(this->meshes, config);
+    if(cache_file.size() > 0){
+        auto cached = mesh_simplifier::read_lod_cache(cache_file, key);
+        if(cached && cached->size() == this->meshes.size()){
+            for(size_t i = 0; i < this->meshes.size(); i++)
+                this->meshes[i].lods = std::move((*cached)[i]);
+
+            print("benzene/Model: Loaded LODs from {:s}\n", cache_file);
+            return;
+        }
+    }
+
+    auto ratios = config.ratios;
+    std::sort(ratios.begin(), ratios.end(), std::greater<float>{});
+
+    // Simplifying a dense mesh takes far longer than loading it, so every mesh gets its own job
+    jobs::parallel_for(0, this->meshes.size(), 1, [&](size_t begin, size_t end){
+        for(size_t i = begin; i < end; i++){
+            auto& mesh = this->meshes[i];
+
+            std::vector<size_t> targets{};
+            for(auto ratio : ratios)
+                targets.push_back((size_t)(mesh.get_indices().size() / 3 * ratio) * 3);
+
+            mesh.lods = mesh_simplifier::build_lod_chain(mesh, targets, config.max_error * mesh_simplifier::mesh_extent(mesh));
+        }
+    });
 
     if constexpr (true){
-        size_t tris = 0;
-        for(const auto& mesh : this->meshes)
-            tris += (mesh.indices.size() / 3);
-        print("benzene/Model: Loaded model with {:d} submesh(es) and {:d} triangles\n", this->meshes.size(), tris);
+        size_t levels = 0, tris = 0;
+        for(const auto& mesh : this->meshes){
+            levels += mesh.lods.size();
+            for(const auto& lod : mesh.lods)
+                tris += (lod.indices.size() / 3);
+        }
+        print("benzene/Model: Generated {:d} LOD(s) with {:d} triangles in total for {:d} submesh(es)\n", levels, tris, this->meshes.size());
     }
+
+    if(cache_file.size() > 0)
+        mesh_simplifier::write_lod_cache(cache_file, key, this->meshes);
 }
 //#include <GLFW/glfw3.h>
 
-benzene::Instance::Instance(const char* name, size_t width, size_t height): width{width}, height{height} {
+benzene::Instance::Instance(const char* name, size_t width, size_t height, const jobs::Config& jobs_config): width{width}, height{height} {
     print("benzene: Starting\n");
 
+    this->scheduler = std::make_unique<jobs::Scheduler>(jobs_config);
+    jobs::set_current(this->scheduler.get());
+
     glfwInit();
 
     #if defined(BENZENE_VULKAN)
@@ -206,10 +535,6 @@ void benzene::Instance::run(std::function<void(benzene::FrameData&)> functor){
 
         ImGui::Render();
         this->backend->frame_update(render_batches, frame_data);
-
-        #ifdef BENZENE_OPENGL
-        Display::instance().swap_buffers();
-        #endif
     }
     this->backend->end_run();
 }
@@ -219,6 +544,8 @@ benzene::Instance::~Instance(){
     Display::instance().clean();
 
     glfwTerminate();
+
+    jobs::set_current(nullptr);
 }
 
 benzene::ModelId benzene::Instance::add_batch(benzene::Batch* model){
@@ -0,0 +1,90 @@
+#include "material_loader.hpp"
+#include "format.hpp"
+
+#include <array>
+#include <chrono>
+#include <optional>
+#include <unordered_map>
+
+using namespace benzene;
+
+namespace {
+    struct Slot {
+        const char* shader_name;
+        Texture::Gamut gamut;
+        Texture::Compression compression;
+    };
+
+    // In the order the maps are listed in Mesh::Material. Specular maps are greyscale and normal maps only need two channels, the shader rebuilds z
+    constexpr std::array<Slot, 3> slots = {{
+        {"diffuse", Texture::Gamut::Srgb, Texture::Compression::Bc7},
+        {"specular", Texture::Gamut::Linear, Texture::Compression::Bc1},
+        {"normal", Texture::Gamut::Linear, Texture::Compression::Bc5}
+    }};
+
+    struct Image {
+        std::string path;
+        size_t slot;
+    };
+
+    std::array<const std::string*, 3> maps(const Mesh::Material& material){
+        return {&material.diffuse_map, &material.specular_map, &material.normal_map};
+    }
+
+    bool wants_textures(const Mesh& mesh){
+        return mesh.textures.empty() && !mesh.material.name.empty();
+    }
+}
+
+void benzene::material_loader::load_textures(const std::string& folder, std::vector<Mesh>& meshes, const TextureConfig& config){
+    auto begin = std::chrono::steady_clock::now();
+
+    // A file is baked once per slot no matter how many meshes use it, every slot compresses and filters it differently
+    std::vector<Image> images{};
+    std::unordered_map<std::string, size_t> image_ids[slots.size()];
+    size_t n_materials = 0;
+    for(const auto& mesh : meshes){
+        if(!wants_textures(mesh))
+            continue;
+
+        n_materials++;
+        auto material_maps = maps(mesh.material);
+        for(size_t k = 0; k < slots.size(); k++)
+            if(!material_maps[k]->empty() && image_ids[k].try_emplace(*material_maps[k], images.size()).second)
+                images.push_back({.path = *material_maps[k], .slot = k});
+    }
+
+    std::vector<std::optional<Texture>> textures(images.size());
+    jobs::parallel_for(0, images.size(), 1, [&](size_t begin, size_t end){
+        for(size_t i = begin; i < end; i++){
+            const auto& slot = slots[images[i].slot];
+            try {
+                // Model textures are the bulk of a scene's texture memory, they only stay on the GPU
+                if(config.compress)
+                    textures[i] = Texture::load_baked(folder + images[i].path, slot.shader_name, slot.gamut, slot.compression, Texture::Residency::ReleaseAfterUpload);
+                else
+                    textures[i] = Texture::load_from_file(folder + images[i].path, slot.shader_name, slot.gamut, Texture::Residency::ReleaseAfterUpload);
+            } catch(const std::exception&){
+                print("benzene/Model: Using the material's colour instead of {:s}\n", images[i].path);
+            }
+        }
+    });
+
+    for(auto& mesh : meshes){
+        if(!wants_textures(mesh))
+            continue;
+
+        auto material_maps = maps(mesh.material);
+        for(size_t k = 0; k < slots.size(); k++){
+            const auto* map = material_maps[k];
+            const auto* texture = map->empty() ? nullptr : &textures[image_ids[k][*map]];
+            if(texture && texture->has_value())
+                mesh.textures.push_back(**texture);
+        }
+    }
+
+    if constexpr (true){
+        auto time = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+        print("benzene/Model: Loaded {:d} texture(s) for {:d} textured submesh(es) in {:.3f} ms\n", images.size(), n_materials, time);
+    }
+}
@@ -0,0 +1,14 @@
+#pragma once
+
+#include <benzene/benzene.hpp>
+
+#include <string>
+#include <vector>
+
+namespace benzene::material_loader
+{
+    // Gives every mesh that came with a material and has no textures yet the diffuse, specular and normal textures its material has maps for.
+    // Every image is loaded once per slot it's used in, in parallel on the job system, and meshes using it share the result. With `config.compress` they're baked
+    // to BC7, BC1 and BC5 respectively. Maps that are missing or fail to decode are left out, backends use the material's colour instead, or a flat normal
+    void load_textures(const std::string& folder, std::vector<Mesh>& meshes, const TextureConfig& config = {});
+} // namespace benzene::material_loader
@@ -0,0 +1,224 @@
+#include "mesh_cache.hpp"
+#include "format.hpp"
+#include "utils.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+using namespace benzene;
+
+namespace {
+    constexpr char magic[8] = {'B', 'Z', 'M', 'E', 'S', 'H', 0, 0};
+    // Bumped whenever the layout or the processing of the meshes changes, so old caches are regenerated
+    constexpr uint32_t version = 3;
+    // Every array starts on a cache line, which also satisfies the alignment of everything stored in them
+    constexpr uint64_t array_alignment = 64;
+
+    struct Header {
+        char magic[8];
+        uint32_t version;
+        // Both depend on how glm pads its vectors, a cache from a differently configured build can't be used in place
+        uint32_t vertex_size, meshlet_size;
+        uint32_t padding;
+        uint64_t source_hash;
+        uint64_t n_meshes;
+    };
+
+    struct StringRef {
+        uint64_t offset, length;
+    };
+
+    // Offsets are from the start of the file
+    struct MeshEntry {
+        uint64_t vertex_offset, vertex_count;
+        uint64_t index_offset, index_count;
+        uint64_t meshlet_offset, meshlet_count;
+        // Material name, then the diffuse, specular and normal map
+        StringRef strings[4];
+        float shininess;
+        float diffuse[3], specular[3];
+        float min[3], max[3];
+        float radius;
+    };
+
+    std::array<const std::string*, 4> material_strings(const Mesh::Material& material){
+        return {&material.name, &material.diffuse_map, &material.specular_map, &material.normal_map};
+    }
+
+    std::array<std::string*, 4> material_strings(Mesh::Material& material){
+        return {&material.name, &material.diffuse_map, &material.specular_map, &material.normal_map};
+    }
+
+    uint64_t align_up(uint64_t offset){
+        return (offset + array_alignment - 1) / array_alignment * array_alignment;
+    }
+}
+
+Mesh::Bounds benzene::mesh_cache::compute_bounds(const Mesh& mesh){
+    auto vertices = mesh.get_vertices();
+    if(vertices.size() == 0)
+        return {.min = glm::vec3{0.0f}, .max = glm::vec3{0.0f}, .radius = 0.0f};
+
+    Mesh::Bounds bounds{.min = vertices[0].pos, .max = vertices[0].pos, .radius = 0.0f};
+    float max_distance2 = 0.0f;
+    for(const auto& vertex : vertices){
+        bounds.min = glm::min(bounds.min, vertex.pos);
+        bounds.max = glm::max(bounds.max, vertex.pos);
+        max_distance2 = std::max(max_distance2, glm::dot(vertex.pos, vertex.pos));
+    }
+    bounds.radius = std::sqrt(max_distance2);
+
+    return bounds;
+}
+
+std::optional<std::vector<Mesh>> benzene::mesh_cache::read(const std::string& path, uint64_t source_hash){
+    std::shared_ptr<MappedFile> file;
+    try {
+        file = std::make_shared<MappedFile>(path);
+    } catch(const std::exception&){
+        return std::nullopt;
+    }
+
+    const auto* base = file->data();
+    auto size = file->size();
+    auto in_file = [size](uint64_t offset, uint64_t count, uint64_t element_size){
+        return offset <= size && count <= (size - offset) / element_size;
+    };
+
+    Header header{};
+    if(size < sizeof(Header))
+        return std::nullopt;
+    std::memcpy(&header, base, sizeof(Header));
+
+    if(!std::equal(header.magic, header.magic + 8, magic) || header.version != version || header.source_hash != source_hash)
+        return std::nullopt;
+
+    if(header.vertex_size != sizeof(Mesh::Vertex) || header.meshlet_size != sizeof(Mesh::Meshlet) || !in_file(sizeof(Header), header.n_meshes, sizeof(MeshEntry)))
+        return std::nullopt;
+
+    std::vector<Mesh> meshes(header.n_meshes);
+    for(size_t i = 0; i < meshes.size(); i++){
+        MeshEntry entry{};
+        std::memcpy(&entry, base + sizeof(Header) + i * sizeof(MeshEntry), sizeof(MeshEntry));
+
+        bool valid = in_file(entry.vertex_offset, entry.vertex_count, sizeof(Mesh::Vertex)) && in_file(entry.index_offset, entry.index_count, sizeof(uint32_t)) &&
+                     in_file(entry.meshlet_offset, entry.meshlet_count, sizeof(Mesh::Meshlet));
+        for(const auto& string : entry.strings)
+            valid = valid && in_file(string.offset, string.length, 1);
+        if(!valid || (entry.vertex_offset % alignof(Mesh::Vertex)) != 0 || (entry.index_offset % alignof(uint32_t)) != 0){
+            print("benzene/Model: Ignoring damaged mesh cache {:s}\n", path);
+            return std::nullopt;
+        }
+
+        auto& mesh = meshes[i];
+        mesh.mapping = file;
+        mesh.mapped_vertices = {(const Mesh::Vertex*)(base + entry.vertex_offset), entry.vertex_count};
+        mesh.mapped_indices = {(const uint32_t*)(base + entry.index_offset), entry.index_count};
+
+        // Meshlets are small and the backends keep their own copy anyway
+        mesh.meshlets.resize(entry.meshlet_count);
+        std::memcpy(mesh.meshlets.data(), base + entry.meshlet_offset, entry.meshlet_count * sizeof(Mesh::Meshlet));
+
+        mesh.material.shininess = entry.shininess;
+        mesh.material.diffuse = {entry.diffuse[0], entry.diffuse[1], entry.diffuse[2]};
+        mesh.material.specular = {entry.specular[0], entry.specular[1], entry.specular[2]};
+        auto strings = material_strings(mesh.material);
+        for(size_t k = 0; k < strings.size(); k++)
+            strings[k]->assign((const char*)(base + entry.strings[k].offset), entry.strings[k].length);
+        mesh.bounds = Mesh::Bounds{.min = {entry.min[0], entry.min[1], entry.min[2]}, .max = {entry.max[0], entry.max[1], entry.max[2]}, .radius = entry.radius};
+    }
+
+    return meshes;
+}
+
+void benzene::mesh_cache::write(const std::string& path, uint64_t source_hash, const std::vector<Mesh>& meshes){
+    Header header{};
+    std::copy(magic, magic + 8, header.magic);
+    header.version = version;
+    header.vertex_size = sizeof(Mesh::Vertex);
+    header.meshlet_size = sizeof(Mesh::Meshlet);
+    header.source_hash = source_hash;
+    header.n_meshes = meshes.size();
+
+    // Material strings go right after the table, then every mesh's arrays
+    std::vector<MeshEntry> entries(meshes.size());
+    uint64_t offset = sizeof(Header) + meshes.size() * sizeof(MeshEntry);
+    for(size_t i = 0; i < meshes.size(); i++){
+        auto strings = material_strings(meshes[i].material);
+        for(size_t k = 0; k < strings.size(); k++){
+            entries[i].strings[k] = {.offset = offset, .length = strings[k]->size()};
+            offset += strings[k]->size();
+        }
+    }
+
+    for(size_t i = 0; i < meshes.size(); i++){
+        const auto& mesh = meshes[i];
+        auto& entry = entries[i];
+
+        entry.vertex_offset = offset = align_up(offset);
+        entry.vertex_count = mesh.get_vertices().size();
+        offset += entry.vertex_count * sizeof(Mesh::Vertex);
+
+        entry.index_offset = offset = align_up(offset);
+        entry.index_count = mesh.get_indices().size();
+        offset += entry.index_count * sizeof(uint32_t);
+
+        entry.meshlet_offset = offset = align_up(offset);
+        entry.meshlet_count = mesh.meshlets.size();
+        offset += entry.meshlet_count * sizeof(Mesh::Meshlet);
+
+        auto bounds = mesh.bounds ? *mesh.bounds : compute_bounds(mesh);
+        entry.shininess = mesh.material.shininess;
+        for(int k = 0; k < 3; k++){
+            entry.diffuse[k] = mesh.material.diffuse[k];
+            entry.specular[k] = mesh.material.specular[k];
+            entry.min[k] = bounds.min[k];
+            entry.max[k] = bounds.max[k];
+        }
+        entry.radius = bounds.radius;
+    }
+
+    // Written next to the cache and then moved over it, so a reader never maps a half written file
+    auto temporary_path = path + ".tmp";
+    std::ofstream file{temporary_path, std::ios::binary | std::ios::trunc};
+    if(!file.is_open()){
+        print("benzene/Model: Failed to open mesh cache {:s} for writing\n", path);
+        return;
+    }
+
+    uint64_t written = 0;
+    auto write = [&file, &written](const void* data, uint64_t size){
+        file.write((const char*)data, size);
+        written += size;
+    };
+    auto pad_to = [&](uint64_t target){
+        constexpr char zeros[array_alignment] = {};
+        write(zeros, target - written);
+    };
+
+    write(&header, sizeof(Header));
+    write(entries.data(), entries.size() * sizeof(MeshEntry));
+    for(const auto& mesh : meshes)
+        for(const auto* string : material_strings(mesh.material))
+            write(string->data(), string->size());
+
+    for(size_t i = 0; i < meshes.size(); i++){
+        const auto& mesh = meshes[i];
+        pad_to(entries[i].vertex_offset);
+        write(mesh.get_vertices().data(), entries[i].vertex_count * sizeof(Mesh::Vertex));
+        pad_to(entries[i].index_offset);
+        write(mesh.get_indices().data(), entries[i].index_count * sizeof(uint32_t));
+        pad_to(entries[i].meshlet_offset);
+        write(mesh.meshlets.data(), entries[i].meshlet_count * sizeof(Mesh::Meshlet));
+    }
+
+    file.close();
+    if(!file || std::rename(temporary_path.c_str(), path.c_str()) != 0){
+        print("benzene/Model: Failed to write mesh cache {:s}\n", path);
+        std::remove(temporary_path.c_str());
+    }
+}
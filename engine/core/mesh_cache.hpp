@@ -0,0 +1,27 @@
+#pragma once
+
+#include <benzene/benzene.hpp>
+
+#include <optional>
+#include <string>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+namespace benzene::mesh_cache
+{
+    // The .bzm file belonging to a model file
+    inline std::string path_for(const std::string& model_path){
+        return model_path + ".bzm";
+    }
+
+    // Bounds of the mesh's vertices, as stored in the cache
+    Mesh::Bounds compute_bounds(const Mesh& mesh);
+
+    // Maps `path` and returns its meshes if it was written for a model with `source_hash`, the benzene::content_hash of the model file combined with its material libraries, without copying any vertices or full detail indices,
+    // they point straight into the mapping. Missing, stale or damaged caches return nothing
+    std::optional<std::vector<Mesh>> read(const std::string& path, uint64_t source_hash);
+    // Writes the vertices, full detail indices, meshlets, material and bounds of every mesh, textures and LODs are left out.
+    // Materials keep their map paths, so textures can be loaded again without the material library
+    void write(const std::string& path, uint64_t source_hash, const std::vector<Mesh>& meshes);
+} // namespace benzene::mesh_cache
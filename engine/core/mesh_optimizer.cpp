@@ -0,0 +1,385 @@
+#include "mesh_optimizer.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <limits>
+#include <numeric>
+#include <unordered_map>
+
+using namespace benzene::mesh_optimizer;
+
+CacheStats benzene::mesh_optimizer::analyze_vertex_cache(const std::vector<uint32_t>& indices, size_t vertex_count, size_t cache_size){
+    // A vertex is in the cache if it was loaded less than cache_size misses ago
+    std::vector<size_t> loaded_at(vertex_count, 0);
+    size_t misses = 0;
+    for(auto index : indices){
+        if(loaded_at[index] == 0 || (misses + 1 - loaded_at[index]) > cache_size){
+            misses++;
+            loaded_at[index] = misses;
+        }
+    }
+
+    auto n_triangles = indices.size() / 3;
+    return {
+        .acmr = (n_triangles > 0) ? (float)misses / n_triangles : 0.0f,
+        .atvr = (vertex_count > 0) ? (float)misses / vertex_count : 0.0f
+    };
+}
+
+void benzene::mesh_optimizer::deduplicate(const std::vector<Mesh::Vertex>& corners, Mesh& mesh){
+    // Corners are bucketed by hash so every shard owns a disjoint set of vertices and can be deduplicated without locks.
+    // The bucketing is a stable counting sort over blocks, which keeps the result independent of the number of workers
+    constexpr size_t n_shards = 64, block_size = 1 << 16;
+    auto n = corners.size();
+    auto n_blocks = (n + block_size - 1) / block_size;
+
+    std::vector<uint8_t> shard_of(n);
+    std::vector<std::array<size_t, n_shards>> block_offsets(n_blocks);
+    jobs::parallel_for(0, n_blocks, 1, [&](size_t begin, size_t end){
+        std::hash<Mesh::Vertex> hasher{};
+        for(size_t block = begin; block < end; block++){
+            auto& counts = block_offsets[block];
+            counts.fill(0);
+            for(size_t i = block * block_size; i < std::min(n, (block + 1) * block_size); i++){
+                // The top bits of a multiplicative hash, the low bits of std::hash for floats are poorly distributed
+                shard_of[i] = (uint8_t)((hasher(corners[i]) * 0x9e3779b97f4a7c15) >> 58);
+                counts[shard_of[i]]++;
+            }
+        }
+    });
+
+    std::array<size_t, n_shards + 1> shard_begin{};
+    for(size_t shard = 0; shard < n_shards; shard++){
+        shard_begin[shard + 1] = shard_begin[shard];
+        for(size_t block = 0; block < n_blocks; block++){
+            auto count = block_offsets[block][shard];
+            block_offsets[block][shard] = shard_begin[shard + 1];
+            shard_begin[shard + 1] += count;
+        }
+    }
+
+    std::vector<uint32_t> order(n);
+    jobs::parallel_for(0, n_blocks, 1, [&](size_t begin, size_t end){
+        for(size_t block = begin; block < end; block++){
+            auto offsets = block_offsets[block];
+            for(size_t i = block * block_size; i < std::min(n, (block + 1) * block_size); i++)
+                order[offsets[shard_of[i]]++] = i;
+        }
+    });
+
+    // Every corner gets an index local to its shard, the shards' unique vertices are laid out one after another
+    std::vector<uint32_t> local_index(n);
+    std::array<std::vector<uint32_t>, n_shards> unique{};
+    jobs::parallel_for(0, n_shards, 1, [&](size_t begin, size_t end){
+        for(size_t shard = begin; shard < end; shard++){
+            std::unordered_map<Mesh::Vertex, uint32_t> indices{};
+            indices.reserve(shard_begin[shard + 1] - shard_begin[shard]);
+            for(size_t j = shard_begin[shard]; j < shard_begin[shard + 1]; j++){
+                auto corner = order[j];
+                auto [it, inserted] = indices.try_emplace(corners[corner], unique[shard].size());
+                if(inserted)
+                    unique[shard].push_back(corner);
+                local_index[corner] = it->second;
+            }
+        }
+    });
+
+    std::array<uint32_t, n_shards + 1> vertex_begin{};
+    for(size_t shard = 0; shard < n_shards; shard++)
+        vertex_begin[shard + 1] = vertex_begin[shard] + unique[shard].size();
+
+    mesh.vertices.resize(vertex_begin[n_shards]);
+    mesh.indices.resize(n);
+    jobs::parallel_for(0, n_shards, 1, [&](size_t begin, size_t end){
+        for(size_t shard = begin; shard < end; shard++)
+            for(size_t j = 0; j < unique[shard].size(); j++)
+                mesh.vertices[vertex_begin[shard] + j] = corners[unique[shard][j]];
+    });
+
+    jobs::parallel_for(0, n, block_size, [&](size_t begin, size_t end){
+        for(size_t i = begin; i < end; i++)
+            mesh.indices[i] = vertex_begin[shard_of[i]] + local_index[i];
+    });
+}
+
+namespace {
+    // Forsyth's cache is an LRU that is a little larger than the real FIFO, scores are tabulated since they only depend on small integers
+    constexpr size_t forsyth_cache_size = 32;
+    constexpr size_t max_valence_score = 32;
+
+    struct ForsythScores {
+        std::array<float, forsyth_cache_size> cache;
+        std::array<float, max_valence_score> valence;
+
+        ForsythScores(){
+            constexpr float decay_power = 1.5f, last_triangle_score = 0.75f;
+            constexpr float valence_scale = 2.0f, valence_power = 0.5f;
+
+            for(size_t i = 0; i < forsyth_cache_size; i++){
+                // The 3 most recent vertices belong to the triangle just emitted, using them again right away isn't worth much extra
+                if(i < 3)
+                    cache[i] = last_triangle_score;
+                else
+                    cache[i] = std::pow(1.0f - (float)(i - 3) / (forsyth_cache_size - 3), decay_power);
+            }
+
+            valence[0] = 0.0f;
+            for(size_t i = 1; i < max_valence_score; i++)
+                valence[i] = valence_scale * std::pow((float)i, -valence_power);
+        }
+
+        float operator()(int cache_position, uint32_t remaining) const {
+            if(remaining == 0)
+                return -1.0f; // Nothing left to draw with it
+
+            float score = (cache_position >= 0) ? cache[cache_position] : 0.0f;
+            return score + valence[std::min<size_t>(remaining, max_valence_score - 1)];
+        }
+    };
+}
+
+void benzene::mesh_optimizer::optimize_vertex_cache(std::vector<uint32_t>& indices, size_t vertex_count){
+    static const ForsythScores score{};
+    auto n_triangles = indices.size() / 3;
+    if(n_triangles == 0)
+        return;
+
+    // Triangles using each vertex, the first `remaining[v]` entries of a vertex's range are the ones not emitted yet
+    std::vector<uint32_t> offsets(vertex_count + 1, 0), remaining(vertex_count, 0);
+    for(auto index : indices)
+        remaining[index]++;
+    for(size_t v = 0; v < vertex_count; v++)
+        offsets[v + 1] = offsets[v] + remaining[v];
+
+    std::vector<uint32_t> adjacency(indices.size());
+    {
+        std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+        for(size_t t = 0; t < n_triangles; t++)
+            for(int k = 0; k < 3; k++)
+                adjacency[fill[indices[t * 3 + k]]++] = t;
+    }
+
+    std::vector<int> cache_position(vertex_count, -1);
+    std::vector<float> vertex_score(vertex_count);
+    for(size_t v = 0; v < vertex_count; v++)
+        vertex_score[v] = score(-1, remaining[v]);
+
+    std::vector<float> triangle_score(n_triangles);
+    std::vector<bool> emitted(n_triangles, false);
+    for(size_t t = 0; t < n_triangles; t++)
+        triangle_score[t] = vertex_score[indices[t * 3]] + vertex_score[indices[t * 3 + 1]] + vertex_score[indices[t * 3 + 2]];
+
+    std::vector<uint32_t> cache{}, next_cache{};
+    cache.reserve(forsyth_cache_size + 3);
+    next_cache.reserve(forsyth_cache_size + 3);
+
+    std::vector<uint32_t> out{};
+    out.reserve(indices.size());
+
+    size_t best = std::max_element(triangle_score.begin(), triangle_score.end()) - triangle_score.begin();
+    size_t cursor = 0;
+    for(size_t emitted_count = 0; emitted_count < n_triangles; emitted_count++){
+        if(best == n_triangles){
+            // Nothing in the cache has triangles left, continue with the next triangle in the input order
+            while(emitted[cursor])
+                cursor++;
+            best = cursor;
+        }
+
+        const uint32_t* tri = &indices[best * 3];
+        emitted[best] = true;
+        out.insert(out.end(), tri, tri + 3);
+
+        for(int k = 0; k < 3; k++){
+            auto v = tri[k];
+            auto begin = adjacency.begin() + offsets[v];
+            auto end = begin + remaining[v];
+            std::iter_swap(std::find(begin, end, (uint32_t)best), end - 1);
+            remaining[v]--;
+        }
+
+        // The triangle's vertices move to the front, everything else shifts back and whatever falls off the end is evicted
+        next_cache.assign(tri, tri + 3);
+        for(auto v : cache)
+            if(v != tri[0] && v != tri[1] && v != tri[2])
+                next_cache.push_back(v);
+
+        for(size_t i = forsyth_cache_size; i < next_cache.size(); i++)
+            cache_position[next_cache[i]] = -1;
+        next_cache.resize(std::min(next_cache.size(), forsyth_cache_size));
+
+        for(size_t i = 0; i < next_cache.size(); i++)
+            cache_position[next_cache[i]] = i;
+
+        // Rescore everything whose cache position changed and pick the best triangle reachable from the cache
+        auto rescore = [&](uint32_t v){
+            auto new_score = score(cache_position[v], remaining[v]);
+            auto delta = new_score - vertex_score[v];
+            vertex_score[v] = new_score;
+            for(size_t i = offsets[v]; i < offsets[v] + remaining[v]; i++)
+                triangle_score[adjacency[i]] += delta;
+        };
+
+        for(auto v : cache)
+            if(cache_position[v] < 0)
+                rescore(v);
+        for(auto v : next_cache)
+            rescore(v);
+
+        best = n_triangles;
+        float best_score = -std::numeric_limits<float>::max();
+        for(auto v : next_cache){
+            for(size_t i = offsets[v]; i < offsets[v] + remaining[v]; i++){
+                auto t = adjacency[i];
+                if(triangle_score[t] > best_score){
+                    best_score = triangle_score[t];
+                    best = t;
+                }
+            }
+        }
+
+        std::swap(cache, next_cache);
+    }
+
+    indices = std::move(out);
+}
+
+void benzene::mesh_optimizer::optimize_overdraw(std::vector<uint32_t>& indices, const std::vector<Mesh::Vertex>& vertices, float threshold){
+    auto n_triangles = indices.size() / 3;
+    if(n_triangles < 2)
+        return;
+
+    // Hard boundaries are where the cache order starts over anyway, every vertex of the triangle misses
+    std::vector<size_t> hard_boundaries{0};
+    {
+        std::vector<size_t> loaded_at(vertices.size(), 0);
+        size_t misses = 0;
+        for(size_t t = 0; t < n_triangles; t++){
+            size_t triangle_misses = 0;
+            for(int k = 0; k < 3; k++){
+                auto v = indices[t * 3 + k];
+                if(loaded_at[v] == 0 || (misses + 1 - loaded_at[v]) > default_cache_size){
+                    loaded_at[v] = ++misses;
+                    triangle_misses++;
+                }
+            }
+
+            if(triangle_misses == 3 && t > 0)
+                hard_boundaries.push_back(t);
+        }
+    }
+    hard_boundaries.push_back(n_triangles);
+
+    // Soft boundaries split hard clusters further, wherever the part since the last split is already cheap enough on its own
+    // Every simulated miss gets the next stamp. Moving the clock past the cache size starts a cold cache without clearing anything, which keeps this linear in the number of triangles
+    std::vector<size_t> loaded_at(vertices.size(), 0);
+    size_t clock = 0;
+    auto cold_start = [&]{
+        clock += default_cache_size + 1;
+    };
+    auto load = [&](uint32_t v) -> size_t {
+        if(loaded_at[v] == 0 || (clock + 1 - loaded_at[v]) > default_cache_size){
+            loaded_at[v] = ++clock;
+            return 1;
+        }
+        return 0;
+    };
+
+    std::vector<size_t> clusters{};
+    for(size_t c = 0; c + 1 < hard_boundaries.size(); c++){
+        auto begin = hard_boundaries[c], end = hard_boundaries[c + 1];
+
+        cold_start();
+        size_t cluster_misses = 0;
+        for(size_t i = begin * 3; i < end * 3; i++)
+            cluster_misses += load(indices[i]);
+        auto target = ((float)cluster_misses / (end - begin)) * threshold;
+
+        clusters.push_back(begin);
+
+        size_t misses = 0, start = begin;
+        cold_start();
+        for(size_t t = begin; t < end; t++){
+            for(int k = 0; k < 3; k++)
+                misses += load(indices[t * 3 + k]);
+
+            auto n = t + 1 - start;
+            if((t + 1) < end && n >= 8 && (float)misses / n <= target){
+                // Starting the next cluster with a cold cache is what drawing it somewhere else would cost
+                clusters.push_back(t + 1);
+                start = t + 1;
+                cold_start();
+                misses = 0;
+            }
+        }
+    }
+    clusters.push_back(n_triangles);
+
+    // Clusters whose average normal points away from the middle of the mesh are likely in front of the ones that don't
+    glm::vec3 mesh_centroid{0.0f};
+    for(const auto& vertex : vertices)
+        mesh_centroid += vertex.pos;
+    mesh_centroid /= (float)std::max<size_t>(vertices.size(), 1);
+
+    auto n_clusters = clusters.size() - 1;
+    std::vector<float> sort_keys(n_clusters);
+    for(size_t c = 0; c < n_clusters; c++){
+        glm::vec3 centroid{0.0f}, normal{0.0f};
+        float area = 0.0f;
+        for(size_t t = clusters[c]; t < clusters[c + 1]; t++){
+            const auto& p0 = vertices[indices[t * 3]].pos;
+            const auto& p1 = vertices[indices[t * 3 + 1]].pos;
+            const auto& p2 = vertices[indices[t * 3 + 2]].pos;
+
+            auto n = glm::cross(p1 - p0, p2 - p0); // Length is twice the area
+            auto a = glm::length(n);
+            centroid += (p0 + p1 + p2) * (a / 3.0f);
+            normal += n;
+            area += a;
+        }
+
+        if(area > 0.0f)
+            centroid /= area;
+        auto normal_length = glm::length(normal);
+        sort_keys[c] = (normal_length > 0.0f) ? glm::dot(centroid - mesh_centroid, normal / normal_length) : 0.0f;
+    }
+
+    std::vector<size_t> order(n_clusters);
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b){ return sort_keys[a] > sort_keys[b]; });
+
+    std::vector<uint32_t> out{};
+    out.reserve(indices.size());
+    for(auto c : order)
+        out.insert(out.end(), indices.begin() + clusters[c] * 3, indices.begin() + clusters[c + 1] * 3);
+
+    indices = std::move(out);
+}
+
+void benzene::mesh_optimizer::optimize_vertex_fetch(std::vector<Mesh::Vertex>& vertices, std::vector<uint32_t>& indices){
+    constexpr uint32_t unmapped = std::numeric_limits<uint32_t>::max();
+    std::vector<uint32_t> remap(vertices.size(), unmapped);
+    std::vector<Mesh::Vertex> out{};
+    out.reserve(vertices.size());
+
+    for(auto& index : indices){
+        if(remap[index] == unmapped){
+            remap[index] = out.size();
+            out.push_back(vertices[index]);
+        }
+        index = remap[index];
+    }
+
+    vertices = std::move(out);
+}
+
+std::pair<CacheStats, CacheStats> benzene::mesh_optimizer::optimize(Mesh& mesh){
+    auto before = analyze_vertex_cache(mesh.indices, mesh.vertices.size());
+
+    optimize_vertex_cache(mesh.indices, mesh.vertices.size());
+    optimize_overdraw(mesh.indices, mesh.vertices);
+    optimize_vertex_fetch(mesh.vertices, mesh.indices);
+
+    return {before, analyze_vertex_cache(mesh.indices, mesh.vertices.size())};
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <benzene/benzene.hpp>
+
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+namespace benzene::mesh_optimizer
+{
+    // Simulated FIFO post-transform cache, roughly what current GPUs behave like
+    constexpr size_t default_cache_size = 16;
+
+    struct CacheStats {
+        float acmr; // Average cache miss ratio, vertex shader runs per triangle, 0.5 is the ideal for large grids
+        float atvr; // Average transformed vertex ratio, vertex shader runs per vertex, 1.0 is ideal
+    };
+    CacheStats analyze_vertex_cache(const std::vector<uint32_t>& indices, size_t vertex_count, size_t cache_size = default_cache_size);
+
+    // Merges identical corners into mesh.vertices and writes one index per corner into mesh.indices, hashing in parallel shards.
+    // The vertex order depends on the hash, optimize_vertex_fetch puts them back in order of first use
+    void deduplicate(const std::vector<Mesh::Vertex>& corners, Mesh& mesh);
+
+    // Reorders triangles for post-transform cache locality, Tom Forsyth's linear-speed vertex cache optimisation
+    void optimize_vertex_cache(std::vector<uint32_t>& indices, size_t vertex_count);
+
+    // Splits the triangles into clusters that cost at most `threshold` times the ACMR of the current order and puts clusters facing
+    // outwards first, so they tend to be drawn before what they occlude. Should run after optimize_vertex_cache
+    void optimize_overdraw(std::vector<uint32_t>& indices, const std::vector<Mesh::Vertex>& vertices, float threshold = 1.05f);
+
+    // Renumbers vertices in the order the indices first reference them, unreferenced vertices are dropped
+    void optimize_vertex_fetch(std::vector<Mesh::Vertex>& vertices, std::vector<uint32_t>& indices);
+
+    // All of the above in order, returns the cache stats from before and after
+    std::pair<CacheStats, CacheStats> optimize(Mesh& mesh);
+} // namespace benzene::mesh_optimizer
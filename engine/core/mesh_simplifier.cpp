@@ -0,0 +1,465 @@
+#include "mesh_simplifier.hpp"
+#include "mesh_optimizer.hpp"
+#include "format.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <numeric>
+
+using namespace benzene;
+
+namespace {
+    // Sum of squared distances to a set of planes, each weighted by the area of the triangle it came from
+    struct Quadric {
+        double a2 = 0.0, b2 = 0.0, c2 = 0.0, ab = 0.0, ac = 0.0, bc = 0.0, ad = 0.0, bd = 0.0, cd = 0.0, d2 = 0.0;
+        double weight = 0.0;
+
+        static Quadric from_triangle(const glm::vec3& p0, const glm::vec3& p1, const glm::vec3& p2){
+            double e1[3] = {(double)p1.x - p0.x, (double)p1.y - p0.y, (double)p1.z - p0.z};
+            double e2[3] = {(double)p2.x - p0.x, (double)p2.y - p0.y, (double)p2.z - p0.z};
+            double n[3] = {e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0]};
+
+            auto length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+            if(length == 0.0)
+                return {};
+
+            double a = n[0] / length, b = n[1] / length, c = n[2] / length;
+            double d = -(a * p0.x + b * p0.y + c * p0.z);
+            double area = length * 0.5;
+
+            Quadric q{};
+            q.a2 = a * a * area; q.b2 = b * b * area; q.c2 = c * c * area;
+            q.ab = a * b * area; q.ac = a * c * area; q.bc = b * c * area;
+            q.ad = a * d * area; q.bd = b * d * area; q.cd = c * d * area;
+            q.d2 = d * d * area;
+            q.weight = area;
+            return q;
+        }
+
+        Quadric& operator+=(const Quadric& other){
+            a2 += other.a2; b2 += other.b2; c2 += other.c2;
+            ab += other.ab; ac += other.ac; bc += other.bc;
+            ad += other.ad; bd += other.bd; cd += other.cd;
+            d2 += other.d2;
+            weight += other.weight;
+            return *this;
+        }
+
+        // Mean squared distance of `p` to the planes
+        double error(const glm::vec3& p) const {
+            if(weight <= 0.0)
+                return 0.0;
+
+            double x = p.x, y = p.y, z = p.z;
+            double e = a2 * x * x + b2 * y * y + c2 * z * z + 2.0 * (ab * x * y + ac * x * z + bc * y * z + ad * x + bd * y + cd * z) + d2;
+            return std::max(e, 0.0) / weight;
+        }
+    };
+
+    struct Collapse {
+        double error;
+        uint32_t from, to; // Position classes
+    };
+}
+
+std::vector<Mesh::Lod> benzene::mesh_simplifier::build_lod_chain(const Mesh& mesh, const std::vector<size_t>& target_index_counts, float max_error){
+    std::vector<Mesh::Lod> lods{};
+    auto vertices = mesh.get_vertices();
+    auto mesh_indices = mesh.get_indices();
+    auto n_vertices = vertices.size();
+    if(mesh_indices.size() < 3 || target_index_counts.size() == 0)
+        return lods;
+
+    // Vertices at the same position but with different normals or uvs are the same corner of the surface, everything works on these classes
+    std::vector<uint32_t> order(n_vertices);
+    std::iota(order.begin(), order.end(), 0);
+    auto position_less = [&](uint32_t a, uint32_t b){
+        const auto& pa = vertices[a].pos;
+        const auto& pb = vertices[b].pos;
+        return (pa.x != pb.x) ? (pa.x < pb.x) : (pa.y != pb.y) ? (pa.y < pb.y) : (pa.z < pb.z);
+    };
+    std::sort(order.begin(), order.end(), position_less);
+
+    std::vector<uint32_t> class_of(n_vertices);
+    std::vector<glm::vec3> class_pos{};
+    std::vector<uint32_t> wedges{};
+    for(size_t i = 0; i < n_vertices; i++){
+        auto v = order[i];
+        if(i == 0 || vertices[order[i - 1]].pos != vertices[v].pos){
+            class_pos.push_back(vertices[v].pos);
+            wedges.push_back(0);
+        }
+        class_of[v] = class_pos.size() - 1;
+        wedges.back()++;
+    }
+    auto n_classes = class_pos.size();
+
+    // Triangles that are already degenerate would confuse the edge counts below
+    std::vector<uint32_t> indices{};
+    indices.reserve(mesh_indices.size());
+    for(size_t t = 0; t + 2 < mesh_indices.size(); t += 3){
+        auto c0 = class_of[mesh_indices[t]], c1 = class_of[mesh_indices[t + 1]], c2 = class_of[mesh_indices[t + 2]];
+        if(c0 != c1 && c1 != c2 && c0 != c2)
+            indices.insert(indices.end(), mesh_indices.begin() + t, mesh_indices.begin() + t + 3);
+    }
+
+    std::vector<Quadric> quadrics(n_classes);
+    for(size_t t = 0; t < indices.size(); t += 3){
+        auto q = Quadric::from_triangle(class_pos[class_of[indices[t]]], class_pos[class_of[indices[t + 1]]], class_pos[class_of[indices[t + 2]]]);
+        for(int k = 0; k < 3; k++)
+            quadrics[class_of[indices[t + k]]] += q;
+    }
+
+    // Only classes inside a manifold patch with a single set of attributes move, open borders, non-manifold edges and seams stay where they are
+    std::vector<uint8_t> movable(n_classes, 1);
+    {
+        std::vector<uint64_t> edges{};
+        edges.reserve(indices.size());
+        for(size_t t = 0; t < indices.size(); t += 3){
+            for(int k = 0; k < 3; k++){
+                auto a = class_of[indices[t + k]], b = class_of[indices[t + (k + 1) % 3]];
+                edges.push_back(((uint64_t)std::min(a, b) << 32) | std::max(a, b));
+            }
+        }
+        std::sort(edges.begin(), edges.end());
+
+        for(size_t i = 0; i < edges.size();){
+            size_t n = 1;
+            while((i + n) < edges.size() && edges[i + n] == edges[i])
+                n++;
+
+            if(n != 2)
+                movable[edges[i] >> 32] = movable[edges[i] & 0xFFFFFFFF] = 0;
+            i += n;
+        }
+
+        for(size_t c = 0; c < n_classes; c++)
+            if(wedges[c] != 1)
+                movable[c] = 0;
+    }
+
+    const double max_error2 = (double)max_error * max_error;
+    double error2 = 0.0;
+
+    std::vector<uint32_t> offsets{}, adjacency{};
+    std::vector<Collapse> collapses{}, best{};
+    std::vector<uint8_t> touched{}, dead{};
+    std::vector<uint32_t> neighbours_from{}, neighbours_to{};
+
+    // Returns the vertex that takes over the triangles of `from`, or nothing if collapsing would flip triangles or tear the surface
+    auto check_collapse = [&](uint32_t from, uint32_t to) -> std::optional<uint32_t> {
+        std::optional<uint32_t> target{};
+        size_t shared = 0;
+        neighbours_from.clear();
+        neighbours_to.clear();
+
+        for(size_t i = offsets[from]; i < offsets[from + 1]; i++){
+            const auto* tri = &indices[adjacency[i] * 3];
+
+            bool has_to = false;
+            int corner = 0;
+            for(int k = 0; k < 3; k++){
+                auto c = class_of[tri[k]];
+                if(c == from){
+                    corner = k;
+                } else {
+                    neighbours_from.push_back(c);
+                    if(c == to){
+                        // Both triangles along the edge have to agree on the attributes of `to`, otherwise `from` sits next to a seam
+                        if(target && *target != tri[k])
+                            return std::nullopt;
+                        target = tri[k];
+                        has_to = true;
+                    }
+                }
+            }
+
+            if(has_to){
+                shared++;
+                continue;
+            }
+
+            glm::vec3 p[3] = {class_pos[class_of[tri[0]]], class_pos[class_of[tri[1]]], class_pos[class_of[tri[2]]]};
+            auto before = glm::cross(p[1] - p[0], p[2] - p[0]);
+            p[corner] = class_pos[to];
+            auto after = glm::cross(p[1] - p[0], p[2] - p[0]);
+            if(glm::dot(before, after) <= 0.25f * glm::length(before) * glm::length(after))
+                return std::nullopt;
+        }
+
+        if(shared != 2 || !target)
+            return std::nullopt;
+
+        // Link condition, the edge's endpoints may only share the two vertices opposite of it or the collapse pinches the surface
+        for(size_t i = offsets[to]; i < offsets[to + 1]; i++)
+            for(int k = 0; k < 3; k++)
+                if(auto c = class_of[indices[adjacency[i] * 3 + k]]; c != to)
+                    neighbours_to.push_back(c);
+
+        std::sort(neighbours_from.begin(), neighbours_from.end());
+        neighbours_from.erase(std::unique(neighbours_from.begin(), neighbours_from.end()), neighbours_from.end());
+        std::sort(neighbours_to.begin(), neighbours_to.end());
+        neighbours_to.erase(std::unique(neighbours_to.begin(), neighbours_to.end()), neighbours_to.end());
+
+        size_t common = 0;
+        for(size_t i = 0, j = 0; i < neighbours_from.size() && j < neighbours_to.size();){
+            if(neighbours_from[i] < neighbours_to[j]) i++;
+            else if(neighbours_to[j] < neighbours_from[i]) j++;
+            else { common++; i++; j++; }
+        }
+
+        return (common == 2) ? target : std::nullopt;
+    };
+
+    auto previous_index_count = indices.size();
+    for(size_t level = 0; level < target_index_counts.size();){
+        auto target_triangles = target_index_counts[level] / 3;
+        if(indices.size() / 3 <= target_triangles){
+            if(indices.size() < previous_index_count)
+                lods.push_back({.indices = indices, .error = (float)std::sqrt(error2)});
+            previous_index_count = std::min(previous_index_count, indices.size());
+            level++;
+            continue;
+        }
+
+        // Triangles around every class, rebuilt every pass since collapses move triangles between classes
+        offsets.assign(n_classes + 1, 0);
+        for(auto index : indices)
+            offsets[class_of[index] + 1]++;
+        std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+
+        adjacency.resize(indices.size());
+        {
+            std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+            for(size_t i = 0; i < indices.size(); i++)
+                adjacency[fill[class_of[indices[i]]]++] = i / 3;
+        }
+
+        // Only the cheapest edge of every class is a candidate, the others get their turn in later passes
+        best.assign(n_classes, {.error = std::numeric_limits<double>::max(), .from = 0, .to = 0});
+        for(size_t t = 0; t < indices.size(); t += 3){
+            for(int k = 0; k < 3; k++){
+                auto from = class_of[indices[t + k]];
+                if(!movable[from])
+                    continue;
+
+                for(int j = 1; j < 3; j++){
+                    auto to = class_of[indices[t + (k + j) % 3]];
+                    auto q = quadrics[from];
+                    q += quadrics[to];
+
+                    auto error = q.error(class_pos[to]);
+                    if(error < best[from].error)
+                        best[from] = {.error = error, .from = from, .to = to};
+                }
+            }
+        }
+
+        collapses.clear();
+        for(const auto& collapse : best)
+            if(collapse.error <= max_error2)
+                collapses.push_back(collapse);
+        std::sort(collapses.begin(), collapses.end(), [](const Collapse& a, const Collapse& b){ return a.error < b.error; });
+
+        // Cheapest first, every collapse only touches triangles that no other collapse of the same pass has changed
+        touched.assign(n_classes, 0);
+        dead.assign(indices.size() / 3, 0);
+        size_t n_triangles = indices.size() / 3, n_collapsed = 0;
+        for(const auto& collapse : collapses){
+            if(n_triangles <= target_triangles)
+                break;
+
+            if(touched[collapse.from] || touched[collapse.to])
+                continue;
+
+            auto target = check_collapse(collapse.from, collapse.to);
+            if(!target)
+                continue;
+
+            for(size_t i = offsets[collapse.from]; i < offsets[collapse.from + 1]; i++){
+                auto t = adjacency[i];
+                auto* tri = &indices[t * 3];
+
+                bool has_to = false;
+                for(int k = 0; k < 3; k++)
+                    has_to |= (class_of[tri[k]] == collapse.to);
+
+                if(has_to){
+                    dead[t] = 1;
+                    n_triangles--;
+                } else {
+                    for(int k = 0; k < 3; k++)
+                        if(class_of[tri[k]] == collapse.from)
+                            tri[k] = *target;
+                }
+            }
+
+            quadrics[collapse.to] += quadrics[collapse.from];
+            error2 = std::max(error2, collapse.error);
+
+            touched[collapse.from] = touched[collapse.to] = 1;
+            for(auto c : neighbours_from)
+                touched[c] = 1;
+            n_collapsed++;
+        }
+
+        size_t out = 0;
+        for(size_t t = 0; t < dead.size(); t++){
+            if(dead[t])
+                continue;
+
+            std::copy_n(indices.begin() + t * 3, 3, indices.begin() + out * 3);
+            out++;
+        }
+        indices.resize(out * 3);
+
+        if(n_collapsed == 0){
+            // Nothing left within the error bound, keep what was reached if it is still a worthwhile step down
+            if(indices.size() < previous_index_count * 3 / 4)
+                lods.push_back({.indices = indices, .error = (float)std::sqrt(error2)});
+            break;
+        }
+    }
+
+    for(auto& lod : lods)
+        mesh_optimizer::optimize_vertex_cache(lod.indices, n_vertices);
+
+    return lods;
+}
+
+float benzene::mesh_simplifier::mesh_extent(const Mesh& mesh){
+    if(mesh.bounds)
+        return glm::length(mesh.bounds->max - mesh.bounds->min);
+
+    auto vertices = mesh.get_vertices();
+    if(vertices.size() == 0)
+        return 0.0f;
+
+    glm::vec3 min = vertices[0].pos, max = vertices[0].pos;
+    for(const auto& vertex : vertices){
+        min = glm::min(min, vertex.pos);
+        max = glm::max(max, vertex.pos);
+    }
+
+    return glm::length(max - min);
+}
+
+namespace {
+    constexpr char lod_cache_magic[8] = {'B', 'Z', 'L', 'O', 'D', 0, 0, 0};
+    constexpr uint32_t lod_cache_version = 1;
+
+    // FNV-1a over 32-bit words, the vertices are hashed per component since glm's aligned vec3 has padding
+    struct Hasher {
+        uint64_t state = 0xcbf29ce484222325;
+
+        void add(uint32_t word){
+            state = (state ^ word) * 0x100000001b3;
+        }
+
+        void add(float f){
+            uint32_t word;
+            std::memcpy(&word, &f, sizeof(word));
+            this->add(word);
+        }
+
+        void add(uint64_t word){
+            this->add((uint32_t)word);
+            this->add((uint32_t)(word >> 32));
+        }
+    };
+}
+
+uint64_t benzene::mesh_simplifier::lod_cache_key(const std::vector<Mesh>& meshes, const LodConfig& config){
+    Hasher hasher{};
+    hasher.add(lod_cache_version);
+    hasher.add((uint64_t)meshes.size());
+    for(const auto& mesh : meshes){
+        auto vertices = mesh.get_vertices();
+        auto indices = mesh.get_indices();
+        hasher.add((uint64_t)vertices.size());
+        for(const auto& vertex : vertices){
+            hasher.add(vertex.pos.x);
+            hasher.add(vertex.pos.y);
+            hasher.add(vertex.pos.z);
+        }
+
+        // Attributes only matter through which vertices share a position, the positions and indices already capture that
+        hasher.add((uint64_t)indices.size());
+        for(auto index : indices)
+            hasher.add(index);
+    }
+
+    hasher.add((uint64_t)config.ratios.size());
+    for(auto ratio : config.ratios)
+        hasher.add(ratio);
+    hasher.add(config.max_error);
+
+    return hasher.state;
+}
+
+std::optional<std::vector<std::vector<Mesh::Lod>>> benzene::mesh_simplifier::read_lod_cache(const std::string& path, uint64_t key){
+    std::ifstream file{path, std::ios::binary};
+    if(!file.is_open())
+        return std::nullopt;
+
+    auto read = [&file]<typename T>(T& value){
+        return (bool)file.read((char*)&value, sizeof(T));
+    };
+
+    char magic[8];
+    uint32_t version = 0;
+    uint64_t file_key = 0, n_meshes = 0;
+    if(!file.read(magic, sizeof(magic)) || !std::equal(magic, magic + 8, lod_cache_magic) || !read(version) || version != lod_cache_version || !read(file_key) || file_key != key || !read(n_meshes))
+        return std::nullopt;
+
+    std::vector<std::vector<Mesh::Lod>> chains(n_meshes);
+    for(auto& chain : chains){
+        uint64_t n_lods = 0;
+        if(!read(n_lods))
+            return std::nullopt;
+
+        chain.resize(n_lods);
+        for(auto& lod : chain){
+            uint64_t n_indices = 0;
+            if(!read(lod.error) || !read(n_indices))
+                return std::nullopt;
+
+            lod.indices.resize(n_indices);
+            if(!file.read((char*)lod.indices.data(), n_indices * sizeof(uint32_t)))
+                return std::nullopt;
+        }
+    }
+
+    return chains;
+}
+
+void benzene::mesh_simplifier::write_lod_cache(const std::string& path, uint64_t key, const std::vector<Mesh>& meshes){
+    std::ofstream file{path, std::ios::binary | std::ios::trunc};
+    if(!file.is_open()){
+        print("benzene/Model: Failed to open LOD cache {:s} for writing\n", path);
+        return;
+    }
+
+    auto write = [&file]<typename T>(const T& value){
+        file.write((const char*)&value, sizeof(T));
+    };
+
+    file.write(lod_cache_magic, sizeof(lod_cache_magic));
+    write(lod_cache_version);
+    write(key);
+    write((uint64_t)meshes.size());
+    for(const auto& mesh : meshes){
+        write((uint64_t)mesh.lods.size());
+        for(const auto& lod : mesh.lods){
+            write(lod.error);
+            write((uint64_t)lod.indices.size());
+            file.write((const char*)lod.indices.data(), lod.indices.size() * sizeof(uint32_t));
+        }
+    }
+
+    if(!file)
+        print("benzene/Model: Failed to write LOD cache {:s}\n", path);
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <benzene/benzene.hpp>
+
+#include <optional>
+#include <string>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+namespace benzene::mesh_simplifier
+{
+    // Collapses edges in order of their quadric error (Garland, Heckbert 1997) and takes a level every time the triangle count drops to
+    // the next of `target_index_counts` (descending). The chain ends early when no collapse within `max_error` (object space) is left
+    // Vertices never move and are never created, so every level indexes `mesh.vertices`, open borders and UV or normal seams stay in place
+    std::vector<Mesh::Lod> build_lod_chain(const Mesh& mesh, const std::vector<size_t>& target_index_counts, float max_error);
+
+    // Length of the diagonal of the mesh's bounding box
+    float mesh_extent(const Mesh& mesh);
+
+    // Identifies the meshes and config a cache was made from, a cache is only used if its key matches
+    uint64_t lod_cache_key(const std::vector<Mesh>& meshes, const LodConfig& config);
+    // One LOD chain per mesh
+    std::optional<std::vector<std::vector<Mesh::Lod>>> read_lod_cache(const std::string& path, uint64_t key);
+    void write_lod_cache(const std::string& path, uint64_t key, const std::vector<Mesh>& meshes);
+} // namespace benzene::mesh_simplifier
@@ -0,0 +1,174 @@
+#include "meshlets.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <utility>
+
+using namespace benzene;
+
+namespace {
+    meshlets::Meshlet compute_bounds(std::span<const Mesh::Vertex> vertices, const uint32_t* indices, size_t index_count){
+        meshlets::Meshlet meshlet{};
+
+        glm::vec3 min{std::numeric_limits<float>::max()}, max{-std::numeric_limits<float>::max()};
+        for(size_t i = 0; i < index_count; i++){
+            min = glm::min(min, vertices[indices[i]].pos);
+            max = glm::max(max, vertices[indices[i]].pos);
+        }
+
+        meshlet.center = (min + max) * 0.5f;
+        for(size_t i = 0; i < index_count; i++)
+            meshlet.radius = std::max(meshlet.radius, glm::length(vertices[indices[i]].pos - meshlet.center));
+
+        std::vector<glm::vec3> normals{};
+        glm::vec3 axis{0.0f};
+        for(size_t i = 0; i + 2 < index_count; i += 3){
+            const auto& p0 = vertices[indices[i]].pos;
+            auto n = glm::cross(vertices[indices[i + 1]].pos - p0, vertices[indices[i + 2]].pos - p0);
+            auto length = glm::length(n);
+            if(length == 0.0f)
+                continue;
+
+            normals.push_back(n / length);
+            axis += normals.back();
+        }
+
+        meshlet.cone_axis = {0.0f, 0.0f, 1.0f};
+        meshlet.cone_cutoff = 1.0f;
+        auto axis_length = glm::length(axis);
+        if(normals.size() == 0 || axis_length == 0.0f)
+            return meshlet;
+
+        axis /= axis_length;
+        float min_dot = 1.0f;
+        for(const auto& n : normals)
+            min_dot = std::min(min_dot, glm::dot(n, axis));
+
+        // Cones of 90 degrees or more always have a triangle facing the camera
+        meshlet.cone_axis = axis;
+        if(min_dot > 0.0f)
+            meshlet.cone_cutoff = std::sqrt(1.0f - min_dot * min_dot);
+
+        return meshlet;
+    }
+}
+
+std::vector<meshlets::Meshlet> benzene::meshlets::build(std::span<const Mesh::Vertex> vertices, std::vector<uint32_t>& indices){
+    auto n_triangles = indices.size() / 3;
+    std::vector<Meshlet> meshlets{};
+    if(n_triangles == 0)
+        return meshlets;
+
+    // Triangles around every vertex
+    std::vector<uint32_t> offsets(vertices.size() + 1, 0), adjacency(n_triangles * 3);
+    for(size_t i = 0; i < n_triangles * 3; i++)
+        offsets[indices[i] + 1]++;
+    for(size_t v = 0; v < vertices.size(); v++)
+        offsets[v + 1] += offsets[v];
+    {
+        std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+        for(size_t i = 0; i < n_triangles * 3; i++)
+            adjacency[fill[indices[i]]++] = i / 3;
+    }
+
+    std::vector<uint8_t> used(n_triangles, 0);
+    // Which meshlet last took a vertex or queued a triangle, so neither needs clearing between meshlets
+    std::vector<uint32_t> owner(vertices.size(), std::numeric_limits<uint32_t>::max());
+    std::vector<uint32_t> queued(n_triangles, std::numeric_limits<uint32_t>::max());
+
+    std::vector<uint32_t> out{};
+    out.reserve(n_triangles * 3);
+    // Triangles of the meshlet being built, written out in their original order once it's done
+    std::vector<uint32_t> members{};
+    // Triangles touching the meshlet being built, with their squared distance to its first triangle
+    std::vector<std::pair<uint32_t, float>> candidates{};
+
+    size_t cursor = 0;
+    while(true){
+        while(cursor < n_triangles && used[cursor])
+            cursor++;
+        if(cursor == n_triangles)
+            break;
+
+        auto id = (uint32_t)meshlets.size();
+        auto first_index = out.size();
+        size_t n_vertices = 0, n_meshlet_triangles = 0;
+        auto centroid = [&](uint32_t t){
+            return (vertices[indices[t * 3]].pos + vertices[indices[t * 3 + 1]].pos + vertices[indices[t * 3 + 2]].pos) / 3.0f;
+        };
+        auto seed_centroid = centroid(cursor);
+
+        auto add = [&](uint32_t t){
+            used[t] = 1;
+            n_meshlet_triangles++;
+            members.push_back(t);
+            for(int k = 0; k < 3; k++){
+                auto v = indices[t * 3 + k];
+                if(owner[v] == id)
+                    continue;
+
+                owner[v] = id;
+                n_vertices++;
+                for(auto i = offsets[v]; i < offsets[v + 1]; i++){
+                    auto neighbour = adjacency[i];
+                    if(!used[neighbour] && queued[neighbour] != id){
+                        queued[neighbour] = id;
+                        auto offset = centroid(neighbour) - seed_centroid;
+                        candidates.emplace_back(neighbour, glm::dot(offset, offset));
+                    }
+                }
+            }
+        };
+
+        candidates.clear();
+        members.clear();
+        add(cursor);
+
+        // Grow from the triangles touching the meshlet, preferring ones that add the fewest vertices and then the ones closest to the seed
+        while(n_meshlet_triangles < max_triangles){
+            auto best = std::numeric_limits<uint32_t>::max();
+            int best_new = 4;
+            float best_distance = std::numeric_limits<float>::max();
+            for(size_t c = 0; c < candidates.size();){
+                auto [t, distance] = candidates[c];
+                if(used[t]){
+                    candidates[c] = candidates.back();
+                    candidates.pop_back();
+                    continue;
+                }
+
+                int n_new = 0;
+                for(int k = 0; k < 3; k++)
+                    n_new += (owner[indices[t * 3 + k]] != id);
+
+                if(n_vertices + n_new <= max_vertices && (n_new < best_new || (n_new == best_new && distance < best_distance))){
+                    best = t;
+                    best_new = n_new;
+                    best_distance = distance;
+                }
+                c++;
+            }
+
+            // The chosen triangle is dropped from the candidates on the next pass, as it's used by then
+            if(best == std::numeric_limits<uint32_t>::max())
+                break;
+
+            add(best);
+        }
+
+        std::sort(members.begin(), members.end());
+        for(auto t : members)
+            out.insert(out.end(), indices.begin() + t * 3, indices.begin() + t * 3 + 3);
+
+        auto meshlet = compute_bounds(vertices, out.data() + first_index, out.size() - first_index);
+        meshlet.first_index = first_index;
+        meshlet.index_count = out.size() - first_index;
+        meshlets.push_back(meshlet);
+    }
+
+    // Anything after the last whole triangle is kept as is
+    out.insert(out.end(), indices.begin() + n_triangles * 3, indices.end());
+    indices = std::move(out);
+    return meshlets;
+}
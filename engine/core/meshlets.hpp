@@ -0,0 +1,28 @@
+#pragma once
+
+#include <benzene/benzene.hpp>
+
+#include <span>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+namespace benzene::meshlets
+{
+    constexpr size_t max_vertices = 64;
+    constexpr size_t max_triangles = 124;
+
+    // Culling a meshlet just leaves out its index range
+    using Meshlet = Mesh::Meshlet;
+
+    // Reorders the triangles in `indices` into meshlets of at most `max_vertices` unique vertices and `max_triangles` triangles,
+    // grown greedily from neighbouring triangles so they stay compact, and returns them in index buffer order.
+    // Triangles keep their relative order within a meshlet, so an order optimized for the vertex cache mostly survives
+    std::vector<Meshlet> build(std::span<const Mesh::Vertex> vertices, std::vector<uint32_t>& indices);
+
+    // Whether every triangle of `meshlet` faces away from `camera_pos`, given in the meshlet's space, front faces are counter clockwise
+    inline bool is_backfacing(const Meshlet& meshlet, const glm::vec3& camera_pos){
+        auto view = meshlet.center - camera_pos;
+        return glm::dot(view, meshlet.cone_axis) >= meshlet.cone_cutoff * glm::length(view) + meshlet.radius;
+    }
+} // namespace benzene::meshlets
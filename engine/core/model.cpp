@@ -4,6 +4,8 @@ using namespace benzene;
 
 #include "format.hpp"
 
+#include <algorithm>
+
 void help_marker(const char* description){
     ImGui::TextDisabled("(?)");
     if(ImGui::IsItemHovered()){
@@ -17,23 +19,70 @@ void help_marker(const char* description){
     }
 }
 
+void Batch::mark_dirty(size_t first, size_t count){
+    if(count == 0)
+        return;
+
+    auto last = first + count;
+    // Most updates come in order, so try to extend the previous range before adding a new one
+    if(dirty_ranges.size() > 0){
+        auto& [begin, end] = dirty_ranges.back();
+        if(first <= end && last >= begin){
+            begin = std::min(begin, first);
+            end = std::max(end, last);
+            return;
+        }
+    }
+
+    dirty_ranges.emplace_back(first, last);
+
+    constexpr size_t max_pending_ranges = 4096;
+    if(dirty_ranges.size() > max_pending_ranges)
+        dirty_ranges = this->consume_dirty_ranges();
+}
+
+std::vector<std::pair<size_t, size_t>> Batch::consume_dirty_ranges(){
+    std::vector<std::pair<size_t, size_t>> merged{};
+    if(dirty_ranges.size() == 0)
+        return merged;
+
+    std::sort(dirty_ranges.begin(), dirty_ranges.end());
+    for(auto [begin, end] : dirty_ranges){
+        end = std::min(end, transforms.size());
+        if(begin >= end)
+            continue;
+
+        if(merged.size() > 0 && begin <= merged.back().second)
+            merged.back().second = std::max(merged.back().second, end);
+        else
+            merged.emplace_back(begin, end);
+    }
+
+    dirty_ranges.clear();
+    return merged;
+}
+
 void Batch::show_inspector(const std::string& window_name, bool* opened, size_t i){
     ImGui::Begin(window_name.c_str(), opened);
 
     if(ImGui::CollapsingHeader("Transform")){
         float step = 0.1, step_fast = 1.0;
         ImGui::Indent();
+        bool changed = false;
         ImGui::Text("Position: ");
         ImGui::SameLine(0, 0);
-        ImGui::InputScalarN("##Position", ImGuiDataType_Float, &transforms[i].pos.x, 3, &step, &step_fast);
+        changed |= ImGui::InputScalarN("##Position", ImGuiDataType_Float, &transforms[i].pos.x, 3, &step, &step_fast);
     
         ImGui::Text("Rotation: ");
         ImGui::SameLine(0, 0);
-        ImGui::InputScalarN("##Rotation", ImGuiDataType_Float, &transforms[i].rotation.x, 3, &step, &step_fast);
+        changed |= ImGui::InputScalarN("##Rotation", ImGuiDataType_Float, &transforms[i].rotation.x, 3, &step, &step_fast);
 
         ImGui::Text("Scale:    ");
         ImGui::SameLine(0, 0);
-        ImGui::InputScalarN("##Scale", ImGuiDataType_Float, &transforms[i].scale.x, 3, &step, &step_fast);
+        changed |= ImGui::InputScalarN("##Scale", ImGuiDataType_Float, &transforms[i].scale.x, 3, &step, &step_fast);
+
+        if(changed)
+            this->mark_dirty(i);
         ImGui::Unindent();
     }
 
@@ -54,7 +103,9 @@ void Batch::show_inspector(const std::string& window_name, bool* opened, size_t
 
                 if(ImGui::CollapsingHeader("Vertices")){
                     ImGui::Indent();
-                    
+
+                    // Mapped vertices are read only, editing them needs a copy
+                    meshes[i].make_owned();
                     for(size_t j = 0; j < meshes[i].vertices.size(); j++){
                         auto& vertex = meshes[i].vertices[j];
                         if(ImGui::TreeNode(format_to_str("{:d}", j).c_str())){
@@ -97,6 +148,8 @@ void Batch::show_inspector(const std::string& window_name, bool* opened, size_t
                             ImGui::Text("Dimensions %dx%d", width, height);
                             ImGui::Text("Channels: %d", texture.get_channels());
                             ImGui::Text("Gamut: %s", Texture::gamut_to_str(texture.get_gamut()));
+                            ImGui::Text("Pixels: %s", texture.bytes().empty() ? "released after upload" : "in memory");
+                            ImGui::Text("Compression: %s, %zu mip level(s) baked", Texture::compression_to_str(texture.get_compression()), texture.get_levels().size());
                             
                             ImGui::TreePop();
                         }
@@ -0,0 +1,381 @@
+#include "obj_loader.hpp"
+#include "format.hpp"
+#include "utils.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <string_view>
+#include <utility>
+
+using namespace benzene;
+
+namespace {
+    // Big enough that a job per chunk is cheap, small enough that files of a few MB still spread over every worker
+    constexpr size_t chunk_size = 1 << 20;
+
+    enum class EventType {
+        Shape, // `o` or `g`
+        Material // `usemtl`
+    };
+
+    // A statement that applies to the faces after it, `triangle` is how many triangles its chunk had before it
+    struct Event {
+        size_t triangle;
+        EventType type;
+        std::string name;
+    };
+
+    struct Chunk {
+        std::vector<float> positions, uvs, normals;
+        std::vector<obj::Index> indices;
+        std::vector<Event> events;
+        // Every `mtllib` statement, a statement may list several files
+        std::vector<std::string> material_libraries;
+        // Negative references are stored relative to the chunk's first element, these (index, field mask) pairs get the chunk's offset added when merging
+        std::vector<std::pair<size_t, uint8_t>> relative;
+        size_t malformed_lines = 0;
+    };
+
+    bool is_space(char c){
+        return c == ' ' || c == '\t' || c == '\r';
+    }
+
+    void skip_spaces(const char*& p, const char* end){
+        while(p < end && is_space(*p))
+            p++;
+    }
+
+    // Whether the line starts with `keyword` followed by whitespace, skips both if it does
+    bool keyword(const char*& p, const char* end, std::string_view keyword){
+        if((size_t)(end - p) < keyword.size() || std::string_view{p, keyword.size()} != keyword)
+            return false;
+        if((p + keyword.size()) < end && !is_space(p[keyword.size()]))
+            return false;
+
+        p += keyword.size();
+        skip_spaces(p, end);
+        return true;
+    }
+
+    bool parse_floats(const char*& p, const char* end, float* out, size_t n){
+        for(size_t i = 0; i < n; i++){
+            skip_spaces(p, end);
+            // from_chars doesn't take a leading '+'
+            if(p < end && *p == '+')
+                p++;
+
+            auto [next, error] = std::from_chars(p, end, out[i]);
+            if(error != std::errc{})
+                return false;
+            p = next;
+        }
+
+        return true;
+    }
+
+    std::string parse_name(const char* p, const char* end){
+        skip_spaces(p, end);
+        while(end > p && is_space(end[-1]))
+            end--;
+
+        return std::string{p, end};
+    }
+
+    // Parses `v[/vt][/vn]`, or `v//vn`, the counts are the elements the chunk had so far for resolving negative references
+    bool parse_corner(const char*& p, const char* end, const size_t counts[3], obj::Index& index, uint8_t& relative){
+        int32_t* fields[3] = {&index.vertex, &index.uv, &index.normal};
+        index = {-1, -1, -1};
+        relative = 0;
+
+        for(int field = 0; field < 3; field++){
+            if(field > 0){
+                if(p == end || *p != '/')
+                    break;
+                p++;
+
+                // Empty uv in `v//vn`
+                if(p < end && *p == '/')
+                    continue;
+            }
+
+            int32_t value = 0;
+            auto [next, error] = std::from_chars(p, end, value);
+            if(error != std::errc{} || value == 0)
+                return false;
+            p = next;
+
+            if(value > 0){
+                *fields[field] = value - 1;
+            } else {
+                *fields[field] = (int32_t)counts[field] + value;
+                relative |= (1 << field);
+            }
+        }
+
+        return p == end || is_space(*p);
+    }
+
+    void parse_chunk(const char* begin, const char* end, Chunk& chunk){
+        std::vector<obj::Index> face{};
+        std::vector<uint8_t> face_relative{};
+
+        for(const char* line = begin; line < end;){
+            const char* line_end = (const char*)std::memchr(line, '\n', end - line);
+            if(!line_end)
+                line_end = end;
+
+            const char* p = line;
+            line = (line_end < end) ? (line_end + 1) : end;
+            skip_spaces(p, line_end);
+
+            bool ok = true;
+            if(keyword(p, line_end, "v")){
+                // Anything after xyz, like w or vertex colours, is ignored. Malformed elements are kept as zeros so later references still line up
+                float xyz[3] = {0.0f, 0.0f, 0.0f};
+                ok = parse_floats(p, line_end, xyz, 3);
+                chunk.positions.insert(chunk.positions.end(), xyz, xyz + 3);
+            } else if(keyword(p, line_end, "vt")){
+                float uv[2] = {0.0f, 0.0f};
+                ok = parse_floats(p, line_end, uv, 1);
+                // v defaults to 0 like in tinyobjloader
+                parse_floats(p, line_end, uv + 1, 1);
+                chunk.uvs.insert(chunk.uvs.end(), uv, uv + 2);
+            } else if(keyword(p, line_end, "vn")){
+                float xyz[3] = {0.0f, 0.0f, 0.0f};
+                ok = parse_floats(p, line_end, xyz, 3);
+                chunk.normals.insert(chunk.normals.end(), xyz, xyz + 3);
+            } else if(keyword(p, line_end, "f")){
+                const size_t counts[3] = {chunk.positions.size() / 3, chunk.uvs.size() / 2, chunk.normals.size() / 3};
+                face.clear();
+                face_relative.clear();
+                while(ok){
+                    skip_spaces(p, line_end);
+                    if(p == line_end)
+                        break;
+
+                    obj::Index index;
+                    uint8_t relative;
+                    ok = parse_corner(p, line_end, counts, index, relative);
+                    face.push_back(index);
+                    face_relative.push_back(relative);
+                }
+
+                ok = ok && face.size() >= 3;
+                for(size_t k = 1; ok && (k + 1) < face.size(); k++){
+                    for(auto corner : {(size_t)0, k, k + 1}){
+                        if(face_relative[corner])
+                            chunk.relative.emplace_back(chunk.indices.size(), face_relative[corner]);
+                        chunk.indices.push_back(face[corner]);
+                    }
+                }
+            } else if(keyword(p, line_end, "o") || keyword(p, line_end, "g")){
+                chunk.events.push_back({.triangle = chunk.indices.size() / 3, .type = EventType::Shape, .name = parse_name(p, line_end)});
+            } else if(keyword(p, line_end, "usemtl")){
+                chunk.events.push_back({.triangle = chunk.indices.size() / 3, .type = EventType::Material, .name = parse_name(p, line_end)});
+            } else if(keyword(p, line_end, "mtllib")){
+                chunk.material_libraries.push_back(parse_name(p, line_end));
+            }
+            // Comments, smoothing groups, lines and points are skipped
+
+            if(!ok)
+                chunk.malformed_lines++;
+        }
+    }
+
+    // Loads the first file of an `mtllib` statement that can be opened, like tinyobjloader
+    void load_material_library(const std::string& folder, const std::string& statement, std::map<std::string, int>& material_map, std::vector<tinyobj::material_t>& materials){
+        size_t begin = 0;
+        while(begin < statement.size()){
+            auto end = statement.find_first_of(" \t", begin);
+            if(end == std::string::npos)
+                end = statement.size();
+
+            std::ifstream file{folder + statement.substr(begin, end - begin)};
+            if(end > begin && file.is_open()){
+                std::string warning{}, error{};
+                tinyobj::LoadMtl(&material_map, &materials, &file, &warning, &error);
+                if(!warning.empty() || !error.empty())
+                    print("benzene/obj: {:s}{:s}", warning, error);
+                return;
+            }
+
+            begin = end + 1;
+        }
+
+        print("benzene/obj: Failed to open material library {:s}\n", statement);
+    }
+}
+
+obj::Model benzene::obj::load(const std::string& path, const std::string& material_folder){
+    MappedFile file{path};
+    const auto* data = (const char*)file.data();
+    auto size = file.size();
+
+    // Every chunk but the first starts right after a newline
+    std::vector<size_t> starts{0};
+    while((starts.back() + chunk_size) < size){
+        const auto* newline = (const char*)std::memchr(data + starts.back() + chunk_size, '\n', size - starts.back() - chunk_size);
+        if(!newline)
+            break;
+        starts.push_back(newline - data + 1);
+    }
+    starts.push_back(size);
+
+    auto n_chunks = starts.size() - 1;
+    std::vector<Chunk> chunks(n_chunks);
+    jobs::parallel_for(0, n_chunks, 1, [&](size_t begin, size_t end){
+        for(size_t i = begin; i < end; i++)
+            parse_chunk(data + starts[i], data + starts[i + 1], chunks[i]);
+    });
+
+    Model model{};
+    std::map<std::string, int> material_map{};
+    std::vector<std::string> loaded_libraries{};
+    size_t malformed_lines = 0;
+    for(const auto& chunk : chunks){
+        malformed_lines += chunk.malformed_lines;
+        for(const auto& library : chunk.material_libraries){
+            if(std::find(loaded_libraries.begin(), loaded_libraries.end(), library) != loaded_libraries.end())
+                continue;
+
+            loaded_libraries.push_back(library);
+            load_material_library(material_folder, library, material_map, model.materials);
+        }
+    }
+
+    if(malformed_lines > 0)
+        print("benzene/obj: Skipped {:d} malformed line(s) in {:s}\n", malformed_lines, path);
+
+    // Where each chunk's elements start in the merged arrays
+    std::vector<size_t> position_offsets(n_chunks + 1, 0), uv_offsets(n_chunks + 1, 0), normal_offsets(n_chunks + 1, 0);
+    for(size_t i = 0; i < n_chunks; i++){
+        position_offsets[i + 1] = position_offsets[i] + chunks[i].positions.size() / 3;
+        uv_offsets[i + 1] = uv_offsets[i] + chunks[i].uvs.size() / 2;
+        normal_offsets[i + 1] = normal_offsets[i] + chunks[i].normals.size() / 3;
+    }
+    model.positions.resize(position_offsets.back() * 3);
+    model.uvs.resize(uv_offsets.back() * 2);
+    model.normals.resize(normal_offsets.back() * 3);
+
+    // Shape and material statements are replayed in file order, splitting every chunk's triangles into runs that each land in one shape
+    struct Run {
+        size_t first_triangle, end_triangle;
+        size_t shape, offset;
+        int32_t material;
+    };
+    std::vector<std::vector<Run>> runs(n_chunks);
+    std::vector<size_t> shape_triangles{0};
+    model.shapes.emplace_back();
+    int32_t material = -1;
+    for(size_t i = 0; i < n_chunks; i++){
+        size_t triangle = 0;
+        auto flush = [&](size_t end){
+            auto shape = model.shapes.size() - 1;
+            if(end > triangle){
+                runs[i].push_back({.first_triangle = triangle, .end_triangle = end, .shape = shape, .offset = shape_triangles[shape], .material = material});
+                shape_triangles[shape] += end - triangle;
+            }
+            triangle = end;
+        };
+
+        for(const auto& event : chunks[i].events){
+            flush(event.triangle);
+
+            if(event.type == EventType::Shape){
+                // A shape without faces is only renamed
+                if(shape_triangles.back() > 0){
+                    model.shapes.emplace_back();
+                    shape_triangles.push_back(0);
+                }
+                model.shapes.back().name = event.name;
+            } else {
+                auto it = material_map.find(event.name);
+                material = (it != material_map.end()) ? it->second : -1;
+                if(it == material_map.end())
+                    print("benzene/obj: Material {:s} not found in any material library\n", event.name);
+            }
+        }
+        flush(chunks[i].indices.size() / 3);
+    }
+
+    for(size_t i = 0; i < model.shapes.size(); i++){
+        model.shapes[i].indices.resize(shape_triangles[i] * 3);
+        model.shapes[i].material_ids.resize(shape_triangles[i]);
+    }
+
+    std::atomic<bool> out_of_range{false};
+    jobs::parallel_for(0, n_chunks, 1, [&](size_t begin, size_t end){
+        for(size_t i = begin; i < end; i++){
+            auto& chunk = chunks[i];
+            std::copy(chunk.positions.begin(), chunk.positions.end(), model.positions.begin() + position_offsets[i] * 3);
+            std::copy(chunk.uvs.begin(), chunk.uvs.end(), model.uvs.begin() + uv_offsets[i] * 2);
+            std::copy(chunk.normals.begin(), chunk.normals.end(), model.normals.begin() + normal_offsets[i] * 3);
+
+            for(auto [index, fields] : chunk.relative){
+                if(fields & 1)
+                    chunk.indices[index].vertex += position_offsets[i];
+                if(fields & 2)
+                    chunk.indices[index].uv += uv_offsets[i];
+                if(fields & 4)
+                    chunk.indices[index].normal += normal_offsets[i];
+            }
+
+            for(const auto& run : runs[i]){
+                auto& shape = model.shapes[run.shape];
+                for(size_t j = run.first_triangle * 3; j < run.end_triangle * 3; j++){
+                    const auto& index = chunk.indices[j];
+                    if(index.vertex < 0 || (size_t)index.vertex >= position_offsets.back() || index.uv < -1 || index.uv >= (int64_t)uv_offsets.back() || index.normal < -1 || index.normal >= (int64_t)normal_offsets.back())
+                        out_of_range = true;
+                }
+
+                std::copy(chunk.indices.begin() + run.first_triangle * 3, chunk.indices.begin() + run.end_triangle * 3, shape.indices.begin() + run.offset * 3);
+                std::fill_n(shape.material_ids.begin() + run.offset, run.end_triangle - run.first_triangle, run.material);
+            }
+
+            // Everything is in the model now, give the memory back while the other chunks are still being copied
+            chunk = Chunk{};
+        }
+    });
+
+    if(out_of_range){
+        print("benzene/obj: A face in {:s} references an element that doesn't exist\n", path);
+        throw std::runtime_error("benzene/obj: Face references a missing element");
+    }
+
+    // Only the last shape can be empty, if the file ends with `o` or `g` or has no faces at all
+    if(model.shapes.back().indices.empty())
+        model.shapes.pop_back();
+
+    return model;
+}
+
+std::vector<std::string> benzene::obj::material_libraries(const std::byte* data, size_t size){
+    std::vector<std::string> files{};
+    const auto* p = (const char*)data;
+    const auto* end = p + size;
+    while(p < end){
+        const auto* line_end = (const char*)std::memchr(p, '\n', end - p);
+        if(!line_end)
+            line_end = end;
+
+        skip_spaces(p, line_end);
+        if(keyword(p, line_end, "mtllib")){
+            auto statement = parse_name(p, line_end);
+            size_t begin = 0;
+            while(begin < statement.size()){
+                auto file_end = std::min(statement.find_first_of(" \t", begin), statement.size());
+                if(file_end > begin)
+                    files.push_back(statement.substr(begin, file_end - begin));
+                begin = file_end + 1;
+            }
+        }
+
+        p = line_end + (line_end < end);
+    }
+
+    return files;
+}
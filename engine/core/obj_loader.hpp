@@ -0,0 +1,39 @@
+#pragma once
+
+#include <benzene/benzene.hpp>
+
+#include <string>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+namespace benzene::obj
+{
+    // Zero based, -1 where the face didn't reference one
+    struct Index {
+        int32_t vertex, uv, normal;
+    };
+
+    struct Shape {
+        std::string name;
+        // Three per triangle, faces with more corners are split into a fan
+        std::vector<Index> indices;
+        // One per triangle, into Model::materials, -1 for faces without a known material
+        std::vector<int32_t> material_ids;
+    };
+
+    struct Model {
+        // 3, 2 and 3 floats per element
+        std::vector<float> positions, uvs, normals;
+        // A new shape starts at every `o` or `g` statement that follows faces, like tinyobjloader
+        std::vector<Shape> shapes;
+        std::vector<tinyobj::material_t> materials;
+    };
+
+    // Maps the file and parses line aligned chunks of it in parallel, then stitches the chunks together in file order
+    // Material libraries are looked up in `material_folder`, throws if the file can't be read or a face references a missing element
+    Model load(const std::string& path, const std::string& material_folder);
+
+    // Every file the `mtllib` statements in `data`, the contents of an OBJ file, name, without parsing anything else
+    std::vector<std::string> material_libraries(const std::byte* data, size_t size);
+} // namespace benzene::obj
@@ -0,0 +1,714 @@
+#include "texture_baker.hpp"
+#include "format.hpp"
+#include "utils.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <limits>
+
+using namespace benzene;
+using Compression = Texture::Compression;
+
+namespace {
+    constexpr char magic[8] = {'B', 'Z', 'T', 'E', 'X', 0, 0, 0};
+    // Bumped whenever the layout, the filtering or the encoders change, so old files are baked again
+    constexpr uint32_t version = 2;
+    // Every level starts on a block, like KTX2's mip padding
+    constexpr uint64_t level_alignment = 16;
+    // Anything larger is a damaged header, GL doesn't go past 16k anyway
+    constexpr uint32_t max_size = 1 << 16;
+
+    // Rows of output pixels per downsampling job, and blocks per encoding job
+    constexpr size_t row_grain = 16;
+    constexpr size_t block_grain = 1024;
+
+    struct Header {
+        char magic[8];
+        uint32_t version;
+        uint32_t compression, gamut;
+        uint32_t width, height, channels;
+        uint32_t level_count;
+        uint32_t padding;
+        uint64_t source_hash;
+    };
+
+    // The same as KTX2's level index, level 0 first, offsets are from the start of the file
+    struct LevelEntry {
+        uint64_t offset, size;
+    };
+
+    uint64_t align_up(uint64_t offset){
+        return (offset + level_alignment - 1) / level_alignment * level_alignment;
+    }
+
+    int level_count(int width, int height){
+        int count = 1;
+        for(int size = std::max(width, height); size > 1; size >>= 1)
+            count++;
+        return count;
+    }
+
+    std::pair<int, int> level_size(int width, int height, int level){
+        return {std::max(width >> level, 1), std::max(height >> level, 1)};
+    }
+
+    size_t level_bytes(int width, int height, Compression compression){
+        return (size_t)((width + 3) / 4) * ((height + 3) / 4) * texture_baker::block_size(compression);
+    }
+
+    // Calls f(texel, weight) for every source texel `tap` of `n_taps` evenly spread over `size` texels covers, the weights add up to 1.
+    // In units of 1 / n_taps so it's exact, with more taps than texels this is just the clamped texel
+    template<typename F>
+    void for_each_source(size_t tap, size_t n_taps, size_t size, F&& f){
+        size_t begin = tap * size, end = (tap + 1) * size;
+        for(size_t texel = begin / n_taps; texel * n_taps < end; texel++){
+            size_t covered = std::min(end, (texel + 1) * n_taps) - std::max(begin, texel * n_taps);
+            f((int)std::min(texel, size - 1), (float)covered / (float)(end - begin));
+        }
+    }
+
+    // From encoded bytes to linear floats and back through a 16 bit quantization, [0] is a plain division for linear data and [1] is sRGB
+    struct Tables {
+        float to_linear[2][256];
+        uint8_t from_linear[2][65536];
+    };
+
+    const Tables& tables(){
+        static const auto tables = []{
+            auto t = std::make_unique<Tables>();
+            for(int i = 0; i < 256; i++){
+                float c = i / 255.0f;
+                t->to_linear[0][i] = c;
+                t->to_linear[1][i] = (c <= 0.04045f) ? (c / 12.92f) : std::pow((c + 0.055f) / 1.055f, 2.4f);
+            }
+
+            for(int i = 0; i < 65536; i++){
+                float l = i / 65535.0f;
+                float s = (l <= 0.0031308f) ? (l * 12.92f) : (1.055f * std::pow(l, 1.0f / 2.4f) - 0.055f);
+                t->from_linear[0][i] = (uint8_t)std::lround(l * 255.0f);
+                t->from_linear[1][i] = (uint8_t)std::lround(std::clamp(s, 0.0f, 1.0f) * 255.0f);
+            }
+            return t;
+        }();
+        return *tables;
+    }
+
+    struct Block {
+        // RGBA, 3 channel pixels get an alpha of 255
+        uint8_t texels[16][4];
+    };
+
+    Block load_block(const uint8_t* pixels, int width, int height, int channels, int bx, int by){
+        Block block;
+        for(int y = 0; y < 4; y++){
+            int sy = std::min(by * 4 + y, height - 1);
+            for(int x = 0; x < 4; x++){
+                int sx = std::min(bx * 4 + x, width - 1);
+                const uint8_t* p = pixels + ((size_t)sy * width + sx) * channels;
+                for(int c = 0; c < 4; c++)
+                    block.texels[y * 4 + x][c] = (c < channels) ? p[c] : 255;
+            }
+        }
+
+        return block;
+    }
+
+    // Ends of the line that fits the first N channels of the block best, its direction found by power iteration on their covariance
+    template<int N>
+    void fit_line(const Block& block, float e0[N], float e1[N]){
+        float mean[N] = {};
+        for(const auto& texel : block.texels)
+            for(int c = 0; c < N; c++)
+                mean[c] += texel[c] / 16.0f;
+
+        float covariance[N][N] = {};
+        for(const auto& texel : block.texels)
+            for(int i = 0; i < N; i++)
+                for(int j = 0; j < N; j++)
+                    covariance[i][j] += (texel[i] - mean[i]) * (texel[j] - mean[j]);
+
+        // Starting from the column of the channel that varies the most never starts orthogonal to the axis
+        int widest = 0;
+        for(int c = 1; c < N; c++)
+            if(covariance[c][c] > covariance[widest][widest])
+                widest = c;
+
+        float axis[N];
+        for(int c = 0; c < N; c++)
+            axis[c] = covariance[c][widest];
+
+        for(int iteration = 0; iteration < 8; iteration++){
+            float next[N] = {}, largest = 0.0f;
+            for(int i = 0; i < N; i++){
+                for(int j = 0; j < N; j++)
+                    next[i] += covariance[i][j] * axis[j];
+                largest = std::max(largest, std::abs(next[i]));
+            }
+
+            if(largest == 0.0f)
+                break;
+            for(int c = 0; c < N; c++)
+                axis[c] = next[c] / largest;
+        }
+
+        float length = 0.0f;
+        for(int c = 0; c < N; c++)
+            length += axis[c] * axis[c];
+        length = std::sqrt(length);
+
+        float low = 0.0f, high = 0.0f;
+        if(length > 0.0f){
+            low = std::numeric_limits<float>::max();
+            high = std::numeric_limits<float>::lowest();
+            for(const auto& texel : block.texels){
+                float t = 0.0f;
+                for(int c = 0; c < N; c++)
+                    t += (texel[c] - mean[c]) * axis[c] / length;
+                low = std::min(low, t);
+                high = std::max(high, t);
+            }
+        }
+
+        for(int c = 0; c < N; c++){
+            float direction = (length > 0.0f) ? (axis[c] / length) : 0.0f;
+            e0[c] = std::clamp(mean[c] + high * direction, 0.0f, 255.0f);
+            e1[c] = std::clamp(mean[c] + low * direction, 0.0f, 255.0f);
+        }
+    }
+
+    // Picks the closest palette entry for every texel, returns the summed squared error
+    template<int N>
+    int assign(const Block& block, const int (*palette)[4], int count, uint8_t indices[16]){
+        int total = 0;
+        for(int i = 0; i < 16; i++){
+            int best = std::numeric_limits<int>::max();
+            for(int j = 0; j < count; j++){
+                int error = 0;
+                for(int c = 0; c < N; c++){
+                    int d = block.texels[i][c] - palette[j][c];
+                    error += d * d;
+                }
+
+                if(error < best){
+                    best = error;
+                    indices[i] = (uint8_t)j;
+                }
+            }
+            total += best;
+        }
+
+        return total;
+    }
+
+    // Least squares endpoints for texels that sit at `weights[indices[i]]` of the way from e0 to e1, left alone if they're all at the same weight
+    template<int N>
+    void refit(const Block& block, const uint8_t indices[16], const float* weights, float e0[N], float e1[N]){
+        float aa = 0.0f, ab = 0.0f, bb = 0.0f;
+        float ax[N] = {}, bx[N] = {};
+        for(int i = 0; i < 16; i++){
+            float b = weights[indices[i]], a = 1.0f - b;
+            aa += a * a;
+            ab += a * b;
+            bb += b * b;
+            for(int c = 0; c < N; c++){
+                ax[c] += a * block.texels[i][c];
+                bx[c] += b * block.texels[i][c];
+            }
+        }
+
+        float determinant = aa * bb - ab * ab;
+        if(std::abs(determinant) < 1e-6f)
+            return;
+
+        for(int c = 0; c < N; c++){
+            e0[c] = std::clamp((bb * ax[c] - ab * bx[c]) / determinant, 0.0f, 255.0f);
+            e1[c] = std::clamp((aa * bx[c] - ab * ax[c]) / determinant, 0.0f, 255.0f);
+        }
+    }
+
+    uint16_t to_565(const float colour[3]){
+        auto quantize = [](float v, int max){
+            return (int)std::lround(v * max / 255.0f);
+        };
+        return (uint16_t)((quantize(colour[0], 31) << 11) | (quantize(colour[1], 63) << 5) | quantize(colour[2], 31));
+    }
+
+    void from_565(uint16_t v, int out[4]){
+        int r = v >> 11, g = (v >> 5) & 63, b = v & 31;
+        out[0] = (r << 3) | (r >> 2);
+        out[1] = (g << 2) | (g >> 4);
+        out[2] = (b << 3) | (b >> 2);
+        out[3] = 255;
+    }
+
+    void encode_bc1(const Block& block, uint8_t* out){
+        // By index, 2 and 3 are the interpolated colours
+        constexpr float weights[4] = {0.0f, 1.0f, 1.0f / 3.0f, 2.0f / 3.0f};
+
+        float e0[3], e1[3];
+        fit_line<3>(block, e0, e1);
+
+        uint16_t best[2] = {};
+        uint8_t best_indices[16] = {};
+        int best_error = std::numeric_limits<int>::max();
+        // The second pass refits the endpoints to where the first one put the texels, rounding to 565 can make that worse so the better one wins
+        for(int pass = 0; pass < 2; pass++){
+            uint16_t c0 = to_565(e0), c1 = to_565(e1);
+            int palette[4][4];
+            from_565(c0, palette[0]);
+            from_565(c1, palette[1]);
+            for(int c = 0; c < 4; c++){
+                palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+                palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+            }
+
+            uint8_t indices[16];
+            int error = assign<3>(block, palette, 4, indices);
+            if(error < best_error){
+                best_error = error;
+                best[0] = c0;
+                best[1] = c1;
+                std::copy(indices, indices + 16, best_indices);
+            }
+
+            refit<3>(block, indices, weights, e0, e1);
+        }
+
+        // Four colours need c0 > c1, otherwise index 3 is transparent black. With c0 == c1 every index is the same colour anyway
+        if(best[0] < best[1]){
+            std::swap(best[0], best[1]);
+            for(auto& index : best_indices)
+                index ^= 1;
+        } else if(best[0] == best[1]){
+            std::fill(best_indices, best_indices + 16, 0);
+        }
+
+        uint32_t bits = 0;
+        for(int i = 0; i < 16; i++)
+            bits |= (uint32_t)best_indices[i] << (2 * i);
+
+        out[0] = best[0] & 0xFF;
+        out[1] = best[0] >> 8;
+        out[2] = best[1] & 0xFF;
+        out[3] = best[1] >> 8;
+        for(int i = 0; i < 4; i++)
+            out[4 + i] = (uint8_t)(bits >> (8 * i));
+    }
+
+    // One channel with 8 levels between its extremes, BC3's alpha and both halves of BC5
+    void encode_bc4(const Block& block, int channel, uint8_t* out){
+        int low = 255, high = 0;
+        for(const auto& texel : block.texels){
+            low = std::min<int>(low, texel[channel]);
+            high = std::max<int>(high, texel[channel]);
+        }
+
+        out[0] = (uint8_t)high;
+        out[1] = (uint8_t)low;
+
+        uint64_t bits = 0;
+        if(high > low){
+            int palette[8] = {high, low};
+            for(int i = 2; i < 8; i++)
+                palette[i] = ((8 - i) * high + (i - 1) * low + 3) / 7;
+
+            for(int i = 0; i < 16; i++){
+                int best = 0;
+                for(int j = 1; j < 8; j++)
+                    if(std::abs(block.texels[i][channel] - palette[j]) < std::abs(block.texels[i][channel] - palette[best]))
+                        best = j;
+                bits |= (uint64_t)best << (3 * i);
+            }
+        }
+
+        for(int i = 0; i < 6; i++)
+            out[2 + i] = (uint8_t)(bits >> (8 * i));
+    }
+
+    void decode_bc1(const uint8_t* in, Block& block){
+        uint16_t c0 = in[0] | (in[1] << 8), c1 = in[2] | (in[3] << 8);
+        int palette[4][4];
+        from_565(c0, palette[0]);
+        from_565(c1, palette[1]);
+        for(int c = 0; c < 4; c++){
+            if(c0 > c1){
+                palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+                palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+            } else {
+                palette[2][c] = (palette[0][c] + palette[1][c]) / 2;
+                palette[3][c] = 0;
+            }
+        }
+
+        uint32_t bits = in[4] | (in[5] << 8) | (in[6] << 16) | ((uint32_t)in[7] << 24);
+        for(int i = 0; i < 16; i++)
+            for(int c = 0; c < 4; c++)
+                block.texels[i][c] = (uint8_t)palette[(bits >> (2 * i)) & 3][c];
+    }
+
+    void decode_bc4(const uint8_t* in, int channel, Block& block){
+        int palette[8] = {in[0], in[1]};
+        if(palette[0] > palette[1]){
+            for(int i = 2; i < 8; i++)
+                palette[i] = ((8 - i) * palette[0] + (i - 1) * palette[1] + 3) / 7;
+        } else {
+            for(int i = 2; i < 6; i++)
+                palette[i] = ((6 - i) * palette[0] + (i - 1) * palette[1] + 2) / 5;
+            palette[6] = 0;
+            palette[7] = 255;
+        }
+
+        uint64_t bits = 0;
+        for(int i = 0; i < 6; i++)
+            bits |= (uint64_t)in[2 + i] << (8 * i);
+        for(int i = 0; i < 16; i++)
+            block.texels[i][channel] = (uint8_t)palette[(bits >> (3 * i)) & 7];
+    }
+
+    // Only mode 6, one pair of RGBA endpoints with 7 bits per channel plus a low bit shared by each endpoint, and 16 weights.
+    // That's what encoders pick for most blocks that aren't split by an edge, the partitioned modes would need a search that isn't worth it here
+    void encode_bc7(const Block& block, uint8_t* out){
+        constexpr int weights64[16] = {0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64};
+        float weights[16];
+        for(int i = 0; i < 16; i++)
+            weights[i] = weights64[i] / 64.0f;
+
+        struct Endpoint {
+            int q[4], p;
+        };
+        auto quantize = [](const float* e){
+            Endpoint best{};
+            float best_error = std::numeric_limits<float>::max();
+            for(int p = 0; p < 2; p++){
+                Endpoint candidate{.q = {}, .p = p};
+                float error = 0.0f;
+                for(int c = 0; c < 4; c++){
+                    candidate.q[c] = std::clamp((int)std::lround((e[c] - p) / 2.0f), 0, 127);
+                    float d = (2 * candidate.q[c] + p) - e[c];
+                    error += d * d;
+                }
+
+                if(error < best_error){
+                    best_error = error;
+                    best = candidate;
+                }
+            }
+            return best;
+        };
+
+        float e[2][4];
+        fit_line<4>(block, e[0], e[1]);
+
+        Endpoint best[2] = {};
+        uint8_t best_indices[16] = {};
+        int best_error = std::numeric_limits<int>::max();
+        for(int pass = 0; pass < 2; pass++){
+            Endpoint q[2] = {quantize(e[0]), quantize(e[1])};
+            int palette[16][4];
+            for(int i = 0; i < 16; i++)
+                for(int c = 0; c < 4; c++)
+                    palette[i][c] = ((64 - weights64[i]) * (2 * q[0].q[c] + q[0].p) + weights64[i] * (2 * q[1].q[c] + q[1].p) + 32) >> 6;
+
+            uint8_t indices[16];
+            int error = assign<4>(block, palette, 16, indices);
+            if(error < best_error){
+                best_error = error;
+                best[0] = q[0];
+                best[1] = q[1];
+                std::copy(indices, indices + 16, best_indices);
+            }
+
+            refit<4>(block, indices, weights, e[0], e[1]);
+        }
+
+        // The first texel's index is stored without its top bit
+        if(best_indices[0] & 8){
+            std::swap(best[0], best[1]);
+            for(auto& index : best_indices)
+                index = 15 - index;
+        }
+
+        uint64_t bits[2] = {};
+        size_t position = 0;
+        auto put = [&](uint32_t value, int count){
+            for(int i = 0; i < count; i++, position++)
+                if((value >> i) & 1)
+                    bits[position / 64] |= 1ull << (position % 64);
+        };
+
+        put(1 << 6, 7);
+        for(int c = 0; c < 4; c++){
+            put(best[0].q[c], 7);
+            put(best[1].q[c], 7);
+        }
+        put(best[0].p, 1);
+        put(best[1].p, 1);
+        put(best_indices[0], 3);
+        for(int i = 1; i < 16; i++)
+            put(best_indices[i], 4);
+
+        for(int i = 0; i < 16; i++)
+            out[i] = (uint8_t)(bits[i / 8] >> (8 * (i % 8)));
+    }
+}
+
+size_t benzene::texture_baker::block_size(Compression compression){
+    switch (compression){
+        case Compression::Bc1: return 8;
+        case Compression::Bc3:
+        case Compression::Bc5:
+        case Compression::Bc7: return 16;
+        case Compression::None: break;
+    }
+
+    return 0;
+}
+
+std::vector<uint8_t> benzene::texture_baker::downsample(const uint8_t* pixels, int width, int height, int channels, Texture::Gamut gamut, Isa isa){
+    int level_width = std::max(width / 2, 1), level_height = std::max(height / 2, 1);
+    std::vector<uint8_t> level((size_t)level_width * level_height * channels);
+
+    const auto& t = tables();
+    const int colour = (gamut == Texture::Gamut::Srgb) ? 1 : 0;
+    const int table[4] = {colour, colour, colour, 0};
+
+    jobs::parallel_for(0, level_height, row_grain, [&](size_t begin, size_t end){
+        // Widened to 4 floats per pixel. Levels round down like GL's own, so an odd size has fewer than 2 taps per source texel,
+        // every tap then averages its share of the source instead of a single texel and the last row or column still counts
+        std::vector<float> rows[2] = {std::vector<float>((size_t)level_width * 8), std::vector<float>((size_t)level_width * 8)};
+        std::vector<uint16_t> filtered((size_t)level_width * 4);
+        for(size_t y = begin; y < end; y++){
+            for(int r = 0; r < 2; r++){
+                float* dst = rows[r].data();
+                std::fill(rows[r].begin(), rows[r].end(), 0.0f);
+                for_each_source(y * 2 + r, 2 * level_height, height, [&](int sy, float wy){
+                    const uint8_t* src = pixels + (size_t)sy * width * channels;
+                    for(int x = 0; x < 2 * level_width; x++)
+                        for_each_source(x, 2 * level_width, width, [&](int sx, float wx){
+                            for(int c = 0; c < 4; c++)
+                                dst[4 * x + c] += wy * wx * ((c < channels) ? t.to_linear[table[c]][src[sx * channels + c]] : 1.0f);
+                        });
+                });
+            }
+
+            switch (isa){
+                #ifdef BENZENE_SIMD_X86
+                case Isa::Avx2:
+                case Isa::Sse4: impl::filter_rows_sse4(rows[0].data(), rows[1].data(), level_width, filtered.data()); break;
+                #endif
+                default: impl::filter_rows_scalar(rows[0].data(), rows[1].data(), level_width, filtered.data()); break;
+            }
+
+            uint8_t* out = level.data() + y * level_width * channels;
+            for(int x = 0; x < level_width; x++)
+                for(int c = 0; c < channels; c++)
+                    out[x * channels + c] = t.from_linear[table[c]][filtered[4 * x + c]];
+        }
+    });
+
+    return level;
+}
+
+void benzene::texture_baker::impl::filter_rows_scalar(const float* row0, const float* row1, size_t width, uint16_t* out){
+    for(size_t x = 0; x < width; x++)
+        for(size_t c = 0; c < 4; c++){
+            float top = row0[8 * x + c] + row0[8 * x + 4 + c];
+            float bottom = row1[8 * x + c] + row1[8 * x + 4 + c];
+            out[4 * x + c] = (uint16_t)std::nearbyint(((top + bottom) * 0.25f) * 65535.0f);
+        }
+}
+
+void benzene::texture_baker::encode(const uint8_t* pixels, int width, int height, int channels, Compression compression, uint8_t* out){
+    int blocks_x = (width + 3) / 4, blocks_y = (height + 3) / 4;
+    auto size = block_size(compression);
+
+    jobs::parallel_for(0, blocks_y, std::max<size_t>(block_grain / blocks_x, 1), [&](size_t begin, size_t end){
+        for(size_t by = begin; by < end; by++){
+            for(int bx = 0; bx < blocks_x; bx++){
+                auto block = load_block(pixels, width, height, channels, bx, (int)by);
+                auto* o = out + (by * blocks_x + bx) * size;
+                switch (compression){
+                    case Compression::Bc1: encode_bc1(block, o); break;
+                    case Compression::Bc3: encode_bc4(block, 3, o); encode_bc1(block, o + 8); break;
+                    case Compression::Bc5: encode_bc4(block, 0, o); encode_bc4(block, 1, o + 8); break;
+                    case Compression::Bc7: encode_bc7(block, o); break;
+                    case Compression::None: break;
+                }
+            }
+        }
+    });
+}
+
+std::vector<uint8_t> benzene::texture_baker::decode(const uint8_t* blocks, int width, int height, Compression compression){
+    if(compression != Compression::Bc1 && compression != Compression::Bc3){
+        print("benzene/texture: Can't decode {:s} blocks\n", Texture::compression_to_str(compression));
+        throw std::runtime_error("benzene/texture: Unsupported texture decode");
+    }
+
+    int blocks_x = (width + 3) / 4, blocks_y = (height + 3) / 4;
+    auto size = block_size(compression);
+    std::vector<uint8_t> pixels((size_t)width * height * 4);
+
+    jobs::parallel_for(0, blocks_y, std::max<size_t>(block_grain / blocks_x, 1), [&](size_t begin, size_t end){
+        for(size_t by = begin; by < end; by++){
+            for(int bx = 0; bx < blocks_x; bx++){
+                const auto* in = blocks + (by * blocks_x + bx) * size;
+                Block block;
+                if(compression == Compression::Bc3){
+                    decode_bc1(in + 8, block);
+                    decode_bc4(in, 3, block);
+                } else {
+                    decode_bc1(in, block);
+                }
+
+                // Blocks sticking out of the image only hold repeated edge pixels
+                for(int y = 0; y < 4 && (int)by * 4 + y < height; y++)
+                    for(int x = 0; x < 4 && bx * 4 + x < width; x++)
+                        std::copy(block.texels[y * 4 + x], block.texels[y * 4 + x] + 4, pixels.data() + (((by * 4 + y) * width) + bx * 4 + x) * 4);
+            }
+        }
+    });
+
+    return pixels;
+}
+
+texture_baker::Baked benzene::texture_baker::bake(const uint8_t* pixels, int width, int height, int channels, Texture::Gamut gamut, Compression compression){
+    if(compression == Compression::None || (channels != 3 && channels != 4)){
+        print("benzene/texture: Can't bake {:d} channel pixels to {:s}\n", channels, Texture::compression_to_str(compression));
+        throw std::runtime_error("benzene/texture: Unsupported texture bake");
+    }
+
+    Baked baked{.source_hash = 0, .width = width, .height = height, .channels = channels, .compression = compression, .gamut = gamut, .levels = {}, .data = nullptr, .size = 0};
+
+    // Coarsest first, the same order as in the file
+    int n_levels = level_count(width, height);
+    baked.levels.resize(n_levels);
+    uint64_t offset = 0;
+    for(int level = n_levels - 1; level >= 0; level--){
+        const auto [level_width, level_height] = level_size(width, height, level);
+        baked.levels[level] = {.offset = offset, .size = level_bytes(level_width, level_height, compression), .width = level_width, .height = level_height};
+        offset = align_up(offset + baked.levels[level].size);
+    }
+
+    auto* data = new uint8_t[offset]();
+    baked.data = std::shared_ptr<const uint8_t>{data, std::default_delete<const uint8_t[]>{}};
+    baked.size = offset;
+
+    // Every level is filtered from the one above it, so they're done one after another with the work within each level spread out
+    std::vector<uint8_t> previous{};
+    const uint8_t* level_pixels = pixels;
+    for(int level = 0; level < n_levels; level++){
+        const auto& l = baked.levels[level];
+        encode(level_pixels, l.width, l.height, channels, compression, data + l.offset);
+        if((level + 1) < n_levels){
+            previous = downsample(level_pixels, l.width, l.height, channels, gamut);
+            level_pixels = previous.data();
+        }
+    }
+
+    return baked;
+}
+
+std::optional<texture_baker::Baked> benzene::texture_baker::read(const std::string& path){
+    std::shared_ptr<MappedFile> file;
+    try {
+        file = std::make_shared<MappedFile>(path);
+    } catch(const std::exception&){
+        return std::nullopt;
+    }
+
+    const auto* base = file->data();
+    auto size = file->size();
+
+    Header header{};
+    if(size < sizeof(Header))
+        return std::nullopt;
+    std::memcpy(&header, base, sizeof(Header));
+
+    if(!std::equal(header.magic, header.magic + 8, magic) || header.version != version)
+        return std::nullopt;
+
+    auto compression = (Compression)header.compression;
+    bool valid = block_size(compression) != 0 && header.gamut <= (uint32_t)Texture::Gamut::Srgb && (header.channels == 3 || header.channels == 4) &&
+                 header.width > 0 && header.width <= max_size && header.height > 0 && header.height <= max_size &&
+                 header.level_count == (uint32_t)level_count(header.width, header.height) && (size - sizeof(Header)) / sizeof(LevelEntry) >= header.level_count;
+    if(!valid){
+        print("benzene/texture: Ignoring damaged baked texture {:s}\n", path);
+        return std::nullopt;
+    }
+
+    Baked baked{.source_hash = header.source_hash, .width = (int)header.width, .height = (int)header.height, .channels = (int)header.channels,
+                .compression = compression, .gamut = (Texture::Gamut)header.gamut, .levels = {}, .data = nullptr, .size = size};
+    for(uint32_t level = 0; level < header.level_count; level++){
+        LevelEntry entry{};
+        std::memcpy(&entry, base + sizeof(Header) + level * sizeof(LevelEntry), sizeof(LevelEntry));
+
+        const auto [level_width, level_height] = level_size(baked.width, baked.height, level);
+        if(entry.size != level_bytes(level_width, level_height, compression) || entry.offset > size || entry.size > (size - entry.offset) || (entry.offset % level_alignment) != 0){
+            print("benzene/texture: Ignoring damaged baked texture {:s}\n", path);
+            return std::nullopt;
+        }
+        baked.levels.push_back({.offset = entry.offset, .size = entry.size, .width = level_width, .height = level_height});
+    }
+
+    baked.data = std::shared_ptr<const uint8_t>{file, (const uint8_t*)base};
+    return baked;
+}
+
+bool benzene::texture_baker::write(const std::string& path, const Baked& baked){
+    Header header{};
+    std::copy(magic, magic + 8, header.magic);
+    header.version = version;
+    header.compression = (uint32_t)baked.compression;
+    header.gamut = (uint32_t)baked.gamut;
+    header.width = baked.width;
+    header.height = baked.height;
+    header.channels = baked.channels;
+    header.level_count = baked.levels.size();
+    header.source_hash = baked.source_hash;
+
+    // Coarsest level first like KTX2, so streaming it in from the front gets a usable texture soonest
+    std::vector<LevelEntry> index(baked.levels.size());
+    uint64_t offset = align_up(sizeof(Header) + index.size() * sizeof(LevelEntry));
+    for(size_t level = index.size(); level-- > 0;){
+        index[level] = {.offset = offset, .size = baked.levels[level].size};
+        offset = align_up(offset + index[level].size);
+    }
+
+    // Written next to the file and then moved over it, so a reader never maps a half written one
+    auto temporary_path = path + ".tmp";
+    std::ofstream file{temporary_path, std::ios::binary | std::ios::trunc};
+    if(!file.is_open()){
+        print("benzene/texture: Failed to open baked texture {:s} for writing\n", path);
+        return false;
+    }
+
+    uint64_t written = 0;
+    auto write = [&file, &written](const void* data, uint64_t size){
+        file.write((const char*)data, size);
+        written += size;
+    };
+    auto pad_to = [&](uint64_t target){
+        constexpr char zeros[level_alignment] = {};
+        write(zeros, target - written);
+    };
+
+    write(&header, sizeof(Header));
+    write(index.data(), index.size() * sizeof(LevelEntry));
+    for(size_t level = index.size(); level-- > 0;){
+        pad_to(index[level].offset);
+        write(baked.data.get() + baked.levels[level].offset, index[level].size);
+    }
+
+    file.close();
+    if(!file || std::rename(temporary_path.c_str(), path.c_str()) != 0){
+        print("benzene/texture: Failed to write baked texture {:s}\n", path);
+        std::remove(temporary_path.c_str());
+        return false;
+    }
+
+    return true;
+}
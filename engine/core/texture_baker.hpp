@@ -0,0 +1,54 @@
+#pragma once
+
+#include <benzene/benzene.hpp>
+#include "transform_kernel.hpp"
+#include "texture_baker_simd.hpp"
+
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+namespace benzene::texture_baker
+{
+    using transform_kernel::Isa;
+    using transform_kernel::best_isa;
+
+    // The .bzt file holding an image baked for `compression` and `gamut`, both change what's stored so every combination gets its own
+    inline std::string path_for(const std::string& image_path, Texture::Compression compression, Texture::Gamut gamut){
+        return image_path + "." + Texture::compression_to_str(compression) + "." + Texture::gamut_to_str(gamut) + ".bzt";
+    }
+
+    // Bytes per 4x4 block
+    size_t block_size(Texture::Compression compression);
+
+    // A compressed mip chain down to 1x1, `levels` point into `data` and go from the finest to the coarsest
+    struct Baked {
+        // benzene::content_hash of the image file it was made from
+        uint64_t source_hash;
+        int width, height, channels;
+        Texture::Compression compression;
+        Texture::Gamut gamut;
+        std::vector<Texture::Level> levels;
+        std::shared_ptr<const uint8_t> data;
+        size_t size;
+    };
+
+    // Box filters 3 or 4 channel pixels down to the next mip level, half the size rounded down but at least 1 pixel.
+    // Colour channels of Srgb pixels are averaged in linear space so the levels don't get darker, alpha is always linear
+    std::vector<uint8_t> downsample(const uint8_t* pixels, int width, int height, int channels, Texture::Gamut gamut, Isa isa = best_isa());
+    // Encodes 3 or 4 channel pixels into rows of 4x4 blocks, starting at the first row of pixels, with the rows of blocks split across the job system.
+    // Blocks sticking out of the image repeat its edge pixels
+    void encode(const uint8_t* pixels, int width, int height, int channels, Texture::Compression compression, uint8_t* out);
+    // The other way around for BC1 and BC3, into 4 channel pixels. For drivers without S3TC, which can still sample them that way
+    std::vector<uint8_t> decode(const uint8_t* blocks, int width, int height, Texture::Compression compression);
+    // Makes the mip chain and encodes every level of it, `source_hash` is left 0
+    Baked bake(const uint8_t* pixels, int width, int height, int channels, Texture::Gamut gamut, Texture::Compression compression);
+
+    // Maps `path` and points the levels into the mapping without copying them. Missing or damaged files return nothing, whether it was baked from the right image is up to the caller
+    std::optional<Baked> read(const std::string& path);
+    // Laid out like a KTX2 file, a header and an index of the levels followed by the levels from the coarsest to the finest. Returns false if it couldn't be written
+    bool write(const std::string& path, const Baked& baked);
+} // namespace benzene::texture_baker
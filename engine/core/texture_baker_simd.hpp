@@ -0,0 +1,14 @@
+#pragma once
+
+// Shared between the per-ISA translation units, like transform_kernel_simd.hpp this has to stay free of anything with external linkage
+
+#include <cstddef>
+#include <cstdint>
+
+namespace benzene::texture_baker::impl
+{
+    // Averages the 2x2 squares of two rows of 2 * `width` linear RGBA pixels, then quantizes the `width` results to 16 bits per channel
+    // for the table going back from linear. Both paths add in the same order and round to even, so they produce identical bits
+    void filter_rows_scalar(const float* row0, const float* row1, size_t width, uint16_t* out);
+    void filter_rows_sse4(const float* row0, const float* row1, size_t width, uint16_t* out);
+} // namespace benzene::texture_baker::impl
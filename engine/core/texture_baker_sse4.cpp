@@ -0,0 +1,24 @@
+#include "texture_baker_simd.hpp"
+
+#include <smmintrin.h>
+
+void benzene::texture_baker::impl::filter_rows_sse4(const float* row0, const float* row1, size_t width, uint16_t* out){
+    const __m128 quarter = _mm_set1_ps(0.25f);
+    const __m128 scale = _mm_set1_ps(65535.0f);
+
+    // A pixel is exactly one register, its 2x2 square is 4 loads
+    auto filter = [&](size_t x){
+        __m128 top = _mm_add_ps(_mm_loadu_ps(row0 + 8 * x), _mm_loadu_ps(row0 + 8 * x + 4));
+        __m128 bottom = _mm_add_ps(_mm_loadu_ps(row1 + 8 * x), _mm_loadu_ps(row1 + 8 * x + 4));
+        return _mm_cvtps_epi32(_mm_mul_ps(_mm_mul_ps(_mm_add_ps(top, bottom), quarter), scale));
+    };
+
+    size_t x = 0;
+    for(; (x + 2) <= width; x += 2)
+        _mm_storeu_si128((__m128i*)(out + 4 * x), _mm_packus_epi32(filter(x), filter(x + 1)));
+
+    if(x < width){
+        __m128i last = filter(x);
+        _mm_storel_epi64((__m128i*)(out + 4 * x), _mm_packus_epi32(last, last));
+    }
+}
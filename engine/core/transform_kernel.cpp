@@ -0,0 +1,232 @@
+#include "transform_kernel.hpp"
+#include "transform_kernel_simd.hpp"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <random>
+
+using namespace benzene::transform_kernel;
+
+void TransformStore::resize(size_t n){
+    this->n = n;
+    for(auto& component : components)
+        component.resize(n);
+}
+
+void TransformStore::gather(const std::vector<Batch::Transform>& transforms, size_t begin, size_t end){
+    assert(end <= n && end <= transforms.size());
+    for(size_t i = begin; i < end; i++){
+        const auto& transform = transforms[i];
+        for(int j = 0; j < 3; j++){
+            components[j][i] = transform.pos[j];
+            components[3 + j][i] = transform.rotation[j];
+            components[6 + j][i] = transform.scale[j];
+        }
+    }
+}
+
+TransformsSoA TransformStore::view(size_t i) const {
+    TransformsSoA soa{};
+    for(int j = 0; j < 3; j++){
+        soa.pos[j] = components[j].data();
+        soa.rotation[j] = components[3 + j].data();
+        soa.scale[j] = components[6 + j].data();
+    }
+
+    return soa.offset(i);
+}
+
+const char* benzene::transform_kernel::isa_to_str(Isa isa){
+    switch (isa){
+        case Isa::Scalar: return "scalar";
+        case Isa::Sse4: return "SSE4.1";
+        case Isa::Avx2: return "AVX2";
+    }
+
+    return "unknown";
+}
+
+Isa benzene::transform_kernel::best_isa(){
+    #ifdef BENZENE_SIMD_X86
+    static const Isa isa = []{
+        __builtin_cpu_init();
+        // The AVX2 library is also built with F16C for the vertex packing, every AVX2 CPU has both but check anyway
+        if(__builtin_cpu_supports("avx2") && __builtin_cpu_supports("f16c"))
+            return Isa::Avx2;
+        if(__builtin_cpu_supports("sse4.1"))
+            return Isa::Sse4;
+        return Isa::Scalar;
+    }();
+    return isa;
+    #else
+    return Isa::Scalar;
+    #endif
+}
+
+void benzene::transform_kernel::build_matrices(const TransformsSoA& in, size_t n, float* out, Isa isa){
+    switch (isa){
+        #ifdef BENZENE_SIMD_X86
+        case Isa::Avx2: impl::build_matrices_avx2(in, n, out); break;
+        case Isa::Sse4: impl::build_matrices_sse4(in, n, out); break;
+        #endif
+        default: impl::build_matrices_scalar(in, n, out); break;
+    }
+}
+
+void benzene::transform_kernel::impl::build_matrices_scalar(const TransformsSoA& in, size_t n, float* out){
+    constexpr float deg_to_rad = 0.0174532925199432957f;
+    for(size_t i = 0; i < n; i++){
+        float sx = std::sin(in.rotation[0][i] * deg_to_rad), cx = std::cos(in.rotation[0][i] * deg_to_rad);
+        float sy = std::sin(in.rotation[1][i] * deg_to_rad), cy = std::cos(in.rotation[1][i] * deg_to_rad);
+        float sz = std::sin(in.rotation[2][i] * deg_to_rad), cz = std::cos(in.rotation[2][i] * deg_to_rad);
+
+        // Columns of R = Ry * Rz * Rx
+        const float r[3][3] = {
+            {cy * cz, sz, -sy * cz},
+            {sx * sy - cx * cy * sz, cx * cz, cx * sy * sz + sx * cy},
+            {sx * cy * sz + cx * sy, -sx * cz, cx * cy - sx * sy * sz}
+        };
+        const float t[3] = {in.pos[0][i], in.pos[1][i], in.pos[2][i]};
+
+        float* model = out + i * floats_per_instance;
+        float* normal = model + 16;
+        for(int col = 0; col < 3; col++){
+            float s = in.scale[col][i];
+            float inv_s = 1.0f / s;
+            float d = r[col][0] * t[0] + r[col][1] * t[1] + r[col][2] * t[2];
+
+            for(int row = 0; row < 3; row++){
+                model[col * 4 + row] = r[col][row] * s;
+                normal[col * 4 + row] = r[col][row] * inv_s;
+            }
+            model[col * 4 + 3] = 0.0f;
+            normal[col * 4 + 3] = -d * inv_s;
+        }
+
+        model[12] = t[0]; model[13] = t[1]; model[14] = t[2]; model[15] = 1.0f;
+        normal[12] = 0.0f; normal[13] = 0.0f; normal[14] = 0.0f; normal[15] = 1.0f;
+    }
+}
+
+FrustumPlanes benzene::transform_kernel::extract_frustum(const glm::mat4& m){
+    auto row = [&m](int i) -> glm::vec4 {
+        return {m[0][i], m[1][i], m[2][i], m[3][i]};
+    };
+
+    // Left, right, bottom, top, near, far, GL clip space is -w <= x, y, z <= w
+    const glm::vec4 planes[6] = {row(3) + row(0), row(3) - row(0), row(3) + row(1), row(3) - row(1), row(3) + row(2), row(3) - row(2)};
+
+    FrustumPlanes frustum{};
+    for(int i = 0; i < 6; i++){
+        auto length = glm::length(glm::vec3{planes[i]});
+        for(int j = 0; j < 4; j++)
+            frustum.planes[i][j] = planes[i][j] / length;
+    }
+
+    return frustum;
+}
+
+size_t benzene::transform_kernel::cull_spheres(const TransformsSoA& in, size_t n, const FrustumPlanes& frustum, float radius, uint32_t first_index, uint32_t* out, Isa isa){
+    switch (isa){
+        #ifdef BENZENE_SIMD_X86
+        case Isa::Avx2: return impl::cull_spheres_avx2(in, n, frustum, radius, first_index, out);
+        case Isa::Sse4: return impl::cull_spheres_sse4(in, n, frustum, radius, first_index, out);
+        #endif
+        default: return impl::cull_spheres_scalar(in, n, frustum, radius, first_index, out);
+    }
+}
+
+size_t benzene::transform_kernel::impl::cull_spheres_scalar(const TransformsSoA& in, size_t n, const FrustumPlanes& frustum, float radius, uint32_t first_index, uint32_t* out){
+    size_t count = 0;
+    for(size_t i = 0; i < n; i++){
+        float p[3] = {in.pos[0][i], in.pos[1][i], in.pos[2][i]};
+        float world_radius = radius * std::max({std::abs(in.scale[0][i]), std::abs(in.scale[1][i]), std::abs(in.scale[2][i])});
+
+        bool inside = true;
+        for(const auto& plane : frustum.planes)
+            inside &= (plane[0] * p[0] + plane[1] * p[1] + plane[2] * p[2] + plane[3]) >= -world_radius;
+
+        if(inside)
+            out[count++] = first_index + i;
+    }
+
+    return count;
+}
+
+void benzene::transform_kernel::build_matrices_reference(const Batch::Transform* in, size_t n, float* out){
+    jobs::parallel_for(0, n, 1024, [&](size_t begin, size_t end){
+        for(size_t i = begin; i < end; i++){
+            auto& transform = in[i];
+            auto translate = glm::translate(glm::mat4{1.0f}, transform.pos);
+            auto scale = glm::scale(glm::mat4{1.0f}, transform.scale);
+            auto rotate = glm::rotate(glm::mat4{1.0f}, glm::radians(transform.rotation.y), glm::vec3{0.0f, 1.0f, 0.0f});
+            rotate = glm::rotate(rotate, glm::radians(transform.rotation.z), glm::vec3{0.0f, 0.0f, 1.0f});
+            rotate = glm::rotate(rotate, glm::radians(transform.rotation.x), glm::vec3{1.0f, 0.0f, 0.0f});
+
+            auto model_matrix = translate * rotate * scale;
+            auto normal_matrix = glm::transpose(glm::inverse(model_matrix));
+
+            float* model = out + i * floats_per_instance;
+            float* normal = model + 16;
+            for(int col = 0; col < 4; col++){
+                for(int row = 0; row < 4; row++){
+                    model[col * 4 + row] = model_matrix[col][row];
+                    normal[col * 4 + row] = normal_matrix[col][row];
+                }
+            }
+        }
+    });
+}
+
+std::vector<BenchmarkResult> benzene::transform_kernel::benchmark(size_t n_instances){
+    std::mt19937 rng{1234};
+    std::uniform_real_distribution<float> position{-100.0f, 100.0f}, angle{0.0f, 360.0f}, scale{0.05f, 4.0f};
+
+    std::vector<Batch::Transform> transforms{n_instances};
+    for(auto& transform : transforms){
+        transform.pos = {position(rng), position(rng), position(rng)};
+        transform.rotation = {angle(rng), angle(rng), angle(rng)};
+        transform.scale = {scale(rng), scale(rng), scale(rng)};
+    }
+
+    TransformStore store{};
+    store.resize(n_instances);
+    store.gather(transforms, 0, n_instances);
+
+    std::vector<float> reference(n_instances * floats_per_instance), result(n_instances * floats_per_instance);
+
+    constexpr size_t iterations = 10;
+    auto time = [&](auto&& f) -> double {
+        f(); // Warm up caches and wake the job workers
+        auto begin = std::chrono::high_resolution_clock::now();
+        for(size_t i = 0; i < iterations; i++)
+            f();
+        auto end = std::chrono::high_resolution_clock::now();
+
+        auto us = std::chrono::duration<double, std::micro>(end - begin).count() / iterations;
+        return n_instances / us;
+    };
+
+    auto max_error = [&]() -> float {
+        float error = 0.0f;
+        for(size_t i = 0; i < result.size(); i++)
+            error = std::max(error, std::abs(result[i] - reference[i]) / std::max(1.0f, std::abs(reference[i])));
+        return error;
+    };
+
+    std::vector<BenchmarkResult> results{};
+    results.push_back({.name = "glm (jobs)", .instances_per_us = time([&]{ build_matrices_reference(transforms.data(), n_instances, reference.data()); }), .max_error = 0.0f});
+
+    for(auto isa : {Isa::Scalar, Isa::Sse4, Isa::Avx2}){
+        if(isa > best_isa())
+            break;
+
+        auto throughput = time([&]{ build_matrices(store.view(), n_instances, result.data(), isa); });
+        results.push_back({.name = isa_to_str(isa), .instances_per_us = throughput, .max_error = max_error()});
+    }
+
+    return results;
+}
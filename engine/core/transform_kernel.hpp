@@ -0,0 +1,50 @@
+#pragma once
+
+#include <benzene/benzene.hpp>
+#include "transform_soa.hpp"
+
+#include <vector>
+#include <cstddef>
+
+namespace benzene::transform_kernel
+{
+    // SoA mirror of a Batch's transforms, so the kernels can load 4 or 8 instances worth of a component at once
+    class TransformStore {
+        public:
+        void resize(size_t n);
+        void gather(const std::vector<Batch::Transform>& transforms, size_t begin, size_t end);
+        TransformsSoA view(size_t i = 0) const;
+
+        private:
+        size_t n = 0;
+        std::vector<float> components[9];
+    };
+
+    enum class Isa {
+        Scalar,
+        Sse4,
+        Avx2
+    };
+    const char* isa_to_str(Isa isa);
+    Isa best_isa();
+
+    // Builds the matrices in closed form, the rotation is expanded directly and the normal matrix is R * S^-1 instead of a general 4x4 inverse
+    void build_matrices(const TransformsSoA& in, size_t n, float* out, Isa isa = best_isa());
+
+    // Gribb-Hartmann plane extraction, normalized so plane distances are in world units
+    FrustumPlanes extract_frustum(const glm::mat4& view_projection);
+
+    // Writes (first_index + i) for every instance i whose bounding sphere may intersect the frustum and returns how many were written,
+    // `radius` bounds the mesh around its object space origin
+    size_t cull_spheres(const TransformsSoA& in, size_t n, const FrustumPlanes& frustum, float radius, uint32_t first_index, uint32_t* out, Isa isa = best_isa());
+
+    // The original glm path, kept around as ground truth for the kernels
+    void build_matrices_reference(const Batch::Transform* in, size_t n, float* out);
+
+    struct BenchmarkResult {
+        const char* name;
+        double instances_per_us;
+        float max_error;
+    };
+    std::vector<BenchmarkResult> benchmark(size_t n_instances);
+} // namespace benzene::transform_kernel
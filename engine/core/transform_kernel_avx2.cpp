@@ -0,0 +1,59 @@
+#include "transform_kernel_simd.hpp"
+
+#include <immintrin.h>
+
+namespace {
+    struct Avx2 {
+        using V = __m256;
+        using I = __m256i;
+        static constexpr size_t width = 8;
+
+        static V set1(float f) { return _mm256_set1_ps(f); }
+        static V load(const float* p) { return _mm256_loadu_ps(p); }
+        static V and_ps(V a, V b) { return _mm256_and_ps(a, b); }
+        static V andnot_ps(V a, V b) { return _mm256_andnot_ps(a, b); }
+        static V or_ps(V a, V b) { return _mm256_or_ps(a, b); }
+        static V xor_ps(V a, V b) { return _mm256_xor_ps(a, b); }
+        static V cvt_ps(I a) { return _mm256_cvtepi32_ps(a); }
+        static V cast_ps(I a) { return _mm256_castsi256_ps(a); }
+
+        static V max_ps(V a, V b) { return _mm256_max_ps(a, b); }
+        static V cmpge_ps(V a, V b) { return _mm256_cmp_ps(a, b, _CMP_GE_OQ); }
+        static int movemask_ps(V a) { return _mm256_movemask_ps(a); }
+
+        static I set1_epi32(int i) { return _mm256_set1_epi32(i); }
+        static I cvtt_epi32(V a) { return _mm256_cvttps_epi32(a); }
+        static I add_epi32(I a, I b) { return _mm256_add_epi32(a, b); }
+        static I sub_epi32(I a, I b) { return _mm256_sub_epi32(a, b); }
+        static I and_epi32(I a, I b) { return _mm256_and_si256(a, b); }
+        static I andnot_epi32(I a, I b) { return _mm256_andnot_si256(a, b); }
+        static I cmpeq_epi32(I a, I b) { return _mm256_cmpeq_epi32(a, b); }
+        static I slli_epi32_29(I a) { return _mm256_slli_epi32(a, 29); }
+
+        // Lane l of the inputs is column (c0[l], c1[l], c2[l], c3[l]) of instance l, done as two 4x4 transposes
+        static void store_columns(float* out, size_t stride, V c0, V c1, V c2, V c3){
+            __m128 lo0 = _mm256_castps256_ps128(c0), lo1 = _mm256_castps256_ps128(c1), lo2 = _mm256_castps256_ps128(c2), lo3 = _mm256_castps256_ps128(c3);
+            __m128 hi0 = _mm256_extractf128_ps(c0, 1), hi1 = _mm256_extractf128_ps(c1, 1), hi2 = _mm256_extractf128_ps(c2, 1), hi3 = _mm256_extractf128_ps(c3, 1);
+
+            _MM_TRANSPOSE4_PS(lo0, lo1, lo2, lo3);
+            _MM_TRANSPOSE4_PS(hi0, hi1, hi2, hi3);
+
+            _mm_storeu_ps(out, lo0);
+            _mm_storeu_ps(out + stride, lo1);
+            _mm_storeu_ps(out + 2 * stride, lo2);
+            _mm_storeu_ps(out + 3 * stride, lo3);
+            _mm_storeu_ps(out + 4 * stride, hi0);
+            _mm_storeu_ps(out + 5 * stride, hi1);
+            _mm_storeu_ps(out + 6 * stride, hi2);
+            _mm_storeu_ps(out + 7 * stride, hi3);
+        }
+    };
+} // namespace
+
+void benzene::transform_kernel::impl::build_matrices_avx2(const TransformsSoA& in, size_t n, float* out){
+    build_matrices_simd<Avx2>(in, n, out);
+}
+
+size_t benzene::transform_kernel::impl::cull_spheres_avx2(const TransformsSoA& in, size_t n, const FrustumPlanes& frustum, float radius, uint32_t first_index, uint32_t* out){
+    return cull_spheres_simd<Avx2>(in, n, frustum, radius, first_index, out);
+}
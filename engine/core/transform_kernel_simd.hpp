@@ -0,0 +1,143 @@
+#pragma once
+
+// Shared between the per-ISA translation units, so this can't pull in anything with external linkage that
+// would get compiled with different instruction sets in different places
+
+#include "transform_soa.hpp"
+
+namespace benzene::transform_kernel::impl
+{
+    void build_matrices_scalar(const TransformsSoA& in, size_t n, float* out);
+    void build_matrices_sse4(const TransformsSoA& in, size_t n, float* out);
+    void build_matrices_avx2(const TransformsSoA& in, size_t n, float* out);
+
+    size_t cull_spheres_scalar(const TransformsSoA& in, size_t n, const FrustumPlanes& frustum, float radius, uint32_t first_index, uint32_t* out);
+    size_t cull_spheres_sse4(const TransformsSoA& in, size_t n, const FrustumPlanes& frustum, float radius, uint32_t first_index, uint32_t* out);
+    size_t cull_spheres_avx2(const TransformsSoA& in, size_t n, const FrustumPlanes& frustum, float radius, uint32_t first_index, uint32_t* out);
+
+    // Cephes style sincos, accurate to a few ulp for the range of angles transforms use
+    template<typename Ops>
+    inline void sincos(typename Ops::V x, typename Ops::V& s, typename Ops::V& c){
+        using V = typename Ops::V;
+        using I = typename Ops::I;
+
+        const V sign_mask = Ops::cast_ps(Ops::set1_epi32((int)0x80000000));
+        const V four_over_pi = Ops::set1(1.27323954473516f);
+
+        V sign_bit_sin = Ops::and_ps(x, sign_mask);
+        x = Ops::andnot_ps(sign_mask, x);
+
+        I j = Ops::cvtt_epi32(x * four_over_pi);
+        j = Ops::and_epi32(Ops::add_epi32(j, Ops::set1_epi32(1)), Ops::set1_epi32(~1));
+        V y = Ops::cvt_ps(j);
+
+        V swap_sign_bit_sin = Ops::cast_ps(Ops::slli_epi32_29(Ops::and_epi32(j, Ops::set1_epi32(4))));
+        V poly_mask = Ops::cast_ps(Ops::cmpeq_epi32(Ops::and_epi32(j, Ops::set1_epi32(2)), Ops::set1_epi32(0)));
+        V sign_bit_cos = Ops::cast_ps(Ops::slli_epi32_29(Ops::andnot_epi32(Ops::sub_epi32(j, Ops::set1_epi32(2)), Ops::set1_epi32(4))));
+        sign_bit_sin = Ops::xor_ps(sign_bit_sin, swap_sign_bit_sin);
+
+        // Extended precision modular arithmetic, x = ((x - y * DP1) - y * DP2) - y * DP3
+        x = x - y * Ops::set1(0.78515625f);
+        x = x - y * Ops::set1(2.4187564849853515625e-4f);
+        x = x - y * Ops::set1(3.77489497744594108e-8f);
+
+        V z = x * x;
+        V cos_poly = ((Ops::set1(2.443315711809948e-5f) * z - Ops::set1(1.388731625493765e-3f)) * z + Ops::set1(4.166664568298827e-2f)) * z * z;
+        cos_poly = cos_poly - z * Ops::set1(0.5f) + Ops::set1(1.0f);
+
+        V sin_poly = ((Ops::set1(-1.9515295891e-4f) * z + Ops::set1(8.3321608736e-3f)) * z - Ops::set1(1.6666654611e-1f)) * z * x + x;
+
+        // Depending on the octant the two polynomials swap roles
+        V sin_result = Ops::or_ps(Ops::and_ps(poly_mask, sin_poly), Ops::andnot_ps(poly_mask, cos_poly));
+        V cos_result = Ops::or_ps(Ops::and_ps(poly_mask, cos_poly), Ops::andnot_ps(poly_mask, sin_poly));
+
+        s = Ops::xor_ps(sin_result, sign_bit_sin);
+        c = Ops::xor_ps(cos_result, sign_bit_cos);
+    }
+
+    template<typename Ops>
+    inline void build_matrices_simd(const TransformsSoA& in, size_t n, float* out){
+        using V = typename Ops::V;
+        constexpr size_t width = Ops::width;
+        constexpr size_t stride = floats_per_instance;
+
+        const V deg_to_rad = Ops::set1(0.0174532925199432957f);
+        const V zero = Ops::set1(0.0f);
+        const V one = Ops::set1(1.0f);
+
+        size_t i = 0;
+        for(; (i + width) <= n; i += width){
+            V sx, cx, sy, cy, sz, cz;
+            sincos<Ops>(Ops::load(in.rotation[0] + i) * deg_to_rad, sx, cx);
+            sincos<Ops>(Ops::load(in.rotation[1] + i) * deg_to_rad, sy, cy);
+            sincos<Ops>(Ops::load(in.rotation[2] + i) * deg_to_rad, sz, cz);
+
+            // R = Ry * Rz * Rx, the same order Batch has always applied the rotations in
+            V r00 = cy * cz, r01 = sz, r02 = zero - sy * cz;
+            V r10 = sx * sy - cx * cy * sz, r11 = cx * cz, r12 = cx * sy * sz + sx * cy;
+            V r20 = sx * cy * sz + cx * sy, r21 = zero - sx * cz, r22 = cx * cy - sx * sy * sz;
+
+            V scale_x = Ops::load(in.scale[0] + i), scale_y = Ops::load(in.scale[1] + i), scale_z = Ops::load(in.scale[2] + i);
+            V tx = Ops::load(in.pos[0] + i), ty = Ops::load(in.pos[1] + i), tz = Ops::load(in.pos[2] + i);
+
+            float* o = out + i * stride;
+            Ops::store_columns(o + 0, stride, r00 * scale_x, r01 * scale_x, r02 * scale_x, zero);
+            Ops::store_columns(o + 4, stride, r10 * scale_y, r11 * scale_y, r12 * scale_y, zero);
+            Ops::store_columns(o + 8, stride, r20 * scale_z, r21 * scale_z, r22 * scale_z, zero);
+            Ops::store_columns(o + 12, stride, tx, ty, tz, one);
+
+            // transpose(inverse(T * R * S)) has R * S^-1 as its upper 3x3 and -(S^-1 * R^T * t) as its bottom row
+            V inv_x = one / scale_x, inv_y = one / scale_y, inv_z = one / scale_z;
+            V d0 = r00 * tx + r01 * ty + r02 * tz;
+            V d1 = r10 * tx + r11 * ty + r12 * tz;
+            V d2 = r20 * tx + r21 * ty + r22 * tz;
+
+            Ops::store_columns(o + 16, stride, r00 * inv_x, r01 * inv_x, r02 * inv_x, zero - d0 * inv_x);
+            Ops::store_columns(o + 20, stride, r10 * inv_y, r11 * inv_y, r12 * inv_y, zero - d1 * inv_y);
+            Ops::store_columns(o + 24, stride, r20 * inv_z, r21 * inv_z, r22 * inv_z, zero - d2 * inv_z);
+            Ops::store_columns(o + 28, stride, zero, zero, zero, one);
+        }
+
+        if(i < n)
+            build_matrices_scalar(in.offset(i), n - i, out + i * stride);
+    }
+
+    // Bounding sphere of `radius` around the object space origin, scaled by the largest axis so the rotation never has to be looked at
+    template<typename Ops>
+    inline size_t cull_spheres_simd(const TransformsSoA& in, size_t n, const FrustumPlanes& frustum, float radius, uint32_t first_index, uint32_t* out){
+        using V = typename Ops::V;
+        constexpr size_t width = Ops::width;
+
+        const V sign_mask = Ops::cast_ps(Ops::set1_epi32((int)0x80000000));
+        const V zero = Ops::set1(0.0f);
+        const V object_radius = Ops::set1(radius);
+
+        V planes[6][4];
+        for(size_t p = 0; p < 6; p++)
+            for(size_t j = 0; j < 4; j++)
+                planes[p][j] = Ops::set1(frustum.planes[p][j]);
+
+        size_t count = 0, i = 0;
+        for(; (i + width) <= n; i += width){
+            V px = Ops::load(in.pos[0] + i), py = Ops::load(in.pos[1] + i), pz = Ops::load(in.pos[2] + i);
+
+            V sx = Ops::andnot_ps(sign_mask, Ops::load(in.scale[0] + i));
+            V sy = Ops::andnot_ps(sign_mask, Ops::load(in.scale[1] + i));
+            V sz = Ops::andnot_ps(sign_mask, Ops::load(in.scale[2] + i));
+            V neg_radius = zero - object_radius * Ops::max_ps(Ops::max_ps(sx, sy), sz);
+
+            V inside = Ops::cmpge_ps(planes[0][0] * px + planes[0][1] * py + planes[0][2] * pz + planes[0][3], neg_radius);
+            for(size_t p = 1; p < 6; p++)
+                inside = Ops::and_ps(inside, Ops::cmpge_ps(planes[p][0] * px + planes[p][1] * py + planes[p][2] * pz + planes[p][3], neg_radius));
+
+            // Compaction, one write per visible lane
+            auto mask = (uint32_t)Ops::movemask_ps(inside);
+            while(mask){
+                out[count++] = first_index + i + __builtin_ctz(mask);
+                mask &= mask - 1;
+            }
+        }
+
+        return count + cull_spheres_scalar(in.offset(i), n - i, frustum, radius, first_index + i, out + count);
+    }
+} // namespace benzene::transform_kernel::impl
@@ -0,0 +1,50 @@
+#include "transform_kernel_simd.hpp"
+
+#include <immintrin.h>
+
+namespace {
+    struct Sse4 {
+        using V = __m128;
+        using I = __m128i;
+        static constexpr size_t width = 4;
+
+        static V set1(float f) { return _mm_set1_ps(f); }
+        static V load(const float* p) { return _mm_loadu_ps(p); }
+        static V and_ps(V a, V b) { return _mm_and_ps(a, b); }
+        static V andnot_ps(V a, V b) { return _mm_andnot_ps(a, b); }
+        static V or_ps(V a, V b) { return _mm_or_ps(a, b); }
+        static V xor_ps(V a, V b) { return _mm_xor_ps(a, b); }
+        static V cvt_ps(I a) { return _mm_cvtepi32_ps(a); }
+        static V cast_ps(I a) { return _mm_castsi128_ps(a); }
+
+        static V max_ps(V a, V b) { return _mm_max_ps(a, b); }
+        static V cmpge_ps(V a, V b) { return _mm_cmpge_ps(a, b); }
+        static int movemask_ps(V a) { return _mm_movemask_ps(a); }
+
+        static I set1_epi32(int i) { return _mm_set1_epi32(i); }
+        static I cvtt_epi32(V a) { return _mm_cvttps_epi32(a); }
+        static I add_epi32(I a, I b) { return _mm_add_epi32(a, b); }
+        static I sub_epi32(I a, I b) { return _mm_sub_epi32(a, b); }
+        static I and_epi32(I a, I b) { return _mm_and_si128(a, b); }
+        static I andnot_epi32(I a, I b) { return _mm_andnot_si128(a, b); }
+        static I cmpeq_epi32(I a, I b) { return _mm_cmpeq_epi32(a, b); }
+        static I slli_epi32_29(I a) { return _mm_slli_epi32(a, 29); }
+
+        // Lane l of the inputs is column (c0[l], c1[l], c2[l], c3[l]) of instance l
+        static void store_columns(float* out, size_t stride, V c0, V c1, V c2, V c3){
+            _MM_TRANSPOSE4_PS(c0, c1, c2, c3);
+            _mm_storeu_ps(out, c0);
+            _mm_storeu_ps(out + stride, c1);
+            _mm_storeu_ps(out + 2 * stride, c2);
+            _mm_storeu_ps(out + 3 * stride, c3);
+        }
+    };
+} // namespace
+
+void benzene::transform_kernel::impl::build_matrices_sse4(const TransformsSoA& in, size_t n, float* out){
+    build_matrices_simd<Sse4>(in, n, out);
+}
+
+size_t benzene::transform_kernel::impl::cull_spheres_sse4(const TransformsSoA& in, size_t n, const FrustumPlanes& frustum, float radius, uint32_t first_index, uint32_t* out){
+    return cull_spheres_simd<Sse4>(in, n, frustum, radius, first_index, out);
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace benzene::transform_kernel
+{
+    // Every instance produces a column-major model matrix followed by its normal matrix (transpose of the inverse)
+    constexpr size_t floats_per_instance = 32;
+
+    // Structure-of-arrays view of a range of Batch::Transform's
+    struct TransformsSoA {
+        const float* pos[3];
+        const float* rotation[3];
+        const float* scale[3];
+
+        TransformsSoA offset(size_t i) const {
+            return {{pos[0] + i, pos[1] + i, pos[2] + i}, {rotation[0] + i, rotation[1] + i, rotation[2] + i}, {scale[0] + i, scale[1] + i, scale[2] + i}};
+        }
+    };
+
+    // Inward facing planes (a, b, c, d), a point p is inside when dot((a, b, c), p) + d >= 0 for all six of them
+    struct FrustumPlanes {
+        float planes[6][4];
+    };
+} // namespace benzene::transform_kernel
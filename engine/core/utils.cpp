@@ -1,9 +1,16 @@
 #include "utils.hpp"
 
+#include <cstring>
 #include <fstream>
+#include <utility>
 
 #include <stdexcept>
 
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
 std::vector<std::byte> benzene::read_binary_file(const std::string& name){
     std::ifstream file{name, std::ios::ate | std::ios::binary};
 
@@ -18,4 +25,74 @@ std::vector<std::byte> benzene::read_binary_file(const std::string& name){
 
     file.close();
     return buf;
-}
\ No newline at end of file
+}
+
+benzene::MappedFile::MappedFile(const std::string& name): ptr{nullptr}, length{0} {
+    int fd = open(name.c_str(), O_RDONLY);
+    if(fd < 0)
+        throw std::runtime_error("Failed to open file");
+
+    struct stat info{};
+    if(fstat(fd, &info) != 0){
+        close(fd);
+        throw std::runtime_error("Failed to stat file");
+    }
+
+    // Mapping 0 bytes fails, an empty file is just an empty mapping
+    length = info.st_size;
+    if(length > 0){
+        auto* mapping = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+        if(mapping == MAP_FAILED){
+            close(fd);
+            throw std::runtime_error("Failed to map file");
+        }
+
+        ptr = (std::byte*)mapping;
+    }
+
+    // The mapping keeps its own reference to the file
+    close(fd);
+}
+
+benzene::MappedFile::~MappedFile(){
+    if(ptr)
+        munmap(ptr, length);
+}
+
+benzene::MappedFile::MappedFile(MappedFile&& other) noexcept: ptr{std::exchange(other.ptr, nullptr)}, length{std::exchange(other.length, 0)} {}
+
+benzene::MappedFile& benzene::MappedFile::operator=(MappedFile&& other) noexcept {
+    if(this != &other){
+        if(ptr)
+            munmap(ptr, length);
+
+        ptr = std::exchange(other.ptr, nullptr);
+        length = std::exchange(other.length, 0);
+    }
+
+    return *this;
+}
+
+uint64_t benzene::content_hash(const std::byte* data, size_t size){
+    // 8 bytes per step keeps hashing a large model well below the cost of reading it
+    uint64_t hash = 0x9e3779b97f4a7c15 ^ size;
+    auto mix = [&hash](uint64_t word){
+        hash = (hash ^ word) * 0xff51afd7ed558ccd;
+        hash ^= hash >> 32;
+    };
+
+    size_t i = 0;
+    for(; (i + 8) <= size; i += 8){
+        uint64_t word;
+        std::memcpy(&word, data + i, sizeof(word));
+        mix(word);
+    }
+
+    // An empty file can map to nullptr, which memcpy mustn't see even for 0 bytes
+    uint64_t tail = 0;
+    if(i < size)
+        std::memcpy(&tail, data + i, size - i);
+    mix(tail);
+
+    return hash;
+}
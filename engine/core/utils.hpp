@@ -1,10 +1,40 @@
 #pragma once
 
 #include <vector>
+#include <cstddef>
 #include <cstdint>
 #include <string>
 
 namespace benzene
 {
     std::vector<std::byte> read_binary_file(const std::string& name);
+
+    // Fast non-cryptographic hash for telling file and pixel contents apart
+    uint64_t content_hash(const std::byte* data, size_t size);
+
+    // Read-only mapping of a whole file, pages are only read in once they're touched
+    class MappedFile {
+        public:
+        MappedFile(): ptr{nullptr}, length{0} {}
+        // Throws if the file can't be opened or mapped
+        explicit MappedFile(const std::string& name);
+        ~MappedFile();
+
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+        MappedFile(MappedFile&& other) noexcept;
+        MappedFile& operator=(MappedFile&& other) noexcept;
+
+        const std::byte* data() const {
+            return ptr;
+        }
+
+        size_t size() const {
+            return length;
+        }
+
+        private:
+        std::byte* ptr;
+        size_t length;
+    };
 } // namespace benzene
@@ -0,0 +1,124 @@
+#include "vertex_packing.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+using namespace benzene::vertex_packing;
+
+static_assert(sizeof(benzene::Mesh::Vertex) == layout::stride * sizeof(float), "The packing kernels read benzene::Mesh::Vertex as floats");
+static_assert(offsetof(benzene::Mesh::Vertex, pos) == layout::pos * sizeof(float));
+static_assert(offsetof(benzene::Mesh::Vertex, normal) == layout::normal * sizeof(float));
+static_assert(offsetof(benzene::Mesh::Vertex, tangent) == layout::tangent * sizeof(float));
+static_assert(offsetof(benzene::Mesh::Vertex, uv) == layout::uv * sizeof(float));
+
+uint16_t benzene::vertex_packing::float_to_half(float f){
+    uint32_t x;
+    std::memcpy(&x, &f, sizeof(x));
+
+    uint32_t sign = (x >> 16) & 0x8000;
+    uint32_t abs = x & 0x7FFFFFFF;
+
+    if(abs > 0x7F800000)
+        return sign | 0x7E00; // NaN
+    if(abs >= 0x477FF000)
+        return sign | 0x7C00; // Rounds up past 65504, or already infinite
+
+    if(abs < 0x38800000){
+        // Below 2^-14 only subnormals are left, anything under half the smallest one rounds to 0
+        if(abs < 0x33000000)
+            return sign;
+
+        uint32_t exponent = abs >> 23;
+        uint32_t mantissa = (abs & 0x7FFFFF) | 0x800000;
+        uint32_t shift = 126 - exponent;
+
+        uint32_t h = mantissa >> shift;
+        uint32_t rest = mantissa & ((1u << shift) - 1), halfway = 1u << (shift - 1);
+        if(rest > halfway || (rest == halfway && (h & 1)))
+            h++;
+        return sign | h;
+    }
+
+    // Rebias the exponent from 127 to 15, a carry out of the mantissa correctly bumps the exponent
+    uint32_t h = (abs - 0x38000000) >> 13;
+    uint32_t rest = abs & 0x1FFF;
+    if(rest > 0x1000 || (rest == 0x1000 && (h & 1)))
+        h++;
+    return sign | h;
+}
+
+float benzene::vertex_packing::half_to_float(uint16_t h){
+    uint32_t sign = (uint32_t)(h & 0x8000) << 16;
+    uint32_t exponent = (h >> 10) & 0x1F;
+    uint32_t mantissa = h & 0x3FF;
+
+    uint32_t x = 0;
+    if(exponent == 0x1F)
+        x = sign | 0x7F800000 | (mantissa << 13);
+    else if(exponent != 0)
+        x = sign | ((exponent + 112) << 23) | (mantissa << 13);
+    else if(mantissa != 0)
+        return std::ldexp((float)mantissa, -24) * (sign ? -1.0f : 1.0f);
+    else
+        x = sign;
+
+    float f;
+    std::memcpy(&f, &x, sizeof(f));
+    return f;
+}
+
+glm::vec2 benzene::vertex_packing::octahedral_encode(glm::vec3 n){
+    auto sign = [](float v){ return (v >= 0.0f) ? 1.0f : -1.0f; };
+
+    // Degenerate normals end up as (0, 0), which decodes to +Z
+    float l1 = std::max(std::abs(n.x) + std::abs(n.y) + std::abs(n.z), 1e-20f);
+    glm::vec2 e{n.x / l1, n.y / l1};
+    if(n.z < 0.0f)
+        e = {(1.0f - std::abs(e.y)) * sign(e.x), (1.0f - std::abs(e.x)) * sign(e.y)};
+
+    return e;
+}
+
+glm::vec3 benzene::vertex_packing::octahedral_decode(glm::vec2 e){
+    glm::vec3 n{e.x, e.y, 1.0f - std::abs(e.x) - std::abs(e.y)};
+    float t = std::max(-n.z, 0.0f);
+    n.x += (n.x >= 0.0f) ? -t : t;
+    n.y += (n.y >= 0.0f) ? -t : t;
+    return glm::normalize(n);
+}
+
+void benzene::vertex_packing::pack(const Mesh::Vertex* in, size_t n, PackedVertex* out, Isa isa){
+    switch (isa){
+        #ifdef BENZENE_SIMD_X86
+        case Isa::Avx2: impl::pack_avx2((const float*)in, n, out); break;
+        #endif
+        default: impl::pack_scalar((const float*)in, n, out); break;
+    }
+}
+
+void benzene::vertex_packing::impl::pack_scalar(const float* in, size_t n, PackedVertex* out){
+    auto snorm16 = [](float v){
+        // nearbyint rounds to even like cvtps_epi32 does, so both paths produce identical bits
+        return (int16_t)std::nearbyint(std::clamp(v, -1.0f, 1.0f) * 32767.0f);
+    };
+
+    for(size_t i = 0; i < n; i++){
+        const float* v = in + i * layout::stride;
+        auto& o = out[i];
+
+        for(int j = 0; j < 3; j++)
+            o.pos[j] = float_to_half(v[layout::pos + j]);
+        o.pos[3] = 0;
+
+        auto normal = octahedral_encode({v[layout::normal], v[layout::normal + 1], v[layout::normal + 2]});
+        auto tangent = octahedral_encode({v[layout::tangent], v[layout::tangent + 1], v[layout::tangent + 2]});
+        o.normal[0] = snorm16(normal.x);
+        o.normal[1] = snorm16(normal.y);
+        o.tangent[0] = snorm16(tangent.x);
+        o.tangent[1] = snorm16(tangent.y);
+
+        o.uv[0] = float_to_half(v[layout::uv]);
+        o.uv[1] = float_to_half(v[layout::uv + 1]);
+    }
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <benzene/benzene.hpp>
+#include "transform_kernel.hpp"
+#include "vertex_packing_simd.hpp"
+
+namespace benzene::vertex_packing
+{
+    using transform_kernel::Isa;
+    using transform_kernel::best_isa;
+
+    // Round to nearest even, the same as F16C
+    uint16_t float_to_half(float f);
+    float half_to_float(uint16_t h);
+
+    // Maps a unit vector onto the octahedron unfolded into [-1, 1]^2
+    glm::vec2 octahedral_encode(glm::vec3 n);
+    glm::vec3 octahedral_decode(glm::vec2 e);
+
+    void pack(const Mesh::Vertex* in, size_t n, PackedVertex* out, Isa isa = best_isa());
+} // namespace benzene::vertex_packing
@@ -0,0 +1,69 @@
+#include "vertex_packing_simd.hpp"
+
+#include <immintrin.h>
+#include <cstring>
+
+namespace {
+    // Octahedral encoding of 8 vectors at once, then quantized to snorm16 and packed as (x | y << 16)
+    __m256i encode_octahedral(__m256 x, __m256 y, __m256 z){
+        const __m256 sign_mask = _mm256_set1_ps(-0.0f);
+        const __m256 one = _mm256_set1_ps(1.0f);
+
+        __m256 l1 = _mm256_add_ps(_mm256_add_ps(_mm256_andnot_ps(sign_mask, x), _mm256_andnot_ps(sign_mask, y)), _mm256_andnot_ps(sign_mask, z));
+        // A real division rather than a reciprocal, so the result matches the scalar path bit for bit
+        l1 = _mm256_max_ps(l1, _mm256_set1_ps(1e-20f));
+        __m256 ex = _mm256_div_ps(x, l1);
+        __m256 ey = _mm256_div_ps(y, l1);
+
+        // sign() is 1 for +0 as well, so build it from a >= 0 compare instead of copying the sign bit
+        __m256 sign_x = _mm256_blendv_ps(_mm256_set1_ps(-1.0f), one, _mm256_cmp_ps(ex, _mm256_setzero_ps(), _CMP_GE_OQ));
+        __m256 sign_y = _mm256_blendv_ps(_mm256_set1_ps(-1.0f), one, _mm256_cmp_ps(ey, _mm256_setzero_ps(), _CMP_GE_OQ));
+        __m256 folded_x = _mm256_mul_ps(_mm256_sub_ps(one, _mm256_andnot_ps(sign_mask, ey)), sign_x);
+        __m256 folded_y = _mm256_mul_ps(_mm256_sub_ps(one, _mm256_andnot_ps(sign_mask, ex)), sign_y);
+
+        __m256 lower = _mm256_cmp_ps(z, _mm256_setzero_ps(), _CMP_LT_OQ);
+        ex = _mm256_blendv_ps(ex, folded_x, lower);
+        ey = _mm256_blendv_ps(ey, folded_y, lower);
+
+        auto quantize = [&](__m256 v){
+            v = _mm256_min_ps(_mm256_max_ps(v, _mm256_set1_ps(-1.0f)), one);
+            return _mm256_cvtps_epi32(_mm256_mul_ps(v, _mm256_set1_ps(32767.0f)));
+        };
+
+        __m256i qx = _mm256_and_si256(quantize(ex), _mm256_set1_epi32(0xFFFF));
+        __m256i qy = _mm256_slli_epi32(quantize(ey), 16);
+        return _mm256_or_si256(qx, qy);
+    }
+}
+
+void benzene::vertex_packing::impl::pack_avx2(const float* in, size_t n, PackedVertex* out){
+    const __m256i gather_index = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    const __m256i vertex_index = _mm256_mullo_epi32(gather_index, _mm256_set1_epi32((int)layout::stride));
+
+    size_t i = 0;
+    for(; i + 8 <= n; i += 8){
+        const float* v = in + i * layout::stride;
+        auto component = [&](size_t offset){ return _mm256_i32gather_ps(v + offset, vertex_index, 4); };
+
+        alignas(32) uint32_t normals[8], tangents[8], uvs[8];
+        _mm256_store_si256((__m256i*)normals, encode_octahedral(component(layout::normal), component(layout::normal + 1), component(layout::normal + 2)));
+        _mm256_store_si256((__m256i*)tangents, encode_octahedral(component(layout::tangent), component(layout::tangent + 1), component(layout::tangent + 2)));
+
+        __m128i u = _mm256_cvtps_ph(component(layout::uv), _MM_FROUND_TO_NEAREST_INT);
+        __m128i w = _mm256_cvtps_ph(component(layout::uv + 1), _MM_FROUND_TO_NEAREST_INT);
+        _mm_store_si128((__m128i*)uvs, _mm_unpacklo_epi16(u, w));
+        _mm_store_si128((__m128i*)(uvs + 4), _mm_unpackhi_epi16(u, w));
+
+        for(size_t j = 0; j < 8; j++){
+            // The padded vec3 is loaded whole, its 4th lane is cleared so the padding half is always 0
+            __m128 pos = _mm_blend_ps(_mm_loadu_ps(v + j * layout::stride + layout::pos), _mm_setzero_ps(), 0b1000);
+            _mm_storel_epi64((__m128i*)out[i + j].pos, _mm_cvtps_ph(pos, _MM_FROUND_TO_NEAREST_INT));
+
+            std::memcpy(out[i + j].normal, &normals[j], sizeof(uint32_t));
+            std::memcpy(out[i + j].tangent, &tangents[j], sizeof(uint32_t));
+            std::memcpy(out[i + j].uv, &uvs[j], sizeof(uint32_t));
+        }
+    }
+
+    pack_scalar(in + i * layout::stride, n - i, out + i);
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+// Shared between the per-ISA translation units, like transform_kernel_simd.hpp this has to stay free of anything with external linkage
+
+#include <cstddef>
+#include <cstdint>
+
+namespace benzene::vertex_packing
+{
+    // 20 bytes instead of the 64 of a padded benzene::Mesh::Vertex
+    struct PackedVertex {
+        uint16_t pos[4]; // Half floats, the 4th is padding
+        int16_t normal[2]; // Octahedral, snorm16
+        int16_t tangent[2]; // Octahedral, snorm16
+        uint16_t uv[2]; // Half floats
+    };
+    static_assert(sizeof(PackedVertex) == 20);
+
+    // Where the components of a benzene::Mesh::Vertex are, in floats, checked against the real struct in vertex_packing.cpp
+    namespace layout {
+        constexpr size_t pos = 0, normal = 4, tangent = 8, uv = 12;
+        constexpr size_t stride = 16;
+    }
+
+    namespace impl {
+        void pack_scalar(const float* in, size_t n, PackedVertex* out);
+        void pack_avx2(const float* in, size_t n, PackedVertex* out);
+    }
+} // namespace benzene::vertex_packing
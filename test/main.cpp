@@ -7,6 +7,7 @@ int main([[maybe_unused]] int argc, [[maybe_unused]] char const *argv[])
 {
     benzene::Instance engine{"Benzene-test", 800, 600};
     //engine.get_backend().set_fps_cap(true, 60);
+    //engine.get_backend().set_render_thread(true);
 
     /*auto mesh = benzene::Mesh::Primitives::cube();
     mesh.textures.push_back(benzene::Texture::load_from_file("../engine/resources/obama.jpg", "diffuse", benzene::Texture::Gamut::Srgb));